@@ -2361,7 +2361,7 @@ static int64_t getmaxrss(void)
 int main(int argc, char **argv)
 {
     int ret;
-    int64_t ti;
+    int64_t ti, rti;
 
     atexit(exit_program);
 
@@ -2395,13 +2395,16 @@ int main(int argc, char **argv)
         exit(1);
     }
 
-    ti = getutime();
+    ti  = getutime();
+    rti = av_gettime();
     if (transcode() < 0)
         exit(1);
-    ti = getutime() - ti;
+    ti  = getutime() - ti;
+    rti = av_gettime() - rti;
     if (do_benchmark) {
         int maxrss = getmaxrss() / 1024;
-        printf("bench: utime=%0.3fs maxrss=%ikB\n", ti / 1000000.0, maxrss);
+        printf("bench: utime=%0.3fs rtime=%0.3fs maxrss=%ikB\n",
+               ti / 1000000.0, rti / 1000000.0, maxrss);
     }
 
     exit(0);
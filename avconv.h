@@ -341,6 +341,8 @@ extern int copy_tb;
 extern int exit_on_error;
 extern int print_stats;
 extern int qp_hist;
+extern int filter_nbthreads;
+extern int filter_branches;
 
 extern const AVIOInterruptCB int_cb;
 
@@ -502,6 +502,9 @@ int configure_filtergraph(FilterGraph *fg)
     avfilter_graph_free(&fg->graph);
     if (!(fg->graph = avfilter_graph_alloc()))
         return AVERROR(ENOMEM);
+    fg->graph->nb_threads = filter_nbthreads;
+    if (filter_branches)
+        fg->graph->thread_type |= AVFILTER_THREAD_BRANCH;
 
     if (simple) {
         OutputStream *ost = fg->outputs[0]->ost;
@@ -71,6 +71,8 @@ int copy_tb           = 1;
 int exit_on_error     = 0;
 int print_stats       = 1;
 int qp_hist           = 0;
+int filter_nbthreads  = 0;
+int filter_branches   = 0;
 
 static int file_overwrite     = 0;
 static int video_discard      = 0;
@@ -2139,6 +2141,10 @@ const OptionDef options[] = {
         "set stream filterchain", "filter_list" },
     { "filter_complex", HAS_ARG | OPT_EXPERT,                        { .func_arg = opt_filter_complex },
         "create a complex filtergraph", "graph_description" },
+    { "filter_threads", HAS_ARG | OPT_INT | OPT_EXPERT,              { &filter_nbthreads },
+        "number of threads used by filtergraphs (0 for automatic)", "number" },
+    { "filter_branches", OPT_BOOL | OPT_EXPERT,                      { &filter_branches },
+        "run independent filtergraph branches concurrently" },
     { "stats",          OPT_BOOL,                                    { &print_stats },
         "print progress report during encoding", },
     { "attach",         HAS_ARG | OPT_PERFILE | OPT_EXPERT |
@@ -989,6 +989,12 @@ enum AVFieldOrder {
     AV_FIELD_BT,          //< Bottom coded first, top displayed first
 };
 
+/**
+ * Pool of worker threads that can be shared by several codec contexts.
+ * Opaque, see avcodec_thread_pool_alloc().
+ */
+typedef struct AVCodecThreadPool AVCodecThreadPool;
+
 /**
  * main external API structure.
  * New fields can be added to the end with minor version bumps.
@@ -2648,6 +2654,22 @@ typedef struct AVCodecContext {
      * - decoding: unused.
      */
     uint64_t vbv_delay;
+
+    /**
+     * Thread pool shared with other codec contexts.
+     * If set, the slice threading jobs of this context are run by the
+     * workers of the pool instead of by threads owned by the context.
+     * The jobs of one execute() call are not guaranteed to run
+     * concurrently, so codecs whose jobs wait for each other do not
+     * split their work when a pool is used.
+     * Only slice threading uses the pool: with frame threading the
+     * context still starts threads of its own, the pool only limiting
+     * their automatic number.
+     * The pool must not be freed before the context is closed.
+     * - encoding: Set by user before avcodec_open2().
+     * - decoding: Set by user before avcodec_open2().
+     */
+    AVCodecThreadPool *thread_pool;
 } AVCodecContext;
 
 /**
@@ -4023,6 +4045,30 @@ int avcodec_default_execute(AVCodecContext *c, int (*func)(AVCodecContext *c2, v
 int avcodec_default_execute2(AVCodecContext *c, int (*func)(AVCodecContext *c2, void *arg2, int, int),void *arg, int *ret, int count);
 //FIXME func typedef
 
+/**
+ * Allocate a thread pool to be shared by several codec contexts through
+ * AVCodecContext.thread_pool.
+ *
+ * Slice threading jobs submitted by all the contexts using the pool are
+ * distributed over its workers, giving each context with pending jobs an
+ * even share of the workers. Frame threading still needs one thread per
+ * frame in flight and keeps starting its own threads, so the pool covers
+ * slice threading only and merely limits the automatic frame thread count.
+ *
+ * @param nb_threads number of worker threads, 0 to use the number of
+ *                   logical CPUs
+ * @return the new pool or NULL on failure or if threading is not available
+ */
+AVCodecThreadPool *avcodec_thread_pool_alloc(int nb_threads);
+
+/**
+ * Stop the workers of a thread pool and free it. All the codec contexts
+ * using the pool must have been closed.
+ *
+ * @param pool pointer to the pool to free, set to NULL afterwards
+ */
+void avcodec_thread_pool_free(AVCodecThreadPool **pool);
+
 /**
  * Fill audio frame data and linesize.
  * AVFrame extended_data channel pointers are allocated if necessary for
@@ -1243,6 +1243,12 @@ int ff_h264_alloc_tables(H264Context *h)
             h->mb2br_xy[mb_xy] = 8 * (FMO ? mb_xy : (mb_xy % (2 * h->mb_stride)));
         }
 
+    if (!h->dequant4_buffer) {
+        FF_ALLOCZ_OR_GOTO(h->avctx, h->dequant4_buffer,
+                          6 * sizeof(*h->dequant4_buffer), fail);
+        FF_ALLOCZ_OR_GOTO(h->avctx, h->dequant8_buffer,
+                          6 * sizeof(*h->dequant8_buffer), fail);
+    }
     if (!h->dequant4_coeff[0])
         init_dequant_tables(h);
 
@@ -1538,6 +1544,8 @@ static int decode_init_thread_copy(AVCodecContext *avctx)
         return 0;
     memset(h->sps_buffers, 0, sizeof(h->sps_buffers));
     memset(h->pps_buffers, 0, sizeof(h->pps_buffers));
+    h->dequant4_buffer = NULL;
+    h->dequant8_buffer = NULL;
 
     h->context_initialized = 0;
 
@@ -1598,6 +1606,9 @@ static int decode_update_thread_context(AVCodecContext *dst,
     }
 
     if (!inited) {
+        uint32_t (*dequant4_buffer)[QP_MAX_NUM + 1][16] = h->dequant4_buffer;
+        uint32_t (*dequant8_buffer)[QP_MAX_NUM + 1][64] = h->dequant8_buffer;
+
         for (i = 0; i < MAX_SPS_COUNT; i++)
             av_freep(h->sps_buffers + i);
 
@@ -1607,6 +1618,8 @@ static int decode_update_thread_context(AVCodecContext *dst,
         memcpy(h, h1, sizeof(*h1));
         memset(h->sps_buffers, 0, sizeof(h->sps_buffers));
         memset(h->pps_buffers, 0, sizeof(h->pps_buffers));
+        h->dequant4_buffer = dequant4_buffer;
+        h->dequant8_buffer = dequant8_buffer;
         memset(&h->er, 0, sizeof(h->er));
         memset(&h->me, 0, sizeof(h->me));
         h->context_initialized = 0;
@@ -1689,7 +1702,10 @@ static int decode_update_thread_context(AVCodecContext *dst,
 
     // Dequantization matrices
     // FIXME these are big - can they be only copied when PPS changes?
-    copy_fields(h, h1, dequant4_buffer, dequant4_coeff);
+    memcpy(h->dequant4_buffer, h1->dequant4_buffer,
+           6 * sizeof(*h->dequant4_buffer));
+    memcpy(h->dequant8_buffer, h1->dequant8_buffer,
+           6 * sizeof(*h->dequant8_buffer));
 
     for (i = 0; i < 6; i++)
         h->dequant4_coeff[i] = h->dequant4_buffer[0] +
@@ -4698,6 +4714,9 @@ av_cold void ff_h264_free_context(H264Context *h)
 
     free_tables(h, 1); // FIXME cleanup init stuff perhaps
 
+    av_freep(&h->dequant4_buffer);
+    av_freep(&h->dequant8_buffer);
+
     for (i = 0; i < MAX_SPS_COUNT; i++)
         av_freep(h->sps_buffers + i);
 
@@ -54,9 +54,10 @@
 
 /**
  * The maximum number of slices supported by the decoder.
- * must be a power of 2
+ * must be a power of 2 and at least MAX_THREADS, so that the slices decoded
+ * concurrently by the slice threads do not alias in ref2frm
  */
-#define MAX_SLICES 16
+#define MAX_SLICES 64
 
 #ifdef ALLOW_INTERLACE
 #define MB_MBAFF    h->mb_mbaff
@@ -357,8 +358,13 @@ typedef struct H264Context {
      */
     PPS pps; // FIXME move to Picture perhaps? (->no) do we need that?
 
-    uint32_t dequant4_buffer[6][QP_MAX_NUM + 1][16]; // FIXME should these be moved down?
-    uint32_t dequant8_buffer[6][QP_MAX_NUM + 1][64];
+    /**
+     * Storage for the 6 dequantization tables of each size, only allocated
+     * in the main context. Slice thread contexts use the tables of the main
+     * context through dequant4_coeff and dequant8_coeff.
+     */
+    uint32_t (*dequant4_buffer)[QP_MAX_NUM + 1][16];
+    uint32_t (*dequant8_buffer)[QP_MAX_NUM + 1][64];
     uint32_t(*dequant4_coeff[6])[16];
     uint32_t(*dequant8_coeff[6])[64];
 
@@ -384,10 +384,11 @@ int ff_mjpeg_decode_sof(MJpegDecodeContext *s)
     return 0;
 }
 
-static inline int mjpeg_decode_dc(MJpegDecodeContext *s, int dc_index)
+static inline int mjpeg_decode_dc(MJpegDecodeContext *s, GetBitContext *gb,
+                                  int dc_index)
 {
     int code;
-    code = get_vlc2(&s->gb, s->vlcs[0][dc_index].table, 9, 2);
+    code = get_vlc2(gb, s->vlcs[0][dc_index].table, 9, 2);
     if (code < 0) {
         av_log(s->avctx, AV_LOG_WARNING,
                "mjpeg_decode_dc: bad vlc: %d:%d (%p)\n",
@@ -396,46 +397,47 @@ static inline int mjpeg_decode_dc(MJpegDecodeContext *s, int dc_index)
     }
 
     if (code)
-        return get_xbits(&s->gb, code);
+        return get_xbits(gb, code);
     else
         return 0;
 }
 
 /* decode block and dequantize */
-static int decode_block(MJpegDecodeContext *s, int16_t *block, int component,
+static int decode_block(MJpegDecodeContext *s, GetBitContext *gb,
+                        int16_t *block, int *last_dc,
                         int dc_index, int ac_index, int16_t *quant_matrix)
 {
     int code, i, j, level, val;
 
     /* DC coef */
-    val = mjpeg_decode_dc(s, dc_index);
+    val = mjpeg_decode_dc(s, gb, dc_index);
     if (val == 0xffff) {
         av_log(s->avctx, AV_LOG_ERROR, "error dc\n");
         return AVERROR_INVALIDDATA;
     }
-    val = val * quant_matrix[0] + s->last_dc[component];
-    s->last_dc[component] = val;
+    val = val * quant_matrix[0] + *last_dc;
+    *last_dc = val;
     block[0] = val;
     /* AC coefs */
     i = 0;
-    {OPEN_READER(re, &s->gb);
+    {OPEN_READER(re, gb);
     do {
-        UPDATE_CACHE(re, &s->gb);
-        GET_VLC(code, re, &s->gb, s->vlcs[1][ac_index].table, 9, 2);
+        UPDATE_CACHE(re, gb);
+        GET_VLC(code, re, gb, s->vlcs[1][ac_index].table, 9, 2);
 
         i += ((unsigned)code) >> 4;
             code &= 0xf;
         if (code) {
             if (code > MIN_CACHE_BITS - 16)
-                UPDATE_CACHE(re, &s->gb);
+                UPDATE_CACHE(re, gb);
 
             {
-                int cache = GET_CACHE(re, &s->gb);
+                int cache = GET_CACHE(re, gb);
                 int sign  = (~cache) >> 31;
                 level     = (NEG_USR32(sign ^ cache,code) ^ sign) - sign;
             }
 
-            LAST_SKIP_BITS(re, &s->gb, code);
+            LAST_SKIP_BITS(re, gb, code);
 
             if (i > 63) {
                 av_log(s->avctx, AV_LOG_ERROR, "error count: %d\n", i);
@@ -445,24 +447,24 @@ static int decode_block(MJpegDecodeContext *s, int16_t *block, int component,
             block[j] = level * quant_matrix[j];
         }
     } while (i < 63);
-    CLOSE_READER(re, &s->gb);}
+    CLOSE_READER(re, gb);}
 
     return 0;
 }
 
-static int decode_dc_progressive(MJpegDecodeContext *s, int16_t *block,
-                                 int component, int dc_index,
+static int decode_dc_progressive(MJpegDecodeContext *s, GetBitContext *gb,
+                                 int16_t *block, int *last_dc, int dc_index,
                                  int16_t *quant_matrix, int Al)
 {
     int val;
     s->dsp.clear_block(block);
-    val = mjpeg_decode_dc(s, dc_index);
+    val = mjpeg_decode_dc(s, gb, dc_index);
     if (val == 0xffff) {
         av_log(s->avctx, AV_LOG_ERROR, "error dc\n");
         return AVERROR_INVALIDDATA;
     }
-    val = (val * quant_matrix[0] << Al) + s->last_dc[component];
-    s->last_dc[component] = val;
+    val = (val * quant_matrix[0] << Al) + *last_dc;
+    *last_dc = val;
     block[0] = val;
     return 0;
 }
@@ -670,7 +672,7 @@ static int ljpeg_decode_rgb_scan(MJpegDecodeContext *s, int predictor,
                 PREDICT(pred, topleft[i], top[i], left[i], modified_predictor);
 
                 left[i] = buffer[mb_x][i] =
-                    mask & (pred + (mjpeg_decode_dc(s, s->dc_index[i]) << point_transform));
+                    mask & (pred + (mjpeg_decode_dc(s, &s->gb, s->dc_index[i]) << point_transform));
             }
 
             if (s->restart_interval && !--s->restart_count) {
@@ -746,7 +748,7 @@ static int ljpeg_decode_yuv_scan(MJpegDecodeContext *s, int predictor,
 
                         if (s->interlaced && s->bottom_field)
                             ptr += linesize >> 1;
-                        *ptr = pred + (mjpeg_decode_dc(s, s->dc_index[i]) << point_transform);
+                        *ptr = pred + (mjpeg_decode_dc(s, &s->gb, s->dc_index[i]) << point_transform);
 
                         if (++x == h) {
                             x = 0;
@@ -775,7 +777,7 @@ static int ljpeg_decode_yuv_scan(MJpegDecodeContext *s, int predictor,
                               (h * mb_x + x);
                         PREDICT(pred, ptr[-linesize - 1],
                                 ptr[-linesize], ptr[-1], predictor);
-                        *ptr = pred + (mjpeg_decode_dc(s, s->dc_index[i]) << point_transform);
+                        *ptr = pred + (mjpeg_decode_dc(s, &s->gb, s->dc_index[i]) << point_transform);
                         if (++x == h) {
                             x = 0;
                             y++;
@@ -792,14 +794,199 @@ static int ljpeg_decode_yuv_scan(MJpegDecodeContext *s, int predictor,
     return 0;
 }
 
+typedef struct MJpegScan {
+    uint8_t *data[MAX_COMPONENTS];
+    const uint8_t *reference_data[MAX_COMPONENTS];
+    int linesize[MAX_COMPONENTS];
+    int nb_components, Ah, Al;
+    int mcu_count;              ///< number of MCUs in the scan
+    const uint8_t *buf;         ///< unescaped scan data
+    int buf_size;
+    int start;                  ///< offset of the first MCU in buf
+    int first_marker;           ///< index of the first RSTn in restart_offsets
+    int end_bits;               ///< bit position in buf after the last MCU
+    int end_restart_count;      ///< restart_count after the last MCU
+} MJpegScan;
+
+/**
+ * Decode the MCUs [mcu, mcu_end) of a scan.
+ * The bit reader, DC predictors and restart counter are passed explicitly
+ * so that independent restart intervals can be decoded concurrently.
+ */
+static int decode_scan_mcus(MJpegDecodeContext *s, const MJpegScan *scan,
+                            GetBitContext *gb, int16_t *block, int *last_dc,
+                            int *restart_count, int mcu, int mcu_end,
+                            GetBitContext *mb_bitmask_gb)
+{
+    int i, mb_x = mcu % s->mb_width, mb_y = mcu / s->mb_width;
+
+    for (; mcu < mcu_end; mcu++) {
+        const int copy_mb = mb_bitmask_gb && !get_bits1(mb_bitmask_gb);
+
+        if (s->restart_interval && !*restart_count)
+            *restart_count = s->restart_interval;
+
+        if (get_bits_left(gb) < 0) {
+            av_log(s->avctx, AV_LOG_ERROR, "overread %d\n",
+                   -get_bits_left(gb));
+            return AVERROR_INVALIDDATA;
+        }
+        for (i = 0; i < scan->nb_components; i++) {
+            uint8_t *ptr;
+            int n, h, v, x, y, c, j;
+            int block_offset;
+            int linesize = scan->linesize[s->comp_index[i]];
+            n = s->nb_blocks[i];
+            c = s->comp_index[i];
+            h = s->h_scount[i];
+            v = s->v_scount[i];
+            x = 0;
+            y = 0;
+            for (j = 0; j < n; j++) {
+                block_offset = ((linesize * (v * mb_y + y) * 8) +
+                                (h * mb_x + x) * 8);
+
+                if (s->interlaced && s->bottom_field)
+                    block_offset += linesize >> 1;
+                ptr = scan->data[c] + block_offset;
+                if (!s->progressive) {
+                    if (copy_mb)
+                        s->dsp.put_pixels_tab[1][0](ptr,
+                            scan->reference_data[c] + block_offset,
+                            linesize, 8);
+                    else {
+                        s->dsp.clear_block(block);
+                        if (decode_block(s, gb, block, &last_dc[i],
+                                         s->dc_index[i], s->ac_index[i],
+                                         s->quant_matrixes[s->quant_index[c]]) < 0) {
+                            av_log(s->avctx, AV_LOG_ERROR,
+                                   "error y=%d x=%d\n", mb_y, mb_x);
+                            return AVERROR_INVALIDDATA;
+                        }
+                        s->dsp.idct_put(ptr, linesize, block);
+                    }
+                } else {
+                    int block_idx  = s->block_stride[c] * (v * mb_y + y) +
+                                     (h * mb_x + x);
+                    int16_t *coefs = s->blocks[c][block_idx];
+                    if (scan->Ah)
+                        coefs[0] += get_bits1(gb) *
+                                    s->quant_matrixes[s->quant_index[c]][0] << scan->Al;
+                    else if (decode_dc_progressive(s, gb, coefs, &last_dc[i],
+                                                   s->dc_index[i],
+                                                   s->quant_matrixes[s->quant_index[c]],
+                                                   scan->Al) < 0) {
+                        av_log(s->avctx, AV_LOG_ERROR,
+                               "error y=%d x=%d\n", mb_y, mb_x);
+                        return AVERROR_INVALIDDATA;
+                    }
+                }
+                av_dlog(s->avctx, "mb: %d %d processed\n", mb_y, mb_x);
+                av_dlog(s->avctx, "%d %d %d %d %d %d %d %d \n",
+                        mb_x, mb_y, x, y, c, s->bottom_field,
+                        (v * mb_y + y) * 8, (h * mb_x + x) * 8);
+                if (++x == h) {
+                    x = 0;
+                    y++;
+                }
+            }
+        }
+
+        if (s->restart_interval) {
+            (*restart_count)--;
+            i = 8 + ((-get_bits_count(gb)) & 7);
+            /* skip RSTn */
+            if (show_bits(gb, i) == (1 << i) - 1) {
+                int pos = get_bits_count(gb);
+                align_get_bits(gb);
+                while (get_bits_left(gb) >= 8 && show_bits(gb, 8) == 0xFF)
+                    skip_bits(gb, 8);
+                if ((get_bits(gb, 8) & 0xF8) == 0xD0) {
+                    for (i = 0; i < scan->nb_components; i++) /* reset dc */
+                        last_dc[i] = 1024;
+                } else
+                    skip_bits_long(gb, pos - get_bits_count(gb));
+            }
+        }
+
+        if (++mb_x == s->mb_width) {
+            mb_x = 0;
+            mb_y++;
+        }
+    }
+    return 0;
+}
+
+static int decode_restart_interval(AVCodecContext *avctx, void *arg,
+                                   int jobnr, int threadnr)
+{
+    MJpegDecodeContext *s = avctx->priv_data;
+    MJpegScan *scan       = arg;
+    int start   = jobnr ? s->restart_offsets[scan->first_marker + jobnr - 1] :
+                          scan->start;
+    int mcu     = jobnr * s->restart_interval;
+    int end     = mcu + s->restart_interval < scan->mcu_count ?
+                  s->restart_offsets[scan->first_marker + jobnr] : scan->buf_size;
+    int mcu_end = FFMIN(mcu + s->restart_interval, scan->mcu_count);
+    int last_dc[MAX_COMPONENTS];
+    int restart_count = 0;
+    int i, ret;
+    GetBitContext gb;
+    LOCAL_ALIGNED_16(int16_t, block, [64]);
+
+    for (i = 0; i < scan->nb_components; i++)
+        last_dc[i] = 1024;
+
+    init_get_bits(&gb, scan->buf + start, (end - start) * 8);
+    ret = decode_scan_mcus(s, scan, &gb, block, last_dc, &restart_count,
+                           mcu, mcu_end, NULL);
+
+    if (mcu_end == scan->mcu_count) {
+        scan->end_bits          = start * 8 + get_bits_count(&gb);
+        scan->end_restart_count = restart_count;
+    }
+    return ret;
+}
+
+/**
+ * Check whether the restart intervals of the current scan can be decoded
+ * in parallel, i.e. whether a RSTn marker was found in the scan data for
+ * every interval boundary.
+ * @return the number of restart intervals, 0 if the scan has to be decoded
+ *         serially
+ */
+static int find_restart_intervals(MJpegDecodeContext *s, MJpegScan *scan)
+{
+    int nb_intervals, i;
+
+    if (!(s->avctx->active_thread_type & FF_THREAD_SLICE) ||
+        !s->restart_interval || s->restart_count || s->progressive ||
+        (get_bits_count(&s->gb) & 7))
+        return 0;
+
+    nb_intervals = (scan->mcu_count + s->restart_interval - 1) /
+                   s->restart_interval;
+    if (nb_intervals < 2)
+        return 0;
+
+    /* skip the markers of a previous field */
+    scan->start = get_bits_count(&s->gb) >> 3;
+    for (i = 0; i < s->nb_restart_offsets; i++)
+        if (s->restart_offsets[i] > scan->start)
+            break;
+    if (s->nb_restart_offsets - i < nb_intervals - 1)
+        return 0;
+    scan->first_marker = i;
+
+    return nb_intervals;
+}
+
 static int mjpeg_decode_scan(MJpegDecodeContext *s, int nb_components, int Ah,
                              int Al, const uint8_t *mb_bitmask,
                              const AVFrame *reference)
 {
-    int i, mb_x, mb_y;
-    uint8_t *data[MAX_COMPONENTS];
-    const uint8_t *reference_data[MAX_COMPONENTS];
-    int linesize[MAX_COMPONENTS];
+    int i, nb_intervals;
+    MJpegScan scan = { { 0 } };
     GetBitContext mb_bitmask_gb;
 
     if (mb_bitmask)
@@ -811,112 +998,55 @@ static int mjpeg_decode_scan(MJpegDecodeContext *s, int nb_components, int Ah,
         s->flipped = 0;
     }
 
+    scan.nb_components = nb_components;
+    scan.Ah            = Ah;
+    scan.Al            = Al;
+    scan.mcu_count     = s->mb_width * s->mb_height;
+
     for (i = 0; i < nb_components; i++) {
         int c   = s->comp_index[i];
-        data[c] = s->picture_ptr->data[c];
-        reference_data[c] = reference ? reference->data[c] : NULL;
-        linesize[c] = s->linesize[c];
+        scan.data[c] = s->picture_ptr->data[c];
+        scan.reference_data[c] = reference ? reference->data[c] : NULL;
+        scan.linesize[c] = s->linesize[c];
         s->coefs_finished[c] |= 1;
         if (s->flipped) {
             // picture should be flipped upside-down for this codec
-            int offset = (linesize[c] * (s->v_scount[i] *
+            int offset = (scan.linesize[c] * (s->v_scount[i] *
                          (8 * s->mb_height - ((s->height / s->v_max) & 7)) - 1));
-            data[c]           += offset;
-            reference_data[c] += offset;
-            linesize[c]       *= -1;
+            scan.data[c]           += offset;
+            scan.reference_data[c] += offset;
+            scan.linesize[c]       *= -1;
         }
     }
 
-    for (mb_y = 0; mb_y < s->mb_height; mb_y++) {
-        for (mb_x = 0; mb_x < s->mb_width; mb_x++) {
-            const int copy_mb = mb_bitmask && !get_bits1(&mb_bitmask_gb);
+    if (!mb_bitmask && (nb_intervals = find_restart_intervals(s, &scan))) {
+        int *rets;
 
-            if (s->restart_interval && !s->restart_count)
-                s->restart_count = s->restart_interval;
+        av_fast_malloc(&s->restart_rets, &s->restart_rets_size,
+                       nb_intervals * sizeof(*s->restart_rets));
+        if (!s->restart_rets)
+            return AVERROR(ENOMEM);
+        rets = s->restart_rets;
 
-            if (get_bits_left(&s->gb) < 0) {
-                av_log(s->avctx, AV_LOG_ERROR, "overread %d\n",
-                       -get_bits_left(&s->gb));
-                return AVERROR_INVALIDDATA;
-            }
-            for (i = 0; i < nb_components; i++) {
-                uint8_t *ptr;
-                int n, h, v, x, y, c, j;
-                int block_offset;
-                n = s->nb_blocks[i];
-                c = s->comp_index[i];
-                h = s->h_scount[i];
-                v = s->v_scount[i];
-                x = 0;
-                y = 0;
-                for (j = 0; j < n; j++) {
-                    block_offset = ((linesize[c] * (v * mb_y + y) * 8) +
-                                    (h * mb_x + x) * 8);
-
-                    if (s->interlaced && s->bottom_field)
-                        block_offset += linesize[c] >> 1;
-                    ptr = data[c] + block_offset;
-                    if (!s->progressive) {
-                        if (copy_mb)
-                            s->dsp.put_pixels_tab[1][0](ptr,
-                                reference_data[c] + block_offset,
-                                linesize[c], 8);
-                        else {
-                            s->dsp.clear_block(s->block);
-                            if (decode_block(s, s->block, i,
-                                             s->dc_index[i], s->ac_index[i],
-                                             s->quant_matrixes[s->quant_index[c]]) < 0) {
-                                av_log(s->avctx, AV_LOG_ERROR,
-                                       "error y=%d x=%d\n", mb_y, mb_x);
-                                return AVERROR_INVALIDDATA;
-                            }
-                            s->dsp.idct_put(ptr, linesize[c], s->block);
-                        }
-                    } else {
-                        int block_idx  = s->block_stride[c] * (v * mb_y + y) +
-                                         (h * mb_x + x);
-                        int16_t *block = s->blocks[c][block_idx];
-                        if (Ah)
-                            block[0] += get_bits1(&s->gb) *
-                                        s->quant_matrixes[s->quant_index[c]][0] << Al;
-                        else if (decode_dc_progressive(s, block, i, s->dc_index[i],
-                                                       s->quant_matrixes[s->quant_index[c]],
-                                                       Al) < 0) {
-                            av_log(s->avctx, AV_LOG_ERROR,
-                                   "error y=%d x=%d\n", mb_y, mb_x);
-                            return AVERROR_INVALIDDATA;
-                        }
-                    }
-                    av_dlog(s->avctx, "mb: %d %d processed\n", mb_y, mb_x);
-                    av_dlog(s->avctx, "%d %d %d %d %d %d %d %d \n",
-                            mb_x, mb_y, x, y, c, s->bottom_field,
-                            (v * mb_y + y) * 8, (h * mb_x + x) * 8);
-                    if (++x == h) {
-                        x = 0;
-                        y++;
-                    }
-                }
-            }
+        scan.buf      = s->gb.buffer;
+        scan.buf_size = s->gb.size_in_bits >> 3;
 
-            if (s->restart_interval) {
-                s->restart_count--;
-                i = 8 + ((-get_bits_count(&s->gb)) & 7);
-                /* skip RSTn */
-                if (show_bits(&s->gb, i) == (1 << i) - 1) {
-                    int pos = get_bits_count(&s->gb);
-                    align_get_bits(&s->gb);
-                    while (get_bits_left(&s->gb) >= 8 && show_bits(&s->gb, 8) == 0xFF)
-                        skip_bits(&s->gb, 8);
-                    if ((get_bits(&s->gb, 8) & 0xF8) == 0xD0) {
-                        for (i = 0; i < nb_components; i++) /* reset dc */
-                            s->last_dc[i] = 1024;
-                    } else
-                        skip_bits_long(&s->gb, pos - get_bits_count(&s->gb));
-                }
-            }
-        }
+        s->avctx->execute2(s->avctx, decode_restart_interval, &scan, rets,
+                           nb_intervals);
+
+        /* leave the bit reader where the serial decoder would have */
+        skip_bits_long(&s->gb, scan.end_bits - get_bits_count(&s->gb));
+        s->restart_count = scan.end_restart_count;
+
+        for (i = 0; i < nb_intervals; i++)
+            if (rets[i] < 0)
+                return rets[i];
+        return 0;
     }
-    return 0;
+
+    return decode_scan_mcus(s, &scan, &s->gb, s->block, s->last_dc,
+                            &s->restart_count, 0, scan.mcu_count,
+                            mb_bitmask ? &mb_bitmask_gb : NULL);
 }
 
 static int mjpeg_decode_scan_progressive_ac(MJpegDecodeContext *s, int ss,
@@ -1348,6 +1478,31 @@ found:
     return val;
 }
 
+/**
+ * Remember the position following a RSTn marker in the unescaped scan data.
+ * Stuffed 0xFF bytes are indistinguishable from markers once unescaped, so
+ * the positions are recorded while unescaping.
+ */
+static int add_restart_offset(MJpegDecodeContext *s, int offset)
+{
+    if (s->nb_restart_offsets >= s->restart_offsets_size / sizeof(*s->restart_offsets)) {
+        int *tmp = av_fast_realloc(s->restart_offsets, &s->restart_offsets_size,
+                                   (s->nb_restart_offsets + 1) * 2 *
+                                   sizeof(*s->restart_offsets));
+        if (!tmp)
+            return AVERROR(ENOMEM);
+        s->restart_offsets = tmp;
+    }
+    s->restart_offsets[s->nb_restart_offsets++] = offset;
+    return 0;
+}
+
+/**
+ * Find the next marker and unescape the data following it.
+ *
+ * @return the marker, -1 if there is none before buf_end, another negative
+ *         AVERROR code on failure
+ */
 int ff_mjpeg_find_marker(MJpegDecodeContext *s,
                          const uint8_t **buf_ptr, const uint8_t *buf_end,
                          const uint8_t **unescaped_buf_ptr,
@@ -1365,6 +1520,8 @@ int ff_mjpeg_find_marker(MJpegDecodeContext *s,
         const uint8_t *src = *buf_ptr;
         uint8_t *dst = s->buffer;
 
+        s->nb_restart_offsets = 0;
+
         while (src < buf_end) {
             uint8_t x = *(src++);
 
@@ -1374,9 +1531,13 @@ int ff_mjpeg_find_marker(MJpegDecodeContext *s,
                     while (src < buf_end && x == 0xff)
                         x = *(src++);
 
-                    if (x >= 0xd0 && x <= 0xd7)
+                    if (x >= 0xd0 && x <= 0xd7) {
                         *(dst++) = x;
-                    else if (x)
+                        /* only needed to split the scan over slice threads */
+                        if (s->avctx->active_thread_type & FF_THREAD_SLICE &&
+                            add_restart_offset(s, dst - s->buffer) < 0)
+                            return AVERROR(ENOMEM);
+                    } else if (x)
                         break;
                 }
             }
@@ -1457,8 +1618,10 @@ int ff_mjpeg_decode_frame(AVCodecContext *avctx, void *data, int *got_frame,
                                           &unescaped_buf_ptr,
                                           &unescaped_buf_size);
         /* EOF */
-        if (start_code < 0) {
+        if (start_code == -1) {
             goto the_end;
+        } else if (start_code < 0) {
+            return start_code;
         } else if (unescaped_buf_size > (1U<<29)) {
             av_log(avctx, AV_LOG_ERROR, "MJPEG packet 0x%x too big (0x%x/0x%x), corrupt data?\n",
                    start_code, unescaped_buf_size, buf_size);
@@ -1626,6 +1789,8 @@ av_cold int ff_mjpeg_decode_end(AVCodecContext *avctx)
     av_free(s->buffer);
     av_freep(&s->ljpeg_buffer);
     s->ljpeg_buffer_size = 0;
+    av_freep(&s->restart_offsets);
+    av_freep(&s->restart_rets);
 
     for (i = 0; i < 3; i++) {
         for (j = 0; j < 4; j++)
@@ -1661,7 +1826,7 @@ AVCodec ff_mjpeg_decoder = {
     .init           = ff_mjpeg_decode_init,
     .close          = ff_mjpeg_decode_end,
     .decode         = ff_mjpeg_decode_frame,
-    .capabilities   = CODEC_CAP_DR1,
+    .capabilities   = CODEC_CAP_DR1 | CODEC_CAP_SLICE_THREADS,
     .long_name      = NULL_IF_CONFIG_SMALL("MJPEG (Motion JPEG)"),
     .priv_class     = &mjpegdec_class,
 };
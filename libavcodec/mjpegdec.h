@@ -97,6 +97,11 @@ typedef struct MJpegDecodeContext {
 
     int restart_interval;
     int restart_count;
+    int *restart_offsets;       ///< positions following the RSTn markers of the current scan
+    unsigned int restart_offsets_size;
+    int nb_restart_offsets;
+    int *restart_rets;          ///< return values of the restart interval jobs
+    unsigned int restart_rets_size;
 
     int buggy_avid;
     int cs_itu601;
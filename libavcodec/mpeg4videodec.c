@@ -2272,7 +2272,7 @@ AVCodec ff_mpeg4_decoder = {
     0, ff_h263_hwaccel_pixfmt_list_420,
     0, 0, 0, 0, 0, mpeg4_video_profiles,
     sizeof(MpegEncContext),
-    0, 0, 0,
+    0, 0, ONLY_IF_THREADS_ENABLED(ff_mpeg_update_thread_context),
     0, 0, decode_init,
     0, 0, ff_h263_decode_frame,
     ff_h263_decode_end,
@@ -175,8 +175,10 @@ static int mxpeg_decode_frame(AVCodecContext *avctx,
     while (buf_ptr < buf_end) {
         start_code = ff_mjpeg_find_marker(jpg, &buf_ptr, buf_end,
                                           &unescaped_buf_ptr, &unescaped_buf_size);
-        if (start_code < 0)
+        if (start_code == -1)
             goto the_end;
+        if (start_code < 0)
+            return start_code;
         {
             init_get_bits(&jpg->gb, unescaped_buf_ptr, unescaped_buf_size*8);
 
@@ -0,0 +1,146 @@
+/*
+ * This file is part of Libav.
+ *
+ * Libav is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation; either
+ * version 2.1 of the License, or (at your option) any later version.
+ *
+ * Libav is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with Libav; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA
+ */
+
+/**
+ * @file
+ * Slice threading microbenchmark.
+ * Submits batches of small jobs through execute2() and prints the number
+ * of jobs per second for increasing thread counts, first with threads
+ * owned by the codec context, then with a shared AVCodecThreadPool.
+ * Every job result is checked, so this doubles as a test of the job
+ * schedulers.
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+
+#include "libavutil/mem.h"
+#include "libavutil/time.h"
+
+#include "avcodec.h"
+#include "thread.h"
+
+#define JOBS_PER_BATCH 256
+#define RUN_TIME       500000 ///< microseconds per thread count
+
+static int job_work = 1000;
+
+static int bench_job(AVCodecContext *avctx, void *arg, int jobnr, int threadnr)
+{
+    unsigned acc = jobnr;
+    int i;
+
+    for (i = 0; i < job_work; i++)
+        acc = acc * 1664525 + 1013904223;
+    ((unsigned *)arg)[jobnr] = acc;
+
+    return jobnr;
+}
+
+static AVCodec bench_codec = {
+    .name         = "bench",
+    .type         = AVMEDIA_TYPE_VIDEO,
+    .capabilities = CODEC_CAP_SLICE_THREADS,
+};
+
+static int run_bench(int thread_count, int use_pool, double *jobs_per_sec)
+{
+    AVCodecThreadPool *pool = NULL;
+    AVCodecContext *avctx;
+    unsigned sink[JOBS_PER_BATCH];
+    int rets[JOBS_PER_BATCH];
+    int64_t start, elapsed;
+    int64_t jobs = 0;
+    int i, ret = 0;
+
+    // the calling thread also runs jobs when a pool is used
+    if (use_pool && thread_count > 1 &&
+        !(pool = avcodec_thread_pool_alloc(thread_count - 1)))
+        return AVERROR(ENOMEM);
+
+    avctx = avcodec_alloc_context3(NULL);
+    if (!avctx) {
+        avcodec_thread_pool_free(&pool);
+        return AVERROR(ENOMEM);
+    }
+    avctx->codec        = &bench_codec;
+    avctx->thread_count = thread_count;
+    avctx->thread_type  = FF_THREAD_SLICE;
+    avctx->thread_pool  = pool;
+
+    if (ff_thread_init(avctx) < 0) {
+        av_free(avctx);
+        avcodec_thread_pool_free(&pool);
+        return AVERROR(EINVAL);
+    }
+
+    start = av_gettime();
+    do {
+        for (i = 0; i < JOBS_PER_BATCH; i++)
+            rets[i] = -1;
+        avctx->execute2(avctx, bench_job, sink, rets, JOBS_PER_BATCH);
+        for (i = 0; i < JOBS_PER_BATCH; i++) {
+            if (rets[i] != i) {
+                fprintf(stderr, "%d threads: job %d returned %d\n",
+                        thread_count, i, rets[i]);
+                ret = 1;
+            }
+        }
+        jobs   += JOBS_PER_BATCH;
+        elapsed = av_gettime() - start;
+    } while (elapsed < RUN_TIME && !ret);
+
+    *jobs_per_sec = jobs * 1000000.0 / elapsed;
+
+    if (avctx->thread_opaque)
+        ff_thread_free(avctx);
+    av_free(avctx);
+    avcodec_thread_pool_free(&pool);
+    return ret;
+}
+
+int main(int argc, char **argv)
+{
+    int max_threads = 16;
+    double base = 0, jobs_per_sec;
+    int i, use_pool, ret;
+
+    if (argc > 1)
+        max_threads = atoi(argv[1]);
+    if (argc > 2)
+        job_work = atoi(argv[2]);
+    if (max_threads < 1 || job_work < 0) {
+        fprintf(stderr, "usage: %s [max_threads] [iterations_per_job]\n",
+                argv[0]);
+        return 2;
+    }
+
+    for (use_pool = 0; use_pool < 2; use_pool++) {
+        for (i = 1; i <= max_threads; i++) {
+            if ((ret = run_bench(i, use_pool, &jobs_per_sec)))
+                return ret < 0 ? 2 : ret;
+            if (i == 1)
+                base = jobs_per_sec;
+            printf("%s threads %3d: %12.0f jobs/s  %6.2fx\n",
+                   use_pool ? "pool " : "owned", i, jobs_per_sec,
+                   jobs_per_sec / base);
+        }
+    }
+
+    return 0;
+}
@@ -31,29 +31,13 @@
 
 #include "config.h"
 
-#if HAVE_SCHED_GETAFFINITY
-#define _GNU_SOURCE
-#include <sched.h>
-#endif
-#if HAVE_GETPROCESSAFFINITYMASK
-#include <windows.h>
-#endif
-#if HAVE_SYSCTL
-#if HAVE_SYS_PARAM_H
-#include <sys/param.h>
-#endif
-#include <sys/types.h>
-#include <sys/sysctl.h>
-#endif
-#if HAVE_SYSCONF
-#include <unistd.h>
-#endif
-
 #include "avcodec.h"
 #include "internal.h"
 #include "thread.h"
+#include "libavutil/atomic.h"
 #include "libavutil/avassert.h"
 #include "libavutil/common.h"
+#include "libavutil/cpu.h"
 
 #if HAVE_PTHREADS
 #include <pthread.h>
@@ -64,7 +48,26 @@
 typedef int (action_func)(AVCodecContext *c, void *arg);
 typedef int (action_func2)(AVCodecContext *c, void *arg, int jobnr, int threadnr);
 
+/**
+ * Number of times an idle slice worker polls for a new batch of jobs
+ * before going to sleep on current_job_cond.
+ */
+#define SLICE_SPIN_COUNT 4096
+
+/**
+ * Range of job indices owned by one slice worker.
+ * The owner and the stealing workers both claim jobs from the front with
+ * an atomic increment of next, so no lock is needed to hand out a job.
+ * Padded to keep the counters of different workers on separate cache lines.
+ */
+typedef struct JobRange {
+    volatile int next;              ///< next unclaimed job, may run past end
+    int end;                        ///< one past the last job of this range
+    uint8_t padding[64 - 2 * sizeof(int)];
+} JobRange;
+
 typedef struct ThreadContext {
+    AVCodecContext *avctx;
     pthread_t *workers;
     action_func *func;
     action_func2 *func2;
@@ -74,13 +77,42 @@ typedef struct ThreadContext {
     int job_count;
     int job_size;
 
+    JobRange *ranges;               ///< one job range per worker
+    volatile int next_id;           ///< used by workers to pick their thread number
+    volatile int generation;        ///< incremented every time a batch of jobs is submitted
+    volatile int busy;              ///< workers that have not finished the current batch
+    int spin_count;                 ///< polls of generation before an idle worker parks
+
+    /**
+     * @name Shared pool state
+     * Used instead of workers and ranges when the jobs are run by an
+     * AVCodecThreadPool. Protected by the pool lock, except next_job.
+     * @{
+     */
+    AVCodecThreadPool *pool;
+    struct ThreadContext *next_queued; ///< next context in the pool queue
+    int queued;                     ///< set while the context is in the pool queue
+    volatile int next_job;          ///< next job to hand out
+    int slots;                      ///< thread numbers handed out for the current batch
+    int active;                     ///< pool workers running jobs of the current batch
+    /** @} */
+
     pthread_cond_t last_job_cond;
     pthread_cond_t current_job_cond;
     pthread_mutex_t current_job_lock;
-    int current_job;
     int done;
 } ThreadContext;
 
+struct AVCodecThreadPool {
+    pthread_t *workers;
+    int nb_workers;
+
+    pthread_mutex_t lock;
+    pthread_cond_t cond;            ///< signaled when jobs are queued or the pool is freed
+    ThreadContext *queue;           ///< contexts that may still have jobs to hand out
+    int die;
+};
+
 /**
  * Context used by codec threads and stored in their AVCodecContext thread_opaque.
  */
@@ -149,83 +181,104 @@ typedef struct FrameThreadContext {
 } FrameThreadContext;
 
 
-/* H264 slice threading seems to be buggy with more than 16 threads,
- * limit the number of threads to 16 for automatic detection */
-#define MAX_AUTO_THREADS 16
+/* Limit for automatic detection, matching the number of slice contexts
+ * the mpegvideo and h264 decoders can allocate (MAX_THREADS) */
+#define MAX_AUTO_THREADS 64
+
+/* Every frame thread holds a complete copy of the decoder state and adds
+ * one frame of delay, so automatic detection uses fewer of them */
+#define MAX_AUTO_FRAME_THREADS 16
 
-static int get_logical_cpus(AVCodecContext *avctx)
+/**
+ * Get the number of threads to use when the user asked for auto detection.
+ *
+ * @param max_threads upper limit for the threading method in use
+ */
+static int get_auto_thread_count(AVCodecContext *avctx, int max_threads)
 {
-    int ret, nb_cpus = 1;
-#if HAVE_SCHED_GETAFFINITY && defined(CPU_COUNT)
-    cpu_set_t cpuset;
+    int nb_cpus;
 
-    CPU_ZERO(&cpuset);
+    // the pool workers and the calling thread already cover all cores
+    if (avctx->thread_pool)
+        return FFMIN(avctx->thread_pool->nb_workers + 1, max_threads);
 
-    ret = sched_getaffinity(0, sizeof(cpuset), &cpuset);
-    if (!ret) {
-        nb_cpus = CPU_COUNT(&cpuset);
-    }
-#elif HAVE_GETPROCESSAFFINITYMASK
-    DWORD_PTR proc_aff, sys_aff;
-    ret = GetProcessAffinityMask(GetCurrentProcess(), &proc_aff, &sys_aff);
-    if (ret)
-        nb_cpus = av_popcount64(proc_aff);
-#elif HAVE_SYSCTL && defined(HW_NCPU)
-    int mib[2] = { CTL_HW, HW_NCPU };
-    size_t len = sizeof(nb_cpus);
-
-    ret = sysctl(mib, 2, &nb_cpus, &len, NULL, 0);
-    if (ret == -1)
-        nb_cpus = 0;
-#elif HAVE_SYSCONF && defined(_SC_NPROC_ONLN)
-    nb_cpus = sysconf(_SC_NPROC_ONLN);
-#elif HAVE_SYSCONF && defined(_SC_NPROCESSORS_ONLN)
-    nb_cpus = sysconf(_SC_NPROCESSORS_ONLN);
-#elif _XBOX
-	//nb_cpus = 6;
-#endif
+    nb_cpus = av_cpu_count();
     av_log(avctx, AV_LOG_DEBUG, "detected %d logical cores\n", nb_cpus);
-    return nb_cpus;
+    // use number of cores + 1 as thread count if there is more than one
+    if (nb_cpus > 1)
+        return FFMIN(nb_cpus + 1, max_threads);
+    return 1;
+}
+
+
+/**
+ * Run one job of the current batch.
+ */
+static av_always_inline void run_job(AVCodecContext *avctx, ThreadContext *c,
+                                     int jobnr, int self_id)
+{
+    c->rets[jobnr % c->rets_count] = c->func ? c->func(avctx, (char*)c->args + jobnr*c->job_size):
+                                               c->func2(avctx, c->args, jobnr, self_id);
 }
 
+/**
+ * Execute jobs of the current batch until all job ranges are exhausted.
+ * Jobs are taken from the worker's own range first, then stolen from the
+ * ranges of the other workers.
+ */
+static void run_jobs(AVCodecContext *avctx, ThreadContext *c, int self_id)
+{
+    int thread_count = avctx->thread_count;
+    int i, jobnr;
+
+    for (i = 0; i < thread_count; i++) {
+        JobRange *r = &c->ranges[(self_id + i) % thread_count];
+
+        while (r->next < r->end) {
+            jobnr = avpriv_atomic_int_add_and_fetch(&r->next, 1) - 1;
+            if (jobnr >= r->end)
+                break;
+            run_job(avctx, c, jobnr, self_id);
+        }
+    }
+}
 
 static void* attribute_align_arg worker(void *v)
 {
     AVCodecContext *avctx = v;
     ThreadContext *c = avctx->thread_opaque;
-    int our_job = c->job_count;
-    int thread_count = avctx->thread_count;
-    int self_id;
+    int self_id = avpriv_atomic_int_add_and_fetch(&c->next_id, 1) - 1;
+    int generation = 0;
+    int i;
 
-    pthread_mutex_lock(&c->current_job_lock);
-    self_id = c->current_job++;
-    for (;;){
-        while (our_job >= c->job_count) {
-            if (c->current_job == thread_count + c->job_count)
-                pthread_cond_signal(&c->last_job_cond);
-
-            pthread_cond_wait(&c->current_job_cond, &c->current_job_lock);
-            our_job = self_id;
-
-            if (c->done) {
-                pthread_mutex_unlock(&c->current_job_lock);
-                return NULL;
-            }
+    for (;;) {
+        /* spin for a while before parking, small jobs are often submitted
+         * back to back and a futex wake-up costs more than the job itself */
+        for (i = 0; i < c->spin_count; i++)
+            if (avpriv_atomic_int_get(&c->generation) != generation || c->done)
+                break;
+
+        if (i == c->spin_count) {
+            pthread_mutex_lock(&c->current_job_lock);
+            while (c->generation == generation && !c->done)
+                pthread_cond_wait(&c->current_job_cond, &c->current_job_lock);
+            pthread_mutex_unlock(&c->current_job_lock);
         }
-        pthread_mutex_unlock(&c->current_job_lock);
 
-        c->rets[our_job%c->rets_count] = c->func ? c->func(avctx, (char*)c->args + our_job*c->job_size):
-                                                   c->func2(avctx, c->args, our_job, self_id);
+        if (c->done)
+            return NULL;
+        /* the barrier in this second read orders the loads of the job
+         * parameters after the load that observed the new generation */
+        generation = avpriv_atomic_int_get(&c->generation);
 
-        pthread_mutex_lock(&c->current_job_lock);
-        our_job = c->current_job++;
-    }
-}
+        run_jobs(avctx, c, self_id);
 
-static av_always_inline void avcodec_thread_park_workers(ThreadContext *c, int thread_count)
-{
-    pthread_cond_wait(&c->last_job_cond, &c->current_job_lock);
-    pthread_mutex_unlock(&c->current_job_lock);
+        if (!avpriv_atomic_int_add_and_fetch(&c->busy, -1)) {
+            pthread_mutex_lock(&c->current_job_lock);
+            pthread_cond_signal(&c->last_job_cond);
+            pthread_mutex_unlock(&c->current_job_lock);
+        }
+    }
 }
 
 static void thread_free(AVCodecContext *avctx)
@@ -233,35 +286,200 @@ static void thread_free(AVCodecContext *avctx)
     ThreadContext *c = avctx->thread_opaque;
     int i;
 
-    pthread_mutex_lock(&c->current_job_lock);
-    c->done = 1;
-    pthread_cond_broadcast(&c->current_job_cond);
-    pthread_mutex_unlock(&c->current_job_lock);
+    if (!c->pool) {
+        pthread_mutex_lock(&c->current_job_lock);
+        c->done = 1;
+        pthread_cond_broadcast(&c->current_job_cond);
+        pthread_mutex_unlock(&c->current_job_lock);
 
-    for (i=0; i<avctx->thread_count; i++)
-         pthread_join(c->workers[i], NULL);
+        for (i=0; i<avctx->thread_count; i++)
+             pthread_join(c->workers[i], NULL);
+    }
 
     pthread_mutex_destroy(&c->current_job_lock);
     pthread_cond_destroy(&c->current_job_cond);
     pthread_cond_destroy(&c->last_job_cond);
+    av_free(c->ranges);
     av_free(c->workers);
     av_freep(&avctx->thread_opaque);
 }
 
+static void pool_run_jobs(ThreadContext *c, int self_id)
+{
+    int jobnr;
+
+    while ((jobnr = avpriv_atomic_int_add_and_fetch(&c->next_job, 1) - 1) < c->job_count)
+        run_job(c->avctx, c, jobnr, self_id);
+}
+
+/**
+ * Remove a context from the pool queue. Must be called with the pool lock held.
+ */
+static void pool_dequeue(AVCodecThreadPool *pool, ThreadContext *c)
+{
+    ThreadContext **p;
+
+    for (p = &pool->queue; *p; p = &(*p)->next_queued) {
+        if (*p == c) {
+            *p = c->next_queued;
+            break;
+        }
+    }
+    c->next_queued = NULL;
+    c->queued      = 0;
+}
+
+/**
+ * Pick the queued context a pool worker should help next.
+ * Each context with jobs left gets an even share of the workers: the one
+ * with the fewest workers already running its jobs wins, ties going to the
+ * context that was queued first. Must be called with the pool lock held.
+ */
+static ThreadContext *pool_pick_context(AVCodecThreadPool *pool)
+{
+    ThreadContext *c, *best = NULL;
+
+    for (c = pool->queue; c; c = c->next_queued) {
+        if (c->slots >= c->avctx->thread_count || c->next_job >= c->job_count)
+            continue;
+        if (!best || c->active < best->active)
+            best = c;
+    }
+    return best;
+}
+
+static void* attribute_align_arg pool_worker(void *v)
+{
+    AVCodecThreadPool *pool = v;
+    ThreadContext *c;
+    int self_id;
+
+    pthread_mutex_lock(&pool->lock);
+    for (;;) {
+        while (!pool->die && !(c = pool_pick_context(pool)))
+            pthread_cond_wait(&pool->cond, &pool->lock);
+        if (pool->die)
+            break;
+
+        self_id = c->slots++;
+        c->active++;
+        pthread_mutex_unlock(&pool->lock);
+
+        pool_run_jobs(c, self_id);
+
+        pthread_mutex_lock(&pool->lock);
+        if (c->queued)
+            pool_dequeue(pool, c);
+        if (!--c->active)
+            pthread_cond_signal(&c->last_job_cond);
+    }
+    pthread_mutex_unlock(&pool->lock);
+
+    return NULL;
+}
+
+/**
+ * Run the current batch of jobs of a context on its shared pool.
+ * The calling thread works on the batch as thread number 0.
+ */
+static void pool_execute(ThreadContext *c)
+{
+    AVCodecThreadPool *pool = c->pool;
+    ThreadContext **p;
+    int i;
+
+    c->next_job = 0;
+    c->slots    = 1;
+
+    pthread_mutex_lock(&pool->lock);
+    for (p = &pool->queue; *p; p = &(*p)->next_queued)
+        ;
+    *p = c;
+    c->queued = 1;
+    for (i = 0; i < FFMIN(c->job_count - 1, pool->nb_workers); i++)
+        pthread_cond_signal(&pool->cond);
+    pthread_mutex_unlock(&pool->lock);
+
+    pool_run_jobs(c, 0);
+
+    pthread_mutex_lock(&pool->lock);
+    if (c->queued)
+        pool_dequeue(pool, c);
+    while (c->active)
+        pthread_cond_wait(&c->last_job_cond, &pool->lock);
+    pthread_mutex_unlock(&pool->lock);
+}
+
+AVCodecThreadPool *avcodec_thread_pool_alloc(int nb_threads)
+{
+    AVCodecThreadPool *pool;
+    int i;
+
+#if HAVE_W32THREADS
+    w32thread_init();
+#endif
+
+    if (nb_threads <= 0)
+        nb_threads = av_cpu_count();
+    if (nb_threads <= 0)
+        nb_threads = 1;
+
+    pool = av_mallocz(sizeof(*pool));
+    if (!pool)
+        return NULL;
+    pool->workers = av_mallocz(sizeof(*pool->workers) * nb_threads);
+    if (!pool->workers) {
+        av_free(pool);
+        return NULL;
+    }
+
+    pthread_mutex_init(&pool->lock, NULL);
+    pthread_cond_init(&pool->cond, NULL);
+    for (i = 0; i < nb_threads; i++) {
+        if (pthread_create(&pool->workers[i], NULL, pool_worker, pool)) {
+            avcodec_thread_pool_free(&pool);
+            return NULL;
+        }
+        pool->nb_workers++;
+    }
+
+    return pool;
+}
+
+void avcodec_thread_pool_free(AVCodecThreadPool **ppool)
+{
+    AVCodecThreadPool *pool = *ppool;
+    int i;
+
+    if (!pool)
+        return;
+
+    pthread_mutex_lock(&pool->lock);
+    pool->die = 1;
+    pthread_cond_broadcast(&pool->cond);
+    pthread_mutex_unlock(&pool->lock);
+
+    for (i = 0; i < pool->nb_workers; i++)
+        pthread_join(pool->workers[i], NULL);
+
+    pthread_mutex_destroy(&pool->lock);
+    pthread_cond_destroy(&pool->cond);
+    av_free(pool->workers);
+    av_freep(ppool);
+}
+
 static int avcodec_thread_execute(AVCodecContext *avctx, action_func* func, void *arg, int *ret, int job_count, int job_size)
 {
     ThreadContext *c= avctx->thread_opaque;
-    int dummy_ret;
+    int thread_count = avctx->thread_count;
+    int dummy_ret, i;
 
-    if (!(avctx->active_thread_type&FF_THREAD_SLICE) || avctx->thread_count <= 1)
+    if (!(avctx->active_thread_type&FF_THREAD_SLICE) || thread_count <= 1)
         return avcodec_default_execute(avctx, func, arg, ret, job_count, job_size);
 
     if (job_count <= 0)
         return 0;
 
-    pthread_mutex_lock(&c->current_job_lock);
-
-    c->current_job = avctx->thread_count;
     c->job_count = job_count;
     c->job_size = job_size;
     c->args = arg;
@@ -273,9 +491,27 @@ static int avcodec_thread_execute(AVCodecContext *avctx, action_func* func, void
         c->rets = &dummy_ret;
         c->rets_count = 1;
     }
-    pthread_cond_broadcast(&c->current_job_cond);
 
-    avcodec_thread_park_workers(c, avctx->thread_count);
+    if (c->pool) {
+        pool_execute(c);
+        return 0;
+    }
+
+    /* all workers are idle at this point, so the ranges can be reset
+     * without atomics; the barrier in avpriv_atomic_int_get() makes them
+     * visible before the new generation is */
+    for (i = 0; i < thread_count; i++) {
+        c->ranges[i].next = (int64_t)job_count *  i      / thread_count;
+        c->ranges[i].end  = (int64_t)job_count * (i + 1) / thread_count;
+    }
+    c->busy = thread_count;
+    avpriv_atomic_int_set(&c->generation, avpriv_atomic_int_get(&c->generation) + 1);
+
+    pthread_mutex_lock(&c->current_job_lock);
+    pthread_cond_broadcast(&c->current_job_cond);
+    while (avpriv_atomic_int_get(&c->busy))
+        pthread_cond_wait(&c->last_job_cond, &c->current_job_lock);
+    pthread_mutex_unlock(&c->current_job_lock);
 
     return 0;
 }
@@ -292,15 +528,10 @@ static int thread_init(AVCodecContext *avctx)
     int i;
     ThreadContext *c;
     int thread_count = avctx->thread_count;
+    int nb_cpus;
 
-    if (!thread_count) {
-        int nb_cpus = get_logical_cpus(avctx);
-        // use number of cores + 1 as thread count if there is more than one
-        if (nb_cpus > 1)
-            thread_count = avctx->thread_count = FFMIN(nb_cpus + 1, MAX_AUTO_THREADS);
-        else
-            thread_count = avctx->thread_count = 1;
-    }
+    if (!thread_count)
+        thread_count = avctx->thread_count = get_auto_thread_count(avctx, MAX_AUTO_THREADS);
 
     if (thread_count <= 1) {
         avctx->active_thread_type = 0;
@@ -310,33 +541,49 @@ static int thread_init(AVCodecContext *avctx)
     c = av_mallocz(sizeof(ThreadContext));
     if (!c)
         return -1;
+    c->avctx = avctx;
+
+    if (avctx->thread_pool) {
+        c->pool = avctx->thread_pool;
+        pthread_cond_init(&c->current_job_cond, NULL);
+        pthread_cond_init(&c->last_job_cond, NULL);
+        pthread_mutex_init(&c->current_job_lock, NULL);
+        avctx->thread_opaque = c;
+        avctx->execute  = avcodec_thread_execute;
+        avctx->execute2 = avcodec_thread_execute2;
+        return 0;
+    }
 
     c->workers = av_mallocz(sizeof(pthread_t)*thread_count);
-    if (!c->workers) {
+    c->ranges  = av_mallocz(sizeof(JobRange)*thread_count);
+    if (!c->workers || !c->ranges) {
+        av_free(c->workers);
+        av_free(c->ranges);
         av_free(c);
         return -1;
     }
 
     avctx->thread_opaque = c;
-    c->current_job = 0;
     c->job_count = 0;
     c->job_size = 0;
+    c->next_id = 0;
+    c->generation = 0;
+    c->busy = 0;
     c->done = 0;
+    // spinning only pays off if the submitting thread runs on another core
+    nb_cpus = av_cpu_count();
+    c->spin_count = nb_cpus > 1 ? SLICE_SPIN_COUNT : 0;
     pthread_cond_init(&c->current_job_cond, NULL);
     pthread_cond_init(&c->last_job_cond, NULL);
     pthread_mutex_init(&c->current_job_lock, NULL);
-    pthread_mutex_lock(&c->current_job_lock);
     for (i=0; i<thread_count; i++) {
         if(pthread_create(&c->workers[i], NULL, worker, avctx)) {
            avctx->thread_count = i;
-           pthread_mutex_unlock(&c->current_job_lock);
            ff_thread_free(avctx);
            return -1;
         }
     }
 
-    avcodec_thread_park_workers(c, thread_count);
-
     avctx->execute = avcodec_thread_execute;
     avctx->execute2 = avcodec_thread_execute2;
     return 0;
@@ -787,20 +1034,19 @@ static int frame_thread_init(AVCodecContext *avctx)
     FrameThreadContext *fctx;
     int i, err = 0;
 
-    if (!thread_count) {
-        int nb_cpus = get_logical_cpus(avctx);
-        // use number of cores + 1 as thread count if there is more than one
-        if (nb_cpus > 1)
-            thread_count = avctx->thread_count = FFMIN(nb_cpus + 1, MAX_AUTO_THREADS);
-        else
-            thread_count = avctx->thread_count = 1;
-    }
+    if (!thread_count)
+        thread_count = avctx->thread_count = get_auto_thread_count(avctx, MAX_AUTO_FRAME_THREADS);
 
     if (thread_count <= 1) {
         avctx->active_thread_type = 0;
         return 0;
     }
 
+    if (avctx->thread_pool)
+        av_log(avctx, AV_LOG_WARNING, "Frame threads cannot be run by a "
+               "shared thread pool, starting %d threads of its own.\n",
+               thread_count);
+
     avctx->thread_opaque = fctx = av_mallocz(sizeof(FrameThreadContext));
 
     fctx->threads = av_mallocz(sizeof(PerThreadContext) * thread_count);
@@ -1015,6 +1261,7 @@ fail:
  */
 static void validate_thread_parameters(AVCodecContext *avctx)
 {
+    int max_threads;
     int frame_threading_supported = (avctx->codec->capabilities & CODEC_CAP_FRAME_THREADS)
                                 && !(avctx->flags & CODEC_FLAG_TRUNCATED)
                                 && !(avctx->flags & CODEC_FLAG_LOW_DELAY)
@@ -1031,10 +1278,12 @@ static void validate_thread_parameters(AVCodecContext *avctx)
         avctx->active_thread_type = 0;
     }
 
-    if (avctx->thread_count > MAX_AUTO_THREADS)
+    max_threads = avctx->active_thread_type == FF_THREAD_FRAME ?
+                  MAX_AUTO_FRAME_THREADS : MAX_AUTO_THREADS;
+    if (avctx->thread_count > max_threads)
         av_log(avctx, AV_LOG_WARNING,
                "Application has requested %d threads. Using a thread count greater than %d is not recommended.\n",
-               avctx->thread_count, MAX_AUTO_THREADS);
+               avctx->thread_count, max_threads);
 }
 
 int ff_thread_init(AVCodecContext *avctx)
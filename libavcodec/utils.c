@@ -2012,6 +2012,15 @@ int ff_thread_init(AVCodecContext *s)
     return -1;
 }
 
+AVCodecThreadPool *avcodec_thread_pool_alloc(int nb_threads)
+{
+    return NULL;
+}
+
+void avcodec_thread_pool_free(AVCodecThreadPool **pool)
+{
+}
+
 #endif
 
 unsigned int av_xiphlacing(unsigned char *s, unsigned int v)
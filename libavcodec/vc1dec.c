@@ -38,6 +38,7 @@
 #include "msmpeg4data.h"
 #include "unary.h"
 #include "mathops.h"
+#include "thread.h"
 #include "vdpau_internal.h"
 
 #undef NDEBUG
@@ -325,6 +326,46 @@ static void vc1_smooth_overlap_filter_iblk(VC1Context *v)
     }
 }
 
+/**
+ * Report the macroblock rows of the current picture that are final to the
+ * other frame threads.
+ * Overlap smoothing and the loop filter trail the decoding loop by up to
+ * two rows, so only rows up to mb_y - 2 are reported here; the whole
+ * picture is reported by ff_MPV_frame_end().
+ */
+static void vc1_report_decode_progress(VC1Context *v)
+{
+    MpegEncContext *s = &v->s;
+
+    if (HAVE_THREADS && (s->avctx->active_thread_type & FF_THREAD_FRAME) &&
+        v->fcm == PROGRESSIVE && s->pict_type != AV_PICTURE_TYPE_B &&
+        !s->er.error_occurred && s->mb_y >= 2)
+        ff_thread_report_progress(&s->current_picture_ptr->tf, s->mb_y - 2, 0);
+}
+
+/**
+ * Wait until a reference picture is decoded down to the given luma line.
+ * Progress is only reported row by row for progressive pictures; for the
+ * others the whole reference is waited for, which costs nothing since
+ * interlaced sequences do not start the next frame before the current one
+ * is done.
+ * @param dir  0 for the forward (last) reference, 1 for the backward (next)
+ * @param line lowest luma line read from the reference
+ */
+static void vc1_await_reference(VC1Context *v, int dir, int line)
+{
+    MpegEncContext *s = &v->s;
+    Picture *ref = dir ? s->next_picture_ptr : s->last_picture_ptr;
+    int row = INT_MAX;
+
+    if (!HAVE_THREADS || !(s->avctx->active_thread_type & FF_THREAD_FRAME) || !ref)
+        return;
+
+    if (v->fcm == PROGRESSIVE)
+        row = av_clip(line, 0, s->mb_height * 16 - 1) >> 4;
+    ff_thread_await_progress(&ref->tf, row, 0);
+}
+
 /** Do motion compensation over 1 macroblock
  * Mostly adapted hpel_motion and qpel_motion from mpegvideo.c
  */
@@ -413,6 +454,8 @@ static void vc1_mc_1mv(VC1Context *v, int dir)
         uvsrc_y = av_clip(uvsrc_y,  -8, s->avctx->coded_height >> 1);
     }
 
+    vc1_await_reference(v, dir, FFMAX(src_y + 16 + s->mspel, 2 * uvsrc_y + 17));
+
     srcY += src_y   * s->linesize   + src_x;
     srcU += uvsrc_y * s->uvlinesize + uvsrc_x;
     srcV += uvsrc_y * s->uvlinesize + uvsrc_x;
@@ -655,6 +698,8 @@ static void vc1_mc_4mv_luma(VC1Context *v, int n, int dir)
         }
     }
 
+    vc1_await_reference(v, dir, src_y + 8 + s->mspel);
+
     srcY += src_y * s->linesize + src_x;
     if (v->field_mode && v->ref_field_type[dir])
         srcY += s->current_picture_ptr->f.linesize[0];
@@ -840,6 +885,8 @@ static void vc1_mc_4mv_chroma(VC1Context *v, int dir)
         uvsrc_y = av_clip(uvsrc_y, -8, s->avctx->coded_height >> 1);
     }
 
+    vc1_await_reference(v, dir, 2 * uvsrc_y + 17);
+
     if (!dir) {
         if (v->field_mode) {
             if ((v->cur_field_type != chroma_ref_type) && v->cur_field_type) {
@@ -1873,6 +1920,8 @@ static void vc1_interp_mc(VC1Context *v)
         uvsrc_y = av_clip(uvsrc_y,  -8, s->avctx->coded_height >> 1);
     }
 
+    vc1_await_reference(v, 1, FFMAX(src_y + 16 + s->mspel, 2 * uvsrc_y + 17));
+
     srcY += src_y   * s->linesize   + src_x;
     srcU += uvsrc_y * s->uvlinesize + uvsrc_x;
     srcV += uvsrc_y * s->uvlinesize + uvsrc_x;
@@ -4444,6 +4493,7 @@ static void vc1_decode_i_blocks(VC1Context *v)
             ff_mpeg_draw_horiz_band(s, s->mb_y * 16, 16);
         else if (s->mb_y)
             ff_mpeg_draw_horiz_band(s, (s->mb_y - 1) * 16, 16);
+        vc1_report_decode_progress(v);
 
         s->first_slice_line = 0;
     }
@@ -4572,6 +4622,7 @@ static void vc1_decode_i_blocks_adv(VC1Context *v)
             ff_mpeg_draw_horiz_band(s, s->mb_y * 16, 16);
         else if (s->mb_y)
             ff_mpeg_draw_horiz_band(s, (s->mb_y-1) * 16, 16);
+        vc1_report_decode_progress(v);
         s->first_slice_line = 0;
     }
 
@@ -4649,6 +4700,7 @@ static void vc1_decode_p_blocks(VC1Context *v)
         memmove(v->is_intra_base, v->is_intra, sizeof(v->is_intra_base[0]) * s->mb_stride);
         memmove(v->luma_mv_base,  v->luma_mv,  sizeof(v->luma_mv_base[0])  * s->mb_stride);
         if (s->mb_y != s->start_mb_y) ff_mpeg_draw_horiz_band(s, (s->mb_y - 1) * 16, 16);
+        vc1_report_decode_progress(v);
         s->first_slice_line = 0;
     }
     if (apply_loop_filter) {
@@ -4698,6 +4750,8 @@ static void vc1_decode_b_blocks(VC1Context *v)
     for (s->mb_y = s->start_mb_y; s->mb_y < s->end_mb_y; s->mb_y++) {
         s->mb_x = 0;
         ff_init_block_index(s);
+        /* direct mode reads the motion vectors of the co-located row */
+        vc1_await_reference(v, 1, s->mb_y * 16 + 15);
         for (; s->mb_x < s->mb_width; s->mb_x++) {
             ff_update_block_index(s);
 
@@ -4736,10 +4790,12 @@ static void vc1_decode_skip_blocks(VC1Context *v)
         s->mb_x = 0;
         ff_init_block_index(s);
         ff_update_block_index(s);
+        vc1_await_reference(v, 0, s->mb_y * 16 + 15);
         memcpy(s->dest[0], s->last_picture.f.data[0] + s->mb_y * 16 * s->linesize,   s->linesize   * 16);
         memcpy(s->dest[1], s->last_picture.f.data[1] + s->mb_y *  8 * s->uvlinesize, s->uvlinesize *  8);
         memcpy(s->dest[2], s->last_picture.f.data[2] + s->mb_y *  8 * s->uvlinesize, s->uvlinesize *  8);
         ff_mpeg_draw_horiz_band(s, s->mb_y * 16, 16);
+        vc1_report_decode_progress(v);
         s->first_slice_line = 0;
     }
     s->pict_type = AV_PICTURE_TYPE_P;
@@ -5161,6 +5217,8 @@ static av_cold int vc1_decode_init(AVCodecContext *avctx)
     avctx->flags |= CODEC_FLAG_EMU_EDGE;
     v->s.flags   |= CODEC_FLAG_EMU_EDGE;
 
+    avctx->internal->allocate_progress = 1;
+
     if (ff_vc1_init_common(v) < 0)
         return -1;
     ff_h264chroma_init(&v->h264chroma, 8);
@@ -5302,6 +5360,112 @@ av_cold int ff_vc1_decode_end(AVCodecContext *avctx)
     return 0;
 }
 
+#if HAVE_THREADS
+static av_cold int vc1_decode_init_thread_copy(AVCodecContext *avctx)
+{
+    VC1Context *v = avctx->priv_data;
+
+    /* the decoding tables are allocated with the MpegEncContext on the
+     * first frame, nothing here is shared with the main context yet */
+    v->s.avctx = avctx;
+    return 0;
+}
+
+/**
+ * Map a field MV type pointer of another thread to the same position in the
+ * buffer of this thread. The mv_f, mv_f_last and mv_f_next pointers rotate
+ * between the three buffers, so the buffer has to be looked up.
+ */
+static uint8_t *vc1_rebase_mv_f(VC1Context *v, const VC1Context *v1,
+                                const uint8_t *p, int size)
+{
+    if (p >= v1->mv_f_last_base && p < v1->mv_f_last_base + size)
+        return v->mv_f_last_base + (p - v1->mv_f_last_base);
+    if (p >= v1->mv_f_next_base && p < v1->mv_f_next_base + size)
+        return v->mv_f_next_base + (p - v1->mv_f_next_base);
+    return v->mv_f_base + (p - v1->mv_f_base);
+}
+
+static int vc1_decode_update_thread_context(AVCodecContext *dst,
+                                            const AVCodecContext *src)
+{
+    VC1Context *v = dst->priv_data, *v1 = src->priv_data;
+    MpegEncContext *s = &v->s, *s1 = &v1->s;
+    int ret;
+
+    if (dst == src)
+        return 0;
+
+    // sequence and entry point headers
+    memcpy(&v->res_sprite, &v1->res_sprite,
+           (char *)&v1->mv_mode - (char *)&v1->res_sprite);
+    v->hrd_num_leaky_buckets = v1->hrd_num_leaky_buckets;
+    v->broken_link           = v1->broken_link;
+    v->closed_entry          = v1->closed_entry;
+    v->dmvrange              = v1->dmvrange;
+    v->range_mapy_flag       = v1->range_mapy_flag;
+    v->range_mapuv_flag      = v1->range_mapuv_flag;
+    v->range_mapy            = v1->range_mapy;
+    v->range_mapuv           = v1->range_mapuv;
+
+    // state carried over from the previous picture header
+    v->rnd          = v1->rnd;
+    v->use_ic       = v1->use_ic;
+    v->lumscale     = v1->lumscale;
+    v->lumshift     = v1->lumshift;
+    v->lumscale2    = v1->lumscale2;
+    v->lumshift2    = v1->lumshift2;
+    v->intcompfield = v1->intcompfield;
+    v->refdist      = v1->refdist;
+    v->tff          = v1->tff;
+    v->mvrange      = v1->mvrange;
+    memcpy(v->luty,   v1->luty,   sizeof(v->luty));
+    memcpy(v->lutuv,  v1->lutuv,  sizeof(v->lutuv));
+    memcpy(v->luty2,  v1->luty2,  sizeof(v->luty2));
+    memcpy(v->lutuv2, v1->lutuv2, sizeof(v->lutuv2));
+
+    if (!s1->context_initialized)
+        return 0;
+
+    if (s->context_initialized &&
+        (s->width != s1->width || s->height != s1->height))
+        ff_vc1_decode_end(dst);
+
+    if ((ret = ff_mpeg_update_thread_context(dst, src)) < 0)
+        return ret;
+
+    s->quarter_sample = s1->quarter_sample;
+    s->mspel          = s1->mspel;
+    s->loop_filter    = s1->loop_filter;
+    s->resync_marker  = s1->resync_marker;
+    s->h_edge_pos     = s1->h_edge_pos;
+    s->v_edge_pos     = s1->v_edge_pos;
+
+    if (!v->mv_type_mb_plane && ff_vc1_decode_init_alloc_tables(v) < 0)
+        return AVERROR(ENOMEM);
+
+    /* field pictures predict from the motion vector field types of the
+     * reference fields */
+    if (v1->interlace) {
+        int size = 2 * (s->b8_stride * (s->mb_height * 2 + 1) +
+                        s->mb_stride * (s->mb_height + 1) * 2);
+
+        int i;
+
+        memcpy(v->mv_f_base,      v1->mv_f_base,      size);
+        memcpy(v->mv_f_last_base, v1->mv_f_last_base, size);
+        memcpy(v->mv_f_next_base, v1->mv_f_next_base, size);
+        for (i = 0; i < 2; i++) {
+            v->mv_f[i]      = vc1_rebase_mv_f(v, v1, v1->mv_f[i],      size);
+            v->mv_f_last[i] = vc1_rebase_mv_f(v, v1, v1->mv_f_last[i], size);
+            v->mv_f_next[i] = vc1_rebase_mv_f(v, v1, v1->mv_f_next[i], size);
+        }
+    }
+
+    return 0;
+}
+#endif
+
 
 /** Decode a VC1/WMV3 frame
  * @todo TODO: Handle VC-1 IDUs (Transport level?)
@@ -5540,6 +5704,12 @@ static int vc1_decode_frame(AVCodecContext *avctx, void *data,
         goto err;
     }
 
+    /* Interlaced pictures keep updating the field MV type buffers and may
+     * carry a second field header, so the next frame thread is only started
+     * once they are completely decoded. */
+    if (!v->interlace)
+        ff_thread_finish_setup(avctx);
+
     s->me.qpel_put = s->dsp.put_qpel_pixels_tab;
     s->me.qpel_avg = s->dsp.avg_qpel_pixels_tab;
 
@@ -5707,11 +5877,13 @@ AVCodec ff_vc1_decoder = {
     "SMPTE VC-1",
     AVMEDIA_TYPE_VIDEO,
     AV_CODEC_ID_VC1,
-    0x0002 | 0x0020,
+    0x0002 | 0x0020 | CODEC_CAP_FRAME_THREADS,
     0, vc1_hwaccel_pixfmt_list_420,
     0, 0, 0, 0, 0, profiles,
     sizeof(VC1Context),
-    0, 0, 0, 0, 0, vc1_decode_init,
+    0, ONLY_IF_THREADS_ENABLED(vc1_decode_init_thread_copy),
+    ONLY_IF_THREADS_ENABLED(vc1_decode_update_thread_context),
+    0, 0, vc1_decode_init,
     0, 0, vc1_decode_frame,
     ff_vc1_decode_end,
     ff_mpeg_flush
@@ -5723,11 +5895,13 @@ AVCodec ff_wmv3_decoder = {
     "Windows Media Video 9",
     AVMEDIA_TYPE_VIDEO,
     AV_CODEC_ID_WMV3,
-    0x0002 | 0x0020,
+    0x0002 | 0x0020 | CODEC_CAP_FRAME_THREADS,
     0, vc1_hwaccel_pixfmt_list_420,
     0, 0, 0, 0, 0, profiles,
     sizeof(VC1Context),
-    0, 0, 0, 0, 0, vc1_decode_init,
+    0, ONLY_IF_THREADS_ENABLED(vc1_decode_init_thread_copy),
+    ONLY_IF_THREADS_ENABLED(vc1_decode_update_thread_context),
+    0, 0, vc1_decode_init,
     0, 0, vc1_decode_frame,
     ff_vc1_decode_end,
     ff_mpeg_flush
@@ -1924,7 +1924,7 @@ static int vp3_update_thread_context(AVCodecContext *dst, const AVCodecContext *
 
         // copy qscale data if necessary
         for (i = 0; i < 3; i++) {
-            if (s->qps[i] != s1->qps[1]) {
+            if (s->qps[i] != s1->qps[i]) {
                 qps_changed = 1;
                 memcpy(&s->qmat[i], &s1->qmat[i], sizeof(s->qmat[i]));
             }
@@ -2421,8 +2421,8 @@ AVCodec ff_theora_decoder = {
     0x0002 | 0x0001 |
                              0x1000,
     0, 0, 0, 0, 0, 0, 0, 0, sizeof(Vp3DecodeContext),
-    0, ((void *)0),
-    ((void *)0),
+    0, ONLY_IF_THREADS_ENABLED(vp3_init_thread_copy),
+    ONLY_IF_THREADS_ENABLED(vp3_update_thread_context),
     0, 0, theora_decode_init,
     0, 0, vp3_decode_frame,
     vp3_decode_end,
@@ -2438,8 +2438,8 @@ AVCodec ff_vp3_decoder = {
     0x0002 | 0x0001 |
                              0x1000,
     0, 0, 0, 0, 0, 0, 0, 0, sizeof(Vp3DecodeContext),
-    0, ((void *)0),
-    ((void *)0),
+    0, ONLY_IF_THREADS_ENABLED(vp3_init_thread_copy),
+    ONLY_IF_THREADS_ENABLED(vp3_update_thread_context),
     0, 0, vp3_decode_init,
     0, 0, vp3_decode_frame,
     vp3_decode_end,
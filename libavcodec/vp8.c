@@ -1656,7 +1656,7 @@ static void vp8_decode_mb_row_no_filter(AVCodecContext *avctx, void *tdata,
                                         int jobnr, int threadnr)
 {
     VP8Context *s = avctx->priv_data;
-    VP8ThreadData *prev_td, *next_td, *td = &s->thread_data[threadnr];
+    VP8ThreadData *prev_td, *next_td, *td = &s->thread_data[jobnr];
     int mb_y = td->thread_mb_pos>>16;
     int i, y, mb_x, mb_xy = mb_y*s->mb_width;
     int num_jobs = s->num_jobs;
@@ -1697,7 +1697,7 @@ static void vp8_decode_mb_row_no_filter(AVCodecContext *avctx, void *tdata,
     for (mb_x = 0; mb_x < s->mb_width; mb_x++, mb_xy++, mb++) {
         // Wait for previous thread to read mb_x+2, and reach mb_y-1.
         if (prev_td != td) {
-            if (threadnr != 0) {
+            if (jobnr != 0) {
                 check_thread_pos(td, prev_td, mb_x+1, mb_y-1);
             } else {
                 check_thread_pos(td, prev_td, (s->mb_width+3) + (mb_x+1), mb_y-1);
@@ -1740,7 +1740,7 @@ static void vp8_decode_mb_row_no_filter(AVCodecContext *avctx, void *tdata,
         if (s->deblock_filter)
             filter_level_for_mb(s, mb, &td->filter_strength[mb_x]);
 
-        if (s->deblock_filter && num_jobs != 1 && threadnr == num_jobs-1) {
+        if (s->deblock_filter && num_jobs != 1 && jobnr == num_jobs-1) {
             if (s->filter.simple)
                 backup_mb_border(s->top_border[mb_x+1], dst[0], NULL, NULL, s->linesize, 0, 1);
             else
@@ -1767,7 +1767,7 @@ static void vp8_filter_mb_row(AVCodecContext *avctx, void *tdata,
                               int jobnr, int threadnr)
 {
     VP8Context *s = avctx->priv_data;
-    VP8ThreadData *td = &s->thread_data[threadnr];
+    VP8ThreadData *td = &s->thread_data[jobnr];
     int mb_x, mb_y = td->thread_mb_pos>>16, num_jobs = s->num_jobs;
     AVFrame *curframe = s->curframe->tf.f;
     VP8Macroblock *mb;
@@ -1825,7 +1825,7 @@ static int vp8_decode_mb_row_sliced(AVCodecContext *avctx, void *tdata,
     VP8ThreadData *next_td = NULL, *prev_td = NULL;
     VP8Frame *curframe = s->curframe;
     int mb_y, num_jobs = s->num_jobs;
-    td->thread_nr = threadnr;
+    td->thread_nr = jobnr;
     for (mb_y = jobnr; mb_y < s->mb_height; mb_y += num_jobs) {
         if (mb_y >= s->mb_height) break;
         td->thread_mb_pos = mb_y<<16;
@@ -1964,7 +1964,9 @@ static int vp8_decode_frame(AVCodecContext *avctx, void *data, int *got_frame,
     if (s->mb_layout == 1)
         vp8_decode_mv_mb_modes(avctx, curframe, prev_frame);
 
-    if (avctx->active_thread_type == FF_THREAD_FRAME)
+    /* the jobs wait on the rows decoded by each other, so they must all
+     * run at the same time, which a shared thread pool cannot promise */
+    if (avctx->active_thread_type == FF_THREAD_FRAME || avctx->thread_pool)
         num_jobs = 1;
     else
         num_jobs = FFMIN(s->num_coeff_partitions, avctx->thread_count);
@@ -21,6 +21,7 @@
 
 #include "audio.h"
 #include "avfilter.h"
+#include "framepool.h"
 #include "internal.h"
 
 AVFrame *ff_null_get_audio_buffer(AVFilterLink *link, int nb_samples)
@@ -42,7 +43,7 @@ AVFrame *ff_default_get_audio_buffer(AVFilterLink *link, int nb_samples)
     if (buf_size < 0)
         goto fail;
 
-    frame->buf[0] = av_buffer_alloc(buf_size);
+    frame->buf[0] = ff_frame_pool_get_audio_buffer(&link->frame_pool, buf_size);
     if (!frame->buf[0])
         goto fail;
 
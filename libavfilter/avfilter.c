@@ -31,6 +31,7 @@
 #include "audio.h"
 #include "avfilter.h"
 #include "formats.h"
+#include "framepool.h"
 #include "internal.h"
 #include "video.h"
 
@@ -156,6 +157,7 @@ int avfilter_config_links(AVFilterContext *filter)
             return 0;
         case AVLINK_UNINIT:
             link->init_state = AVLINK_STARTINIT;
+            ff_frame_pool_uninit(&link->frame_pool);
 
             if ((ret = avfilter_config_links(link->src)) < 0)
                 return ret;
@@ -319,6 +321,19 @@ static const char *filter_name(void *p)
     return filter->filter->name;
 }
 
+static int default_execute(AVFilterContext *ctx, avfilter_action_func *func, void *arg,
+                           int *ret, int nb_jobs)
+{
+    int i;
+
+    for (i = 0; i < nb_jobs; i++) {
+        int r = func(ctx, arg, i, nb_jobs);
+        if (ret)
+            ret[i] = r;
+    }
+    return 0;
+}
+
 static const AVClass avfilter_class = {
     "AVFilter",
     filter_name,
@@ -341,6 +356,13 @@ int avfilter_open(AVFilterContext **filter_ctx, AVFilter *filter, const char *in
     ret->av_class = &avfilter_class;
     ret->filter   = filter;
     ret->name     = inst_name ? av_strdup(inst_name) : NULL;
+    ret->thread_type = AVFILTER_THREAD_SLICE | AVFILTER_THREAD_BRANCH;
+
+    ret->internal = av_mallocz(sizeof(*ret->internal));
+    if (!ret->internal)
+        goto err;
+    ret->internal->execute = default_execute;
+
     if (filter->priv_size) {
         ret->priv     = av_mallocz(filter->priv_size);
         if (!ret->priv)
@@ -384,6 +406,7 @@ err:
     av_freep(&ret->output_pads);
     ret->nb_outputs = 0;
     av_freep(&ret->priv);
+    av_freep(&ret->internal);
     av_free(ret);
     return AVERROR(ENOMEM);
 }
@@ -406,6 +429,7 @@ void avfilter_free(AVFilterContext *filter)
             ff_formats_unref(&link->out_samplerates);
             ff_channel_layouts_unref(&link->in_channel_layouts);
             ff_channel_layouts_unref(&link->out_channel_layouts);
+            ff_frame_pool_uninit(&link->frame_pool);
         }
         av_freep(&link);
     }
@@ -419,6 +443,7 @@ void avfilter_free(AVFilterContext *filter)
             ff_formats_unref(&link->out_samplerates);
             ff_channel_layouts_unref(&link->in_channel_layouts);
             ff_channel_layouts_unref(&link->out_channel_layouts);
+            ff_frame_pool_uninit(&link->frame_pool);
         }
         av_freep(&link);
     }
@@ -429,6 +454,9 @@ void avfilter_free(AVFilterContext *filter)
     av_freep(&filter->inputs);
     av_freep(&filter->outputs);
     av_freep(&filter->priv);
+    if (filter->internal)
+        av_freep(&filter->internal->branch_rets);
+    av_freep(&filter->internal);
     av_free(filter);
 }
 
@@ -507,3 +535,34 @@ int ff_filter_frame(AVFilterLink *link, AVFrame *frame)
 
     return filter_frame(link, out);
 }
+
+static int filter_frame_output(AVFilterContext *ctx, void *arg, int jobnr, int nb_jobs)
+{
+    AVFrame **frames = arg;
+    return ff_filter_frame(ctx->outputs[jobnr], frames[jobnr]);
+}
+
+int ff_filter_frame_outputs(AVFilterContext *ctx, AVFrame **frames)
+{
+    int i, ret = 0;
+
+    if (ctx->graph && ctx->thread_type & AVFILTER_THREAD_BRANCH) {
+        int *rets = ctx->internal->branch_rets;
+
+        ctx->graph->internal->thread_execute(ctx, filter_frame_output, frames,
+                                             rets, ctx->nb_outputs);
+        for (i = 0; i < ctx->nb_outputs; i++)
+            if (rets[i] < 0)
+                return rets[i];
+        return 0;
+    }
+
+    for (i = 0; i < ctx->nb_outputs; i++) {
+        ret = ff_filter_frame(ctx->outputs[i], frames[i]);
+        if (ret < 0)
+            break;
+    }
+    for (i++; i < ctx->nb_outputs; i++)
+        av_frame_free(&frames[i]);
+    return ret;
+}
@@ -372,6 +372,12 @@ const char *avfilter_pad_get_name(AVFilterPad *pads, int pad_idx);
  */
 enum AVMediaType avfilter_pad_get_type(AVFilterPad *pads, int pad_idx);
 
+/**
+ * The filter supports multithreading by splitting frames into multiple parts
+ * and processing them concurrently.
+ */
+#define AVFILTER_FLAG_SLICE_THREADS         (1 << 0)
+
 /**
  * Filter definition. This defines the pads a filter contains, and all the
  * callback functions used to interact with the filter.
@@ -388,6 +394,11 @@ typedef struct AVFilter {
     const AVFilterPad *inputs;  ///< NULL terminated list of inputs. NULL if none
     const AVFilterPad *outputs; ///< NULL terminated list of outputs. NULL if none
 
+    /**
+     * A combination of AVFILTER_FLAG_*
+     */
+    int flags;
+
     /*****************************************************************
      * All fields below this line are not part of the public API. They
      * may not be used outside of libavfilter and can be changed and
@@ -422,6 +433,20 @@ typedef struct AVFilter {
     int priv_size;      ///< size of private data to allocate for the filter
 } AVFilter;
 
+/**
+ * Process multiple parts of the frame concurrently.
+ */
+#define AVFILTER_THREAD_SLICE (1 << 0)
+
+/**
+ * Send frames down the output branches of a filter concurrently. Only used
+ * for filters with several outputs whose downstream branches do not share
+ * any filter.
+ */
+#define AVFILTER_THREAD_BRANCH (1 << 1)
+
+typedef struct AVFilterInternal AVFilterInternal;
+
 /** An instance of a filter */
 struct AVFilterContext {
     const AVClass *av_class;              ///< needed for av_log()
@@ -445,6 +470,31 @@ struct AVFilterContext {
     unsigned    nb_outputs;         ///< number of output pads
 
     void *priv;                     ///< private data for use by the filter
+
+    struct AVFilterGraph *graph;    ///< filtergraph this filter belongs to
+
+    /**
+     * Type of multithreading being allowed/used. A combination of
+     * AVFILTER_THREAD_* flags.
+     *
+     * May be set by the caller before adding the filter to a graph to forbid
+     * some or all kinds of multithreading for this filter. The default is
+     * allowing everything.
+     *
+     * When the filter is added to a graph, this field is combined using bit
+     * AND with AVFilterGraph.thread_type to get the final mask used for
+     * determining allowed threading types. I.e. a threading type needs to be
+     * set in both to be allowed.
+     *
+     * After the filter is added to a graph, libavfilter sets this field to
+     * the threading type that is actually used (0 for no multithreading).
+     */
+    int thread_type;
+
+    /**
+     * An opaque struct for libavfilter internal use.
+     */
+    AVFilterInternal *internal;
 };
 
 /**
@@ -521,6 +571,12 @@ struct AVFilterLink {
         AVLINK_STARTINIT,       ///< started, but incomplete
         AVLINK_INIT             ///< complete
     } init_state;
+
+    /**
+     * Buffer pool for the frames allocated by the default get_video_buffer()
+     * and get_audio_buffer() callbacks on this link.
+     */
+    struct FFFramePool *frame_pool;
 };
 
 /**
@@ -20,29 +20,72 @@
  * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA
  */
 
+#include <limits.h>
+#include <stddef.h>
 #include <string.h>
 
+#include "config.h"
+
 #include "libavutil/avassert.h"
 #include "libavutil/channel_layout.h"
 #include "libavutil/common.h"
+#include "libavutil/cpu.h"
 #include "libavutil/log.h"
+#include "libavutil/opt.h"
+#include "libavutil/pixdesc.h"
 #include "avfilter.h"
 #include "avfiltergraph.h"
 #include "formats.h"
 #include "internal.h"
+#include "thread.h"
+
+#define OFFSET(x) offsetof(AVFilterGraph, x)
+#define FLAGS AV_OPT_FLAG_VIDEO_PARAM
+static const AVOption filtergraph_options[] = {
+    { "thread_type", "Allowed thread types", OFFSET(thread_type), AV_OPT_TYPE_FLAGS,
+        { .i64 = AVFILTER_THREAD_SLICE }, 0, INT_MAX, FLAGS, "thread_type" },
+        { "slice",  NULL, 0, AV_OPT_TYPE_CONST, { .i64 = AVFILTER_THREAD_SLICE  }, .flags = FLAGS, .unit = "thread_type" },
+        { "branch", NULL, 0, AV_OPT_TYPE_CONST, { .i64 = AVFILTER_THREAD_BRANCH }, .flags = FLAGS, .unit = "thread_type" },
+    { "threads",     "Maximum number of threads", OFFSET(nb_threads),
+        AV_OPT_TYPE_INT,   { .i64 = 0 }, 0, INT_MAX, FLAGS },
+    { NULL },
+};
 
 static const AVClass filtergraph_class = {
     .class_name = "AVFilterGraph",
     .item_name  = av_default_item_name,
+    .option     = filtergraph_options,
     .version    = LIBAVUTIL_VERSION_INT,
 };
 
+#if !HAVE_THREADS
+void ff_graph_thread_free(AVFilterGraph *graph)
+{
+}
+
+int ff_graph_thread_init(AVFilterGraph *graph)
+{
+    graph->thread_type = 0;
+    graph->nb_threads  = 1;
+    return 0;
+}
+#endif
+
 AVFilterGraph *avfilter_graph_alloc(void)
 {
     AVFilterGraph *ret = av_mallocz(sizeof(AVFilterGraph));
     if (!ret)
         return NULL;
+
+    ret->internal = av_mallocz(sizeof(*ret->internal));
+    if (!ret->internal) {
+        av_freep(&ret);
+        return NULL;
+    }
+
     ret->av_class = &filtergraph_class;
+    av_opt_set_defaults(ret);
+
     return ret;
 }
 
@@ -52,22 +95,60 @@ void avfilter_graph_free(AVFilterGraph **graph)
         return;
     for (; (*graph)->filter_count > 0; (*graph)->filter_count--)
         avfilter_free((*graph)->filters[(*graph)->filter_count - 1]);
+
+    ff_graph_thread_free(*graph);
+
     av_freep(&(*graph)->scale_sws_opts);
     av_freep(&(*graph)->resample_lavr_opts);
     av_freep(&(*graph)->filters);
+    av_freep(&(*graph)->internal);
     av_freep(graph);
 }
 
+/**
+ * Set up the slice threading implementation used by the filters of a graph,
+ * once, before the first filter is added.
+ */
+static int graph_thread_init(AVFilterGraph *graph)
+{
+    if (graph->internal->thread_execute || graph->filter_count)
+        return 0;
+
+    if (graph->execute) {
+        graph->internal->thread_execute = graph->execute;
+        if (!graph->nb_threads)
+            graph->nb_threads = FFMAX(av_cpu_count(), 1);
+        return 0;
+    }
+
+    return ff_graph_thread_init(graph);
+}
+
 int avfilter_graph_add_filter(AVFilterGraph *graph, AVFilterContext *filter)
 {
-    AVFilterContext **filters = av_realloc(graph->filters,
-                                           sizeof(AVFilterContext*) * (graph->filter_count+1));
+    AVFilterContext **filters;
+    int ret;
+
+    if ((ret = graph_thread_init(graph)) < 0)
+        return ret;
+
+    filters = av_realloc(graph->filters,
+                         sizeof(AVFilterContext*) * (graph->filter_count+1));
     if (!filters)
         return AVERROR(ENOMEM);
 
     graph->filters = filters;
     graph->filters[graph->filter_count++] = filter;
 
+    filter->graph = graph;
+    filter->thread_type &= graph->thread_type;
+    if (!(filter->filter->flags & AVFILTER_FLAG_SLICE_THREADS))
+        filter->thread_type &= ~AVFILTER_THREAD_SLICE;
+    if (!graph->internal->thread_execute)
+        filter->thread_type = 0;
+    if (filter->thread_type & AVFILTER_THREAD_SLICE)
+        filter->internal->execute = graph->internal->thread_execute;
+
     return 0;
 }
 
@@ -163,9 +244,552 @@ AVFilterContext *avfilter_graph_get_filter(AVFilterGraph *graph, char *name)
     return NULL;
 }
 
+/* Weights of the conversion cost estimates. Anything that loses information
+ * costs more than any amount of lossless work, so that a lossless path is
+ * always preferred when there is one. */
+#define LOSS_CHROMA        (1 << 16) ///< color to grayscale
+#define LOSS_ALPHA         (1 << 15) ///< dropping the alpha channel
+#define LOSS_PALETTE       (1 << 14) ///< quantizing to a palette
+#define LOSS_DEPTH         (1 << 11) ///< per bit of precision lost
+#define LOSS_SUBSAMPLING   (1 << 10) ///< per step of chroma subsampling added
+#define COST_COLORSPACE    16        ///< RGB <-> YUV matrix conversion
+#define COST_UPSAMPLING    4         ///< per step of chroma upsampling
+#define COST_DEPTH         2         ///< per bit of precision added
+#define COST_LAYOUT        2         ///< packed <-> planar or endianness flip
+
+/** cost of an auto-inserted conversion filter, on top of its conversion */
+#define CONVERSION_PENALTY (1 << 24)
+/** above the cost of any possible conversion, placements needing one are
+ *  rejected by plan_cost() */
+#define CONVERSION_IMPOSSIBLE (1 << 22)
+
+static int pix_fmt_depth(const AVPixFmtDescriptor *desc)
+{
+    int i, depth = 0;
+
+    for (i = 0; i < desc->nb_components; i++)
+        depth = FFMAX(depth, desc->comp[i].depth_minus1 + 1);
+
+    return depth;
+}
+
+/**
+ * Estimate the cost of converting video from pixel format src to dst.
+ */
+static int pix_fmt_conversion_cost(enum AVPixelFormat src,
+                                   enum AVPixelFormat dst)
+{
+    const AVPixFmtDescriptor *s = av_pix_fmt_desc_get(src);
+    const AVPixFmtDescriptor *d = av_pix_fmt_desc_get(dst);
+    int s_alpha, d_alpha, s_color, d_color, s_depth, d_depth;
+    int cost = 0;
+
+    if (src == dst)
+        return 0;
+    if (!s || !d || (s->flags | d->flags) & PIX_FMT_HWACCEL)
+        return CONVERSION_IMPOSSIBLE;
+
+    s_alpha = !!(s->flags & PIX_FMT_ALPHA);
+    d_alpha = !!(d->flags & PIX_FMT_ALPHA);
+    s_color = s->nb_components - s_alpha >= 3 || s->flags & PIX_FMT_PAL;
+    d_color = d->nb_components - d_alpha >= 3 || d->flags & PIX_FMT_PAL;
+    s_depth = pix_fmt_depth(s);
+    d_depth = pix_fmt_depth(d);
+
+    if (s_color && !d_color)
+        cost += LOSS_CHROMA;
+    if (s_alpha && !d_alpha)
+        cost += LOSS_ALPHA;
+    if (d->flags & PIX_FMT_PAL && !(s->flags & PIX_FMT_PAL))
+        cost += LOSS_PALETTE;
+
+    if (d_depth < s_depth)
+        cost += LOSS_DEPTH * (s_depth - d_depth);
+    else
+        cost += COST_DEPTH * (d_depth - s_depth);
+
+    if (s_color && d_color) {
+        int steps = d->log2_chroma_w + d->log2_chroma_h -
+                    s->log2_chroma_w - s->log2_chroma_h;
+
+        if (steps > 0)
+            cost += LOSS_SUBSAMPLING * steps;
+        else
+            cost += COST_UPSAMPLING * -steps;
+
+        if ((s->flags ^ d->flags) & PIX_FMT_RGB)
+            cost += COST_COLORSPACE;
+    }
+
+    if ((s->flags ^ d->flags) & PIX_FMT_PLANAR)
+        cost += COST_LAYOUT;
+    if ((s->flags ^ d->flags) & PIX_FMT_BE)
+        cost += COST_LAYOUT;
+
+    /* the formats differ in some other way, e.g. component order */
+    return FFMAX(cost, 1);
+}
+
+/**
+ * Estimate the cost of converting audio from sample format src to dst.
+ */
+static int sample_fmt_conversion_cost(enum AVSampleFormat src,
+                                      enum AVSampleFormat dst)
+{
+    enum AVSampleFormat src_packed = av_get_packed_sample_fmt(src);
+    enum AVSampleFormat dst_packed = av_get_packed_sample_fmt(dst);
+    int src_bps = av_get_bytes_per_sample(src);
+    int dst_bps = av_get_bytes_per_sample(dst);
+    int cost = 0;
+
+    if (src == dst)
+        return 0;
+    if (src_packed == AV_SAMPLE_FMT_NONE || dst_packed == AV_SAMPLE_FMT_NONE)
+        return CONVERSION_IMPOSSIBLE;
+
+    if (src_packed != dst_packed) {
+        /* double holds everything, integers fit in anything wider */
+        int lossless = dst_packed == AV_SAMPLE_FMT_DBL ||
+                       (dst_bps > src_bps && src_packed != AV_SAMPLE_FMT_FLT);
+
+        if (lossless)
+            cost += COST_DEPTH * (dst_bps - src_bps);
+        else
+            cost += LOSS_DEPTH + COST_DEPTH * abs(dst_bps - src_bps);
+    }
+    if (av_sample_fmt_is_planar(src) != av_sample_fmt_is_planar(dst))
+        cost += 1;
+
+    return cost;
+}
+
+static int format_conversion_cost(enum AVMediaType type, int src, int dst)
+{
+    return type == AVMEDIA_TYPE_VIDEO ? pix_fmt_conversion_cost(src, dst) :
+                                        sample_fmt_conversion_cost(src, dst);
+}
+
+/**
+ * Return the cheapest conversion cost from a format in src to a format in
+ * dst and store the formats involved in src_fmt and dst_fmt.
+ */
+static int cheapest_conversion(enum AVMediaType type,
+                               const int64_t *src, int nb_src,
+                               const int64_t *dst, int nb_dst,
+                               int *src_fmt, int *dst_fmt)
+{
+    int i, j, best = INT_MAX;
+
+    for (i = 0; i < nb_src && best; i++)
+        for (j = 0; j < nb_dst && best; j++) {
+            int cost = format_conversion_cost(type, src[i], dst[j]);
+            if (cost < best) {
+                best = cost;
+                if (src_fmt) *src_fmt = src[i];
+                if (dst_fmt) *dst_fmt = dst[j];
+            }
+        }
+
+    return best;
+}
+
+enum {
+    PLAN_FORMATS,
+    PLAN_SAMPLERATES,
+    PLAN_CHANNEL_LAYOUTS,
+    PLAN_NB
+};
+
+/**
+ * A format list taking part in the negotiation. Lists that are merged
+ * together during the negotiation form a component, whose root holds the
+ * formats the lists of the component have in common.
+ */
+typedef struct PlanNode {
+    const void *list;
+    int64_t *vals;  ///< sorted formats of the list
+    int   nb_vals;  ///< number of formats, -1 if the list accepts anything
+    int64_t *set;   ///< formats common to the component (roots only)
+    int   nb_set;
+    int   parent;
+    int   group;    ///< connectivity regardless of conflicts
+} PlanNode;
+
+typedef struct FormatPlan {
+    AVFilterLink **links;
+    int (*ends)[PLAN_NB][2]; ///< node indices of the ends of each link
+    int nb_links;
+    PlanNode *nodes;
+    int nb_nodes;
+} FormatPlan;
+
+static int cmp_int64(const void *a, const void *b)
+{
+    int64_t va = *(const int64_t *)a, vb = *(const int64_t *)b;
+    return (va > vb) - (va < vb);
+}
+
+static int plan_add_node(FormatPlan *p, const void *list, int kind)
+{
+    PlanNode *node;
+    int i, nb;
+
+    if (!list)
+        return -1;
+    for (i = 0; i < p->nb_nodes; i++)
+        if (p->nodes[i].list == list)
+            return i;
+
+    node = &p->nodes[p->nb_nodes];
+    if (kind == PLAN_CHANNEL_LAYOUTS) {
+        const AVFilterChannelLayouts *l = list;
+        nb = l->nb_channel_layouts;
+        if (nb && !(node->vals = av_malloc(nb * sizeof(*node->vals))))
+            return AVERROR(ENOMEM);
+        for (i = 0; i < nb; i++)
+            node->vals[i] = l->channel_layouts[i];
+    } else {
+        const AVFilterFormats *f = list;
+        nb = f->format_count;
+        if (nb && !(node->vals = av_malloc(nb * sizeof(*node->vals))))
+            return AVERROR(ENOMEM);
+        for (i = 0; i < nb; i++)
+            node->vals[i] = f->formats[i];
+    }
+    if (nb && !(node->set = av_malloc(nb * sizeof(*node->set)))) {
+        av_freep(&node->vals);
+        return AVERROR(ENOMEM);
+    }
+    qsort(node->vals, nb, sizeof(*node->vals), cmp_int64);
+
+    node->list    = list;
+    /* an empty list of sample rates or channel layouts stands for any */
+    node->nb_vals = !nb && kind != PLAN_FORMATS ? -1 : nb;
+    node->group   = p->nb_nodes;
+
+    return p->nb_nodes++;
+}
+
+static void plan_free(FormatPlan *p)
+{
+    int i;
+
+    for (i = 0; i < p->nb_nodes; i++) {
+        av_freep(&p->nodes[i].vals);
+        av_freep(&p->nodes[i].set);
+    }
+    av_freep(&p->nodes);
+    av_freep(&p->links);
+    av_freep(&p->ends);
+}
+
+static int plan_find(FormatPlan *p, int i)
+{
+    while (p->nodes[i].parent != i)
+        i = p->nodes[i].parent = p->nodes[p->nodes[i].parent].parent;
+    return i;
+}
+
+static int plan_find_group(FormatPlan *p, int i)
+{
+    while (p->nodes[i].group != i)
+        i = p->nodes[i].group = p->nodes[p->nodes[i].group].group;
+    return i;
+}
+
+/**
+ * Merge the components of the nodes a and b if they have a format in common.
+ *
+ * @return 1 if the components were merged, 0 if they are incompatible
+ */
+static int plan_merge(FormatPlan *p, int a, int b)
+{
+    PlanNode *ra, *rb;
+    int i = 0, j = 0, k = 0;
+
+    a = plan_find(p, a);
+    b = plan_find(p, b);
+    if (a == b)
+        return 1;
+    ra = &p->nodes[a];
+    rb = &p->nodes[b];
+
+    if (ra->nb_set < 0 || rb->nb_set < 0) {
+        if (ra->nb_set < 0)
+            ra->parent = b;
+        else
+            rb->parent = a;
+        return 1;
+    }
+
+    while (i < ra->nb_set && j < rb->nb_set) {
+        if (ra->set[i] < rb->set[j]) {
+            i++;
+        } else if (ra->set[i] > rb->set[j]) {
+            j++;
+        } else {
+            ra->set[k++] = ra->set[i];
+            i++;
+            j++;
+        }
+    }
+    /* the intersection was computed in place, but nothing is changed on
+     * failure since k only grows on matches and stays at 0 */
+    if (!k)
+        return 0;
+
+    ra->nb_set = k;
+    rb->parent = a;
+    return 1;
+}
+
+/**
+ * Simulate the merging of the format lists of the graph.
+ *
+ * @param cut   if not NULL, the links marked in it get a conversion filter
+ *              and the others must all merge
+ * @param fails if not NULL, behave like query_formats(): every link that
+ *              cannot be merged gets a conversion filter and is marked in
+ *              fails
+ * @return number of conversions, or -1 if cut leaves incompatible lists
+ */
+static int plan_run(FormatPlan *p, const uint8_t *cut, uint8_t *fails)
+{
+    int i, k, nb_fails = 0;
+
+    for (i = 0; i < p->nb_nodes; i++) {
+        PlanNode *node = &p->nodes[i];
+        node->parent = i;
+        node->nb_set = node->nb_vals;
+        if (node->nb_vals > 0)
+            memcpy(node->set, node->vals, node->nb_vals * sizeof(*node->set));
+    }
+
+    for (i = 0; i < p->nb_links; i++) {
+        int merged = 1;
+
+        if (cut && cut[i])
+            continue;
+        for (k = 0; k < PLAN_NB; k++)
+            if (p->ends[i][k][0] >= 0 && p->ends[i][k][1] >= 0)
+                merged &= plan_merge(p, p->ends[i][k][0], p->ends[i][k][1]);
+
+        if (!merged) {
+            if (!fails)
+                return -1;
+            fails[i] = 1;
+            nb_fails++;
+        }
+    }
+
+    return nb_fails;
+}
+
+/**
+ * Estimate the cost of the conversions on the links marked in cut, using
+ * the state left by plan_run().
+ *
+ * @return the cost, INT64_MAX if one of the conversions is impossible
+ */
+static int64_t plan_cost(FormatPlan *p, const uint8_t *cut)
+{
+    int64_t cost = 0;
+    int i;
+
+    for (i = 0; i < p->nb_links; i++) {
+        PlanNode *src, *dst;
+        int conv;
+
+        if (!cut[i])
+            continue;
+        cost += CONVERSION_PENALTY;
+
+        if (p->ends[i][PLAN_FORMATS][0] < 0 || p->ends[i][PLAN_FORMATS][1] < 0)
+            continue;
+        src = &p->nodes[plan_find(p, p->ends[i][PLAN_FORMATS][0])];
+        dst = &p->nodes[plan_find(p, p->ends[i][PLAN_FORMATS][1])];
+        conv = cheapest_conversion(p->links[i]->type,
+                                   src->set, src->nb_set,
+                                   dst->set, dst->nb_set, NULL, NULL);
+        if (conv >= CONVERSION_IMPOSSIBLE)
+            return INT64_MAX;
+        cost += conv;
+    }
+
+    return cost;
+}
+
+static int plan_init(FormatPlan *p, AVFilterGraph *graph)
+{
+    int i, j, k, nb_links = 0;
+
+    for (i = 0; i < graph->filter_count; i++)
+        nb_links += graph->filters[i]->nb_inputs;
+
+    p->links = av_malloc(nb_links * sizeof(*p->links));
+    p->ends  = av_malloc(nb_links * sizeof(*p->ends));
+    p->nodes = av_mallocz(nb_links * 2 * PLAN_NB * sizeof(*p->nodes));
+    if (nb_links && (!p->links || !p->ends || !p->nodes))
+        return AVERROR(ENOMEM);
+
+    for (i = 0; i < graph->filter_count; i++) {
+        AVFilterContext *filter = graph->filters[i];
+
+        for (j = 0; j < filter->nb_inputs; j++) {
+            AVFilterLink *link = filter->inputs[j];
+            const void *lists[PLAN_NB][2] = {
+                { link->in_formats,         link->out_formats         },
+                { link->in_samplerates,     link->out_samplerates     },
+                { link->in_channel_layouts, link->out_channel_layouts },
+            };
+            int l = p->nb_links;
+
+            if (!link->in_formats || !link->out_formats)
+                continue;
+
+            for (k = 0; k < PLAN_NB; k++) {
+                int in  = plan_add_node(p, lists[k][0], k);
+                int out = plan_add_node(p, lists[k][1], k);
+
+                if (in < -1 || out < -1)
+                    return AVERROR(ENOMEM);
+                if (in < 0 || out < 0)
+                    in = out = -1;
+                p->ends[l][k][0] = in;
+                p->ends[l][k][1] = out;
+
+                if (in >= 0) {
+                    int g0 = plan_find_group(p, p->ends[l][0][0]);
+                    p->nodes[plan_find_group(p, in )].group = g0;
+                    p->nodes[plan_find_group(p, out)].group = g0;
+                }
+            }
+            p->links[p->nb_links++] = link;
+        }
+    }
+
+    return 0;
+}
+
+#define MAX_PLAN_CANDIDATES 24
+#define MAX_PLAN_RUNS       (1 << 14)
+
+/**
+ * Look for the cheapest set of links to put conversion filters on, so that
+ * the format lists on all the other links can be merged.
+ *
+ * Merging the links in the order of the filters and inserting a conversion
+ * on every link that does not fit the lists merged so far is not always the
+ * best placement, e.g. a split whose outputs all need
+ * another format gets one conversion per output, while a single one on its
+ * input would do.
+ *
+ * @param[out] cut links to insert conversions on, set to NULL if the
+ *                 placement of query_formats() is already the best one
+ */
+static int plan_conversions(AVFilterGraph *graph, AVClass *log_ctx,
+                            AVFilterLink ***cut, int *nb_cut)
+{
+    FormatPlan p = { 0 };
+    uint8_t *fails = NULL, *try = NULL, *best = NULL;
+    int cand[MAX_PLAN_CANDIDATES], idx[MAX_PLAN_CANDIDATES];
+    int i, j, s, nb_fails, nb_cand = 0, runs = 0, ret;
+    int64_t best_cost;
+
+    *cut    = NULL;
+    *nb_cut = 0;
+
+    if ((ret = plan_init(&p, graph)) < 0)
+        goto end;
+
+    fails = av_mallocz(p.nb_links + 1);
+    try   = av_mallocz(p.nb_links + 1);
+    best  = av_mallocz(p.nb_links + 1);
+    if (!fails || !try || !best) {
+        ret = AVERROR(ENOMEM);
+        goto end;
+    }
+
+    nb_fails = plan_run(&p, NULL, fails);
+    if (!nb_fails)
+        goto end;
+
+    /* only links connected to a failing one can move its conversion */
+    for (i = 0; i < p.nb_links; i++) {
+        int g = plan_find_group(&p, p.ends[i][0][0]);
+
+        for (j = 0; j < p.nb_links; j++)
+            if (fails[j] && plan_find_group(&p, p.ends[j][0][0]) == g)
+                break;
+        if (j == p.nb_links)
+            continue;
+        if (nb_cand == MAX_PLAN_CANDIDATES)
+            goto end;
+        cand[nb_cand++] = i;
+    }
+
+    plan_run(&p, fails, NULL);
+    best_cost = plan_cost(&p, fails);
+    memcpy(best, fails, p.nb_links);
+
+    /* try all sets of conversions no larger than the default one, smallest
+     * first, keeping the default placement on ties */
+    for (s = 1; s <= nb_fails && runs < MAX_PLAN_RUNS; s++) {
+        for (i = 0; i < s; i++)
+            idx[i] = i;
+
+        while (runs++ < MAX_PLAN_RUNS) {
+            memset(try, 0, p.nb_links);
+            for (i = 0; i < s; i++)
+                try[cand[idx[i]]] = 1;
+
+            if (plan_run(&p, try, NULL) >= 0) {
+                int64_t cost = plan_cost(&p, try);
+                if (cost < best_cost) {
+                    best_cost = cost;
+                    memcpy(best, try, p.nb_links);
+                }
+            }
+
+            /* next combination of s candidates */
+            for (i = s - 1; i >= 0 && idx[i] == nb_cand - s + i; i--)
+                ;
+            if (i < 0)
+                break;
+            idx[i]++;
+            for (j = i + 1; j < s; j++)
+                idx[j] = idx[j - 1] + 1;
+        }
+        if (best_cost < (int64_t)(s + 1) * CONVERSION_PENALTY)
+            break;
+    }
+
+    if (!memcmp(best, fails, p.nb_links))
+        goto end;
+
+    if (!(*cut = av_malloc(p.nb_links * sizeof(**cut)))) {
+        ret = AVERROR(ENOMEM);
+        goto end;
+    }
+    for (i = 0; i < p.nb_links; i++)
+        if (best[i])
+            (*cut)[(*nb_cut)++] = p.links[i];
+
+    av_log(log_ctx, AV_LOG_VERBOSE, "Placing %d format conversion(s) "
+           "instead of %d.\n", *nb_cut, nb_fails);
+
+end:
+    av_freep(&fails);
+    av_freep(&try);
+    av_freep(&best);
+    plan_free(&p);
+    return ret;
+}
+
 static int query_formats(AVFilterGraph *graph, AVClass *log_ctx)
 {
-    int i, j, ret;
+    AVFilterLink **cut;
+    int i, j, k, ret, nb_cut;
     int scaler_count = 0, resampler_count = 0;
 
     /* ask all the sub-filters for their supported media formats */
@@ -176,6 +800,9 @@ static int query_formats(AVFilterGraph *graph, AVClass *log_ctx)
             ff_default_query_formats(graph->filters[i]);
     }
 
+    if ((ret = plan_conversions(graph, log_ctx, &cut, &nb_cut)) < 0)
+        return ret;
+
     /* go through and merge as many format lists as possible */
     for (i = 0; i < graph->filter_count; i++) {
         AVFilterContext *filter = graph->filters[i];
@@ -187,19 +814,28 @@ static int query_formats(AVFilterGraph *graph, AVClass *log_ctx)
             if (!link)
                 continue;
 
-            if (link->in_formats != link->out_formats &&
-                !ff_merge_formats(link->in_formats,
-                                        link->out_formats))
+            for (k = 0; k < nb_cut && cut[k] != link; k++)
+                ;
+            if (k < nb_cut) {
+                /* planned conversion, leave the lists on both sides apart.
+                 * The link will feed the conversion filter, so forget it. */
+                cut[k] = cut[--nb_cut];
                 convert_needed = 1;
-            if (link->type == AVMEDIA_TYPE_AUDIO) {
-                if (link->in_channel_layouts != link->out_channel_layouts &&
-                    !ff_merge_channel_layouts(link->in_channel_layouts,
-                                              link->out_channel_layouts))
-                    convert_needed = 1;
-                if (link->in_samplerates != link->out_samplerates &&
-                    !ff_merge_samplerates(link->in_samplerates,
-                                          link->out_samplerates))
+            } else {
+                if (link->in_formats != link->out_formats &&
+                    !ff_merge_formats(link->in_formats,
+                                      link->out_formats))
                     convert_needed = 1;
+                if (link->type == AVMEDIA_TYPE_AUDIO) {
+                    if (link->in_channel_layouts != link->out_channel_layouts &&
+                        !ff_merge_channel_layouts(link->in_channel_layouts,
+                                                  link->out_channel_layouts))
+                        convert_needed = 1;
+                    if (link->in_samplerates != link->out_samplerates &&
+                        !ff_merge_samplerates(link->in_samplerates,
+                                              link->out_samplerates))
+                        convert_needed = 1;
+                }
             }
 
             if (convert_needed) {
@@ -215,7 +851,8 @@ static int query_formats(AVFilterGraph *graph, AVClass *log_ctx)
                     if (!(filter = avfilter_get_by_name("scale"))) {
                         av_log(log_ctx, AV_LOG_ERROR, "'scale' filter "
                                "not present, cannot convert pixel formats.\n");
-                        return AVERROR(EINVAL);
+                        ret = AVERROR(EINVAL);
+                        goto end;
                     }
 
                     snprintf(inst_name, sizeof(inst_name), "auto-inserted scaler %d",
@@ -224,13 +861,14 @@ static int query_formats(AVFilterGraph *graph, AVClass *log_ctx)
                     if ((ret = avfilter_graph_create_filter(&convert, filter,
                                                             inst_name, scale_args, NULL,
                                                             graph)) < 0)
-                        return ret;
+                        goto end;
                     break;
                 case AVMEDIA_TYPE_AUDIO:
                     if (!(filter = avfilter_get_by_name("resample"))) {
                         av_log(log_ctx, AV_LOG_ERROR, "'resample' filter "
                                "not present, cannot convert audio formats.\n");
-                        return AVERROR(EINVAL);
+                        ret = AVERROR(EINVAL);
+                        goto end;
                     }
 
                     snprintf(inst_name, sizeof(inst_name), "auto-inserted resampler %d",
@@ -242,14 +880,15 @@ static int query_formats(AVFilterGraph *graph, AVClass *log_ctx)
                     if ((ret = avfilter_graph_create_filter(&convert, filter,
                                                             inst_name, scale_args,
                                                             NULL, graph)) < 0)
-                        return ret;
+                        goto end;
                     break;
                 default:
-                    return AVERROR(EINVAL);
+                    ret = AVERROR(EINVAL);
+                    goto end;
                 }
 
                 if ((ret = avfilter_insert_filter(link, convert, 0, 0)) < 0)
-                    return ret;
+                    goto end;
 
                 convert->filter->query_formats(convert);
                 inlink  = convert->inputs[0];
@@ -274,13 +913,15 @@ static int query_formats(AVFilterGraph *graph, AVClass *log_ctx)
                     av_log(log_ctx, AV_LOG_ERROR,
                            "Impossible to convert between the formats supported by the filter "
                            "'%s' and the filter '%s'\n", link->src->name, link->dst->name);
-                    return ret;
+                    goto end;
                 }
             }
         }
     }
 
-    return 0;
+end:
+    av_freep(&cut);
+    return ret;
 }
 
 static int pick_format(AVFilterLink *link)
@@ -544,73 +1185,79 @@ static void swap_channel_layouts(AVFilterGraph *graph)
         swap_channel_layouts_on_filter(graph->filters[i]);
 }
 
-static void swap_sample_fmts_on_filter(AVFilterContext *filter)
+/**
+ * Settle the links on the other side of filter from a link whose format is
+ * settled on the format that is the cheapest to convert to or from.
+ *
+ * @param upstream settle the inputs from the outputs instead of the opposite
+ * @return 1 if a link was settled, 0 otherwise
+ */
+static int settle_formats_on_filter(AVFilterContext *filter, int upstream)
 {
+    AVFilterLink **fixed_links = upstream ? filter->outputs    : filter->inputs;
+    AVFilterLink  **open_links = upstream ? filter->inputs     : filter->outputs;
+    int           nb_fixed     = upstream ? filter->nb_outputs : filter->nb_inputs;
+    int           nb_open      = upstream ? filter->nb_inputs  : filter->nb_outputs;
     AVFilterLink *link = NULL;
-    int format, bps;
-    int i, j;
+    int i, j, format, ret = 0;
 
-    for (i = 0; i < filter->nb_inputs; i++) {
-        link = filter->inputs[i];
+    for (i = 0; i < nb_fixed; i++) {
+        link = fixed_links[i];
 
-        if (link->type == AVMEDIA_TYPE_AUDIO &&
-            link->out_formats->format_count == 1)
+        if ((link->type == AVMEDIA_TYPE_VIDEO ||
+             link->type == AVMEDIA_TYPE_AUDIO) &&
+            link->in_formats && link->in_formats->format_count == 1)
             break;
     }
-    if (i == filter->nb_inputs)
-        return;
+    if (i == nb_fixed)
+        return 0;
 
-    format = link->out_formats->formats[0];
-    bps    = av_get_bytes_per_sample(format);
+    format = link->in_formats->formats[0];
 
-    for (i = 0; i < filter->nb_outputs; i++) {
-        AVFilterLink *outlink = filter->outputs[i];
-        int best_idx = -1, best_score = INT_MIN;
+    for (i = 0; i < nb_open; i++) {
+        AVFilterLink *olink = open_links[i];
+        AVFilterFormats *fmts = olink->in_formats;
+        int best_idx = 0, best_cost = INT_MAX;
 
-        if (outlink->type != AVMEDIA_TYPE_AUDIO ||
-            outlink->in_formats->format_count < 2)
+        if (olink->type != link->type || !fmts || fmts->format_count < 2)
             continue;
 
-        for (j = 0; j < outlink->in_formats->format_count; j++) {
-            int out_format = outlink->in_formats->formats[j];
-            int out_bps    = av_get_bytes_per_sample(out_format);
-            int score;
-
-            if (av_get_packed_sample_fmt(out_format) == format ||
-                av_get_planar_sample_fmt(out_format) == format) {
-                best_idx   = j;
-                break;
-            }
-
-            /* for s32 and float prefer double to prevent loss of information */
-            if (bps == 4 && out_bps == 8) {
-                best_idx = j;
-                break;
-            }
+        for (j = 0; j < fmts->format_count; j++) {
+            int cost = upstream ?
+                format_conversion_cost(link->type, fmts->formats[j], format) :
+                format_conversion_cost(link->type, format, fmts->formats[j]);
 
-            /* prefer closest higher or equal bps */
-            score = -abs(out_bps - bps);
-            if (out_bps >= bps)
-                score += INT_MAX/2;
-
-            if (score > best_score) {
-                best_score = score;
-                best_idx   = j;
+            if (cost < best_cost) {
+                best_cost = cost;
+                best_idx  = j;
             }
         }
-        av_assert0(best_idx >= 0);
-        FFSWAP(int, outlink->in_formats->formats[0],
-               outlink->in_formats->formats[best_idx]);
+        fmts->formats[0]   = fmts->formats[best_idx];
+        fmts->format_count = 1;
+        ret = 1;
     }
+
+    return ret;
 }
 
-static void swap_sample_fmts(AVFilterGraph *graph)
+/**
+ * Pick the formats that still have to be chosen one link at a time, each time
+ * next to a link whose format is already known, and propagate every choice
+ * through the filters that do not change the format before the next one.
+ */
+static void settle_formats(AVFilterGraph *graph)
 {
-    int i;
-
-    for (i = 0; i < graph->filter_count; i++)
-        swap_sample_fmts_on_filter(graph->filters[i]);
+    int i, settled;
 
+    do {
+        reduce_formats(graph);
+
+        settled = 0;
+        for (i = 0; i < graph->filter_count && !settled; i++)
+            settled = settle_formats_on_filter(graph->filters[i], 0);
+        for (i = 0; i < graph->filter_count && !settled; i++)
+            settled = settle_formats_on_filter(graph->filters[i], 1);
+    } while (settled);
 }
 
 static int pick_formats(AVFilterGraph *graph)
@@ -630,11 +1277,59 @@ static int pick_formats(AVFilterGraph *graph)
     return 0;
 }
 
+/**
+ * Log the conversions done by the filters inserted by query_formats(), which
+ * are the filters of the graph from first on.
+ */
+static void report_conversions(AVFilterGraph *graph, AVClass *log_ctx,
+                               int first)
+{
+    int64_t total = 0;
+    int i;
+
+    for (i = first; i < graph->filter_count; i++) {
+        AVFilterContext *filter = graph->filters[i];
+        AVFilterLink *inlink  = filter->inputs[0];
+        AVFilterLink *outlink = filter->outputs[0];
+        int cost = format_conversion_cost(inlink->type, inlink->format,
+                                          outlink->format);
+
+        if (inlink->type == AVMEDIA_TYPE_VIDEO) {
+            av_log(log_ctx, AV_LOG_VERBOSE, "%s: %s -> %s between '%s' and "
+                   "'%s', cost %d\n", filter->name,
+                   av_get_pix_fmt_name(inlink->format),
+                   av_get_pix_fmt_name(outlink->format),
+                   inlink->src->name, outlink->dst->name, cost);
+        } else {
+            char in_layout[128], out_layout[128];
+
+            av_get_channel_layout_string(in_layout, sizeof(in_layout), 0,
+                                         inlink->channel_layout);
+            av_get_channel_layout_string(out_layout, sizeof(out_layout), 0,
+                                         outlink->channel_layout);
+            av_log(log_ctx, AV_LOG_VERBOSE, "%s: %s %dHz %s -> %s %dHz %s "
+                   "between '%s' and '%s', cost %d\n", filter->name,
+                   av_get_sample_fmt_name(inlink->format),
+                   inlink->sample_rate, in_layout,
+                   av_get_sample_fmt_name(outlink->format),
+                   outlink->sample_rate, out_layout,
+                   inlink->src->name, outlink->dst->name, cost);
+        }
+        total += cost;
+    }
+
+    if (i > first)
+        av_log(log_ctx, AV_LOG_VERBOSE, "Negotiated formats with %d "
+               "conversion filter(s), total cost %"PRId64".\n",
+               i - first, total);
+}
+
 /**
  * Configure the formats of all the links in the graph.
  */
 static int graph_config_formats(AVFilterGraph *graph, AVClass *log_ctx)
 {
+    int nb_filters = graph->filter_count;
     int ret;
 
     /* find supported formats from sub-filters, and merge along links */
@@ -643,18 +1338,20 @@ static int graph_config_formats(AVFilterGraph *graph, AVClass *log_ctx)
 
     /* Once everything is merged, it's possible that we'll still have
      * multiple valid media format choices. We try to minimize the amount
-     * of format conversion inside filters */
-    reduce_formats(graph);
+     * of format conversion inside filters, and pick the cheapest formats
+     * where a filter has to convert */
+    settle_formats(graph);
 
-    /* for audio filters, ensure the best format, sample rate and channel layout
+    /* for audio filters, ensure the best sample rate and channel layout
      * is selected */
-    swap_sample_fmts(graph);
     swap_samplerates(graph);
     swap_channel_layouts(graph);
 
     if ((ret = pick_formats(graph)) < 0)
         return ret;
 
+    report_conversions(graph, log_ctx, nb_filters);
+
     return 0;
 }
 
@@ -696,6 +1393,91 @@ static int graph_insert_fifos(AVFilterGraph *graph, AVClass *log_ctx)
     return 0;
 }
 
+static int filter_index(AVFilterGraph *graph, AVFilterContext *filter)
+{
+    int i;
+
+    for (i = 0; i < graph->filter_count; i++)
+        if (graph->filters[i] == filter)
+            return i;
+    return -1;
+}
+
+/**
+ * Mark all filters reachable from filter with branch.
+ *
+ * @return 0 if none of them was reached from another branch before,
+ *         AVERROR(EINVAL) otherwise
+ */
+static int mark_branch(AVFilterGraph *graph, AVFilterContext *filter,
+                       int *branch_of, int branch)
+{
+    int i, idx = filter_index(graph, filter);
+
+    if (idx < 0 || (branch_of[idx] && branch_of[idx] != branch))
+        return AVERROR(EINVAL);
+    if (branch_of[idx])
+        return 0;
+    branch_of[idx] = branch;
+
+    for (i = 0; i < filter->nb_outputs; i++)
+        if (filter->outputs[i] &&
+            mark_branch(graph, filter->outputs[i]->dst, branch_of, branch) < 0)
+            return AVERROR(EINVAL);
+    return 0;
+}
+
+/**
+ * Decide which filters send frames down their outputs concurrently.
+ * This is only done if no filter can be reached through more than one
+ * output, so that every filter is only ever run by one thread at a time.
+ */
+static int graph_config_branches(AVFilterGraph *graph, AVClass *log_ctx)
+{
+    int *branch_of;
+    int i, j;
+
+    branch_of = av_malloc(graph->filter_count * sizeof(*branch_of));
+    if (!branch_of)
+        return AVERROR(ENOMEM);
+
+    for (i = 0; i < graph->filter_count; i++) {
+        AVFilterContext *filter = graph->filters[i];
+
+        if (!(filter->thread_type & AVFILTER_THREAD_BRANCH))
+            continue;
+        filter->thread_type &= ~AVFILTER_THREAD_BRANCH;
+        if (filter->nb_outputs < 2)
+            continue;
+
+        memset(branch_of, 0, graph->filter_count * sizeof(*branch_of));
+        branch_of[i] = -1;
+        for (j = 0; j < filter->nb_outputs; j++)
+            if (mark_branch(graph, filter->outputs[j]->dst, branch_of, j + 1) < 0)
+                break;
+        if (j < filter->nb_outputs) {
+            av_log(log_ctx, AV_LOG_VERBOSE, "The outputs of '%s' lead to "
+                   "shared filters, running them one after the other.\n",
+                   filter->name);
+            continue;
+        }
+
+        av_freep(&filter->internal->branch_rets);
+        filter->internal->branch_rets = av_malloc(filter->nb_outputs *
+                                                  sizeof(*filter->internal->branch_rets));
+        if (!filter->internal->branch_rets) {
+            av_free(branch_of);
+            return AVERROR(ENOMEM);
+        }
+        filter->thread_type |= AVFILTER_THREAD_BRANCH;
+        av_log(log_ctx, AV_LOG_VERBOSE, "Running the %d output branches of "
+               "'%s' concurrently.\n", filter->nb_outputs, filter->name);
+    }
+
+    av_free(branch_of);
+    return 0;
+}
+
 int avfilter_graph_config(AVFilterGraph *graphctx, void *log_ctx)
 {
     int ret;
@@ -708,6 +1490,8 @@ int avfilter_graph_config(AVFilterGraph *graphctx, void *log_ctx)
         return ret;
     if ((ret = graph_config_links(graphctx, log_ctx)))
         return ret;
+    if ((ret = graph_config_branches(graphctx, log_ctx)) < 0)
+        return ret;
 
     return 0;
 }
@@ -0,0 +1,157 @@
+/*
+ * This file is part of Libav.
+ *
+ * Libav is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation; either
+ * version 2.1 of the License, or (at your option) any later version.
+ *
+ * Libav is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with Libav; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA
+ */
+
+#include "libavutil/buffer.h"
+#include "libavutil/common.h"
+#include "libavutil/imgutils.h"
+#include "libavutil/mem.h"
+#include "libavutil/pixdesc.h"
+
+#include "framepool.h"
+
+struct FFFramePool {
+    AVBufferPool *pools[4];
+    int linesize[4];
+
+    /* parameters the pools were created for */
+    int format;
+    int width, height;
+    int align;
+    int size;               ///< audio buffer size
+};
+
+static void pool_reset(FFFramePool *pool)
+{
+    int i;
+
+    for (i = 0; i < FF_ARRAY_ELEMS(pool->pools); i++)
+        av_buffer_pool_uninit(&pool->pools[i]);
+    memset(pool->linesize, 0, sizeof(pool->linesize));
+    pool->format = -1;
+    pool->width  = pool->height = pool->align = pool->size = 0;
+}
+
+static FFFramePool *pool_alloc(FFFramePool **pool)
+{
+    if (!*pool) {
+        *pool = av_mallocz(sizeof(**pool));
+        if (*pool)
+            (*pool)->format = -1;
+    }
+    return *pool;
+}
+
+static int update_video_pool(FFFramePool *pool, const AVFrame *frame, int align)
+{
+    const AVPixFmtDescriptor *desc = av_pix_fmt_desc_get(frame->format);
+    int linesize[4] = { 0 };
+    int i, ret;
+
+    if (pool->format == frame->format && pool->align == align &&
+        pool->width  == frame->width  && pool->height == frame->height)
+        return 0;
+
+    pool_reset(pool);
+
+    if (!desc)
+        return AVERROR(EINVAL);
+    if ((ret = av_image_check_size(frame->width, frame->height, 0, NULL)) < 0)
+        return ret;
+    if ((ret = av_image_fill_linesizes(linesize, frame->format, frame->width)) < 0)
+        return ret;
+
+    for (i = 0; i < 4 && linesize[i]; i++) {
+        int h = frame->height;
+        if (i == 1 || i == 2)
+            h = -((-h) >> desc->log2_chroma_h);
+
+        pool->linesize[i] = FFALIGN(linesize[i], align);
+        pool->pools[i]    = av_buffer_pool_init(pool->linesize[i] * h, NULL);
+        if (!pool->pools[i]) {
+            pool_reset(pool);
+            return AVERROR(ENOMEM);
+        }
+    }
+    if (desc->flags & PIX_FMT_PAL || desc->flags & PIX_FMT_PSEUDOPAL) {
+        av_buffer_pool_uninit(&pool->pools[1]);
+        pool->pools[1] = av_buffer_pool_init(1024, NULL);
+        if (!pool->pools[1]) {
+            pool_reset(pool);
+            return AVERROR(ENOMEM);
+        }
+    }
+
+    pool->format = frame->format;
+    pool->width  = frame->width;
+    pool->height = frame->height;
+    pool->align  = align;
+
+    return 0;
+}
+
+int ff_frame_pool_get_video_buffer(FFFramePool **ppool, AVFrame *frame,
+                                   int align)
+{
+    FFFramePool *pool = pool_alloc(ppool);
+    int i, ret;
+
+    if (!pool)
+        return AVERROR(ENOMEM);
+    if ((ret = update_video_pool(pool, frame, align)) < 0)
+        return ret;
+
+    for (i = 0; i < 4 && pool->pools[i]; i++) {
+        frame->buf[i] = av_buffer_pool_get(pool->pools[i]);
+        if (!frame->buf[i]) {
+            av_frame_unref(frame);
+            return AVERROR(ENOMEM);
+        }
+        frame->data[i]     = frame->buf[i]->data;
+        frame->linesize[i] = pool->linesize[i];
+    }
+    frame->extended_data = frame->data;
+
+    return 0;
+}
+
+AVBufferRef *ff_frame_pool_get_audio_buffer(FFFramePool **ppool, int size)
+{
+    FFFramePool *pool = pool_alloc(ppool);
+
+    if (!pool)
+        return NULL;
+
+    if (size > pool->size) {
+        pool_reset(pool);
+        pool->pools[0] = av_buffer_pool_init(size, NULL);
+        if (!pool->pools[0])
+            return NULL;
+        pool->size = size;
+    }
+
+    return av_buffer_pool_get(pool->pools[0]);
+}
+
+void ff_frame_pool_uninit(FFFramePool **pool)
+{
+    if (!*pool)
+        return;
+
+    pool_reset(*pool);
+    av_freep(pool);
+}
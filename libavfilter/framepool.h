@@ -0,0 +1,65 @@
+/*
+ * This file is part of Libav.
+ *
+ * Libav is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation; either
+ * version 2.1 of the License, or (at your option) any later version.
+ *
+ * Libav is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with Libav; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA
+ */
+
+#ifndef AVFILTER_FRAMEPOOL_H
+#define AVFILTER_FRAMEPOOL_H
+
+/**
+ * @file
+ * Per-link pools of frame buffers.
+ */
+
+#include "libavutil/frame.h"
+
+/**
+ * Buffer pools for the frames allocated on one link. The pools are
+ * (re)created lazily for the parameters of the requested frame, so a
+ * change of format or dimensions just starts a new set of pools; buffers
+ * still in use from the old ones stay valid until they are released.
+ */
+typedef struct FFFramePool FFFramePool;
+
+/**
+ * Allocate the data buffers of a video frame from a pool.
+ *
+ * @param pool  pointer to the pool, allocated on first use
+ * @param frame frame with format, width and height set
+ * @param align linesize alignment
+ * @return 0 on success, a negative AVERROR on failure
+ */
+int ff_frame_pool_get_video_buffer(FFFramePool **pool, AVFrame *frame,
+                                   int align);
+
+/**
+ * Get a buffer for the samples of an audio frame from a pool.
+ * Audio frames on a link usually vary in nb_samples, so the pool buffers
+ * only grow: smaller requests are served from the current pool and it is
+ * recreated only when a larger buffer is needed.
+ *
+ * @param pool pointer to the pool, allocated on first use
+ * @param size minimum size of the buffer
+ * @return a buffer of at least size bytes or NULL on failure
+ */
+AVBufferRef *ff_frame_pool_get_audio_buffer(FFFramePool **pool, int size);
+
+/**
+ * Free a pool. Buffers that are still in use are freed when released.
+ */
+void ff_frame_pool_uninit(FFFramePool **pool);
+
+#endif /* AVFILTER_FRAMEPOOL_H */
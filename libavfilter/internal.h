@@ -25,6 +25,7 @@
  */
 
 #include "avfilter.h"
+#include "avfiltergraph.h"
 
 #if !FF_API_AVFILTERPAD_PUBLIC
 /**
@@ -117,6 +118,20 @@ struct AVFilterPad {
 };
 #endif
 
+struct AVFilterGraphInternal {
+    void *thread;
+    avfilter_execute_func *thread_execute;
+};
+
+struct AVFilterInternal {
+    /**
+     * Run the slice jobs of the filter. The jobs are run one after the other
+     * unless the filter is in a graph with slice threading.
+     */
+    avfilter_execute_func *execute;
+    int *branch_rets;               ///< one return value per output, for AVFILTER_THREAD_BRANCH
+};
+
 /** default handler for freeing audio/video buffer when there are no references left */
 void ff_avfilter_default_free_buffer(AVFilterBuffer *buf);
 
@@ -196,4 +211,31 @@ int ff_request_frame(AVFilterLink *link);
  */
 int ff_filter_frame(AVFilterLink *link, AVFrame *frame);
 
+/**
+ * Send one frame on each output of a filter. With AVFILTER_THREAD_BRANCH
+ * the frames travel down the output branches concurrently, this returns
+ * once all of them are done.
+ *
+ * @param frames frames[i] is sent on output i. The function takes ownership
+ *               of all of them, also on error.
+ *
+ * @return >= 0 on success, the first negative AVERROR otherwise
+ */
+int ff_filter_frame_outputs(AVFilterContext *ctx, AVFrame **frames);
+
+/**
+ * Get the number of threads the slice jobs of a filter may be spread over.
+ * Filters use this to decide how many parts to split a frame into and how
+ * much per-job scratch memory to allocate.
+ *
+ * @return the number of threads, 1 if slice threading is not in use or the
+ *         filter is not in a graph
+ */
+static inline int ff_filter_get_nb_threads(AVFilterContext *ctx)
+{
+    if (ctx->graph && ctx->thread_type & AVFILTER_THREAD_SLICE)
+        return ctx->graph->nb_threads;
+    return 1;
+}
+
 #endif /* AVFILTER_INTERNAL_H */
@@ -0,0 +1,256 @@
+/*
+ * This file is part of Libav.
+ *
+ * Libav is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation; either
+ * version 2.1 of the License, or (at your option) any later version.
+ *
+ * Libav is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with Libav; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA
+ */
+
+/**
+ * @file
+ * Slice threading for filter graphs
+ *
+ * All filters of a graph share one set of worker threads. The thread calling
+ * execute() runs jobs as well, so a graph with nb_threads threads starts
+ * nb_threads - 1 workers.
+ */
+
+#include <stddef.h>
+
+#include "config.h"
+
+#include "libavutil/common.h"
+#include "libavutil/cpu.h"
+#include "libavutil/mem.h"
+
+#include "avfilter.h"
+#include "avfiltergraph.h"
+#include "internal.h"
+#include "thread.h"
+
+#if HAVE_PTHREADS
+#include <pthread.h>
+#elif HAVE_W32THREADS
+#include "libavcodec/w32pthreads.h"
+#endif
+
+/* Filters split frames into a handful of bands, more threads than this
+ * only add synchronization overhead */
+#define MAX_AUTO_THREADS 16
+
+typedef struct ThreadContext {
+    AVFilterGraph *graph;
+
+    int nb_threads;                 ///< worker threads plus the calling thread
+    pthread_t *workers;
+
+    /* parameters of the current execute() call */
+    avfilter_action_func *func;
+    AVFilterContext *ctx;
+    void *arg;
+    int *rets;
+    int nb_rets;
+    int nb_jobs;
+
+    int current_job;                ///< next job to hand out
+    int finished;                   ///< number of jobs completed
+    int busy;                       ///< set while an execute() call is in progress
+
+    pthread_cond_t current_job_cond; ///< signaled when jobs are submitted or the threads should exit
+    pthread_cond_t last_job_cond;   ///< signaled when the last job of a batch completes
+    pthread_mutex_t current_job_lock;
+    int done;
+} ThreadContext;
+
+/**
+ * Run the next job of the current batch. Must be called with
+ * current_job_lock held, returns with it held.
+ */
+static void run_job(ThreadContext *c)
+{
+    int jobnr = c->current_job++;
+
+    pthread_mutex_unlock(&c->current_job_lock);
+    c->rets[jobnr % c->nb_rets] = c->func(c->ctx, c->arg, jobnr, c->nb_jobs);
+    pthread_mutex_lock(&c->current_job_lock);
+
+    if (++c->finished == c->nb_jobs)
+        pthread_cond_signal(&c->last_job_cond);
+}
+
+static void* attribute_align_arg worker(void *v)
+{
+    ThreadContext *c = v;
+
+    pthread_mutex_lock(&c->current_job_lock);
+    for (;;) {
+        while (c->current_job >= c->nb_jobs && !c->done)
+            pthread_cond_wait(&c->current_job_cond, &c->current_job_lock);
+        if (c->done)
+            break;
+        run_job(c);
+    }
+    pthread_mutex_unlock(&c->current_job_lock);
+
+    return NULL;
+}
+
+static int thread_execute(AVFilterContext *ctx, avfilter_action_func *func,
+                          void *arg, int *ret, int nb_jobs)
+{
+    ThreadContext *c = ctx->graph->internal->thread;
+    int dummy_ret;
+
+    if (nb_jobs <= 0)
+        return 0;
+
+    pthread_mutex_lock(&c->current_job_lock);
+
+    /* Only one batch at a time. Other callers are jobs of the running batch,
+     * e.g. filters in branches running concurrently, or run alongside it, so
+     * all threads are busy anyway and waiting could deadlock. */
+    if (c->busy) {
+        int i;
+
+        pthread_mutex_unlock(&c->current_job_lock);
+        for (i = 0; i < nb_jobs; i++) {
+            int r = func(ctx, arg, i, nb_jobs);
+            if (ret)
+                ret[i] = r;
+        }
+        return 0;
+    }
+    c->busy = 1;
+
+    c->func    = func;
+    c->ctx     = ctx;
+    c->arg     = arg;
+    if (ret) {
+        c->rets    = ret;
+        c->nb_rets = nb_jobs;
+    } else {
+        c->rets    = &dummy_ret;
+        c->nb_rets = 1;
+    }
+    c->finished    = 0;
+    c->current_job = 0;
+    c->nb_jobs     = nb_jobs;
+
+    if (nb_jobs > 1)
+        pthread_cond_broadcast(&c->current_job_cond);
+
+    while (c->current_job < c->nb_jobs)
+        run_job(c);
+    while (c->finished < c->nb_jobs)
+        pthread_cond_wait(&c->last_job_cond, &c->current_job_lock);
+
+    c->busy = 0;
+    pthread_mutex_unlock(&c->current_job_lock);
+
+    return 0;
+}
+
+static void thread_uninit(ThreadContext *c)
+{
+    int i;
+
+    pthread_mutex_lock(&c->current_job_lock);
+    c->done = 1;
+    pthread_cond_broadcast(&c->current_job_cond);
+    pthread_mutex_unlock(&c->current_job_lock);
+
+    for (i = 0; i < c->nb_threads - 1; i++)
+        pthread_join(c->workers[i], NULL);
+
+    pthread_mutex_destroy(&c->current_job_lock);
+    pthread_cond_destroy(&c->current_job_cond);
+    pthread_cond_destroy(&c->last_job_cond);
+    av_freep(&c->workers);
+}
+
+static int thread_init(ThreadContext *c, int nb_threads)
+{
+    int i, ret;
+
+    if (!nb_threads) {
+        int nb_cpus = av_cpu_count();
+        av_log(c->graph, AV_LOG_DEBUG, "detected %d logical cores\n", nb_cpus);
+        nb_threads = av_clip(nb_cpus, 1, MAX_AUTO_THREADS);
+    }
+
+    if (nb_threads <= 1)
+        return 1;
+
+    c->workers = av_mallocz(sizeof(*c->workers) * (nb_threads - 1));
+    if (!c->workers)
+        return AVERROR(ENOMEM);
+
+    c->nb_threads  = 1;
+    c->current_job = 0;
+    c->nb_jobs     = 0;
+    c->done        = 0;
+
+    pthread_cond_init(&c->current_job_cond, NULL);
+    pthread_cond_init(&c->last_job_cond, NULL);
+    pthread_mutex_init(&c->current_job_lock, NULL);
+
+    for (i = 0; i < nb_threads - 1; i++) {
+        ret = pthread_create(&c->workers[i], NULL, worker, c);
+        if (ret) {
+            thread_uninit(c);
+            return AVERROR(ret);
+        }
+        c->nb_threads++;
+    }
+
+    return c->nb_threads;
+}
+
+int ff_graph_thread_init(AVFilterGraph *graph)
+{
+    int ret;
+
+#if HAVE_W32THREADS
+    w32thread_init();
+#endif
+
+    if (graph->nb_threads == 1) {
+        graph->thread_type = 0;
+        return 0;
+    }
+
+    graph->internal->thread = av_mallocz(sizeof(ThreadContext));
+    if (!graph->internal->thread)
+        return AVERROR(ENOMEM);
+    ((ThreadContext *)graph->internal->thread)->graph = graph;
+
+    ret = thread_init(graph->internal->thread, graph->nb_threads);
+    if (ret <= 1) {
+        av_freep(&graph->internal->thread);
+        graph->thread_type = 0;
+        graph->nb_threads  = 1;
+        return ret < 0 ? ret : 0;
+    }
+    graph->nb_threads = ret;
+
+    graph->internal->thread_execute = thread_execute;
+
+    return 0;
+}
+
+void ff_graph_thread_free(AVFilterGraph *graph)
+{
+    if (graph->internal->thread)
+        thread_uninit(graph->internal->thread);
+    av_freep(&graph->internal->thread);
+}
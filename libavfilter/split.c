@@ -32,8 +32,13 @@
 #include "internal.h"
 #include "video.h"
 
+typedef struct SplitContext {
+    AVFrame **frames;   ///< the frames sent on each output
+} SplitContext;
+
 static int split_init(AVFilterContext *ctx, const char *args)
 {
+    SplitContext *s = ctx->priv;
     int i, nb_outputs = 2;
 
     if (args) {
@@ -56,33 +61,42 @@ static int split_init(AVFilterContext *ctx, const char *args)
         ff_insert_outpad(ctx, i, &pad);
     }
 
+    s->frames = av_malloc(nb_outputs * sizeof(*s->frames));
+    if (!s->frames)
+        return AVERROR(ENOMEM);
+
     return 0;
 }
 
 static void split_uninit(AVFilterContext *ctx)
 {
+    SplitContext *s = ctx->priv;
     int i;
 
     for (i = 0; i < ctx->nb_outputs; i++)
         av_freep(&ctx->output_pads[i].name);
+    av_freep(&s->frames);
 }
 
 static int filter_frame(AVFilterLink *inlink, AVFrame *frame)
 {
     AVFilterContext *ctx = inlink->dst;
-    int i, ret = 0;
+    SplitContext *s = ctx->priv;
+    int i, ret;
 
     for (i = 0; i < ctx->nb_outputs; i++) {
-        AVFrame *buf_out = av_frame_clone(frame);
-        if (!buf_out) {
-            ret = AVERROR(ENOMEM);
-            break;
+        s->frames[i] = av_frame_clone(frame);
+        if (!s->frames[i]) {
+            while (i--)
+                av_frame_free(&s->frames[i]);
+            av_frame_free(&frame);
+            return AVERROR(ENOMEM);
         }
-
-        ret = ff_filter_frame(ctx->outputs[i], buf_out);
-        if (ret < 0)
-            break;
     }
+
+    // the branches may run concurrently, so keep our reference until all
+    // of them are done to not make the frame writable for one of them
+    ret = ff_filter_frame_outputs(ctx, s->frames);
     av_frame_free(&frame);
     return ret;
 }
@@ -101,8 +115,9 @@ AVFilter avfilter_vf_split = {
     .name      = "split",
     .description = NULL_IF_CONFIG_SMALL("Pass on the input to two outputs."),
 
-    .init   = split_init,
-    .uninit = split_uninit,
+    .priv_size = sizeof(SplitContext),
+    .init      = split_init,
+    .uninit    = split_uninit,
 
     .inputs    = avfilter_vf_split_inputs,
     .outputs   = NULL,
@@ -122,8 +137,9 @@ AVFilter avfilter_af_asplit = {
     .name        = "asplit",
     .description = NULL_IF_CONFIG_SMALL("Pass on the audio input to N audio outputs."),
 
-    .init   = split_init,
-    .uninit = split_uninit,
+    .priv_size = sizeof(SplitContext),
+    .init      = split_init,
+    .uninit    = split_uninit,
 
     .inputs  = avfilter_af_asplit_inputs,
     .outputs = NULL,
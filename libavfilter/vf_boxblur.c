@@ -70,7 +70,8 @@ typedef struct {
     int hsub, vsub;
     int radius[4];
     int power[4];
-    uint8_t *temp[2]; ///< temporary buffer used in blur_power()
+    int temp_size;    ///< size of the temporary buffers of one thread
+    uint8_t *temp[2]; ///< temporary buffers used in blur_power(), one pair per thread
 } BoxBlurContext;
 
 #define Y 0
@@ -150,9 +151,10 @@ static int config_input(AVFilterLink *inlink)
 
     av_freep(&boxblur->temp[0]);
     av_freep(&boxblur->temp[1]);
-    if (!(boxblur->temp[0] = av_malloc(FFMAX(w, h))))
+    boxblur->temp_size = FFMAX(w, h);
+    if (!(boxblur->temp[0] = av_malloc(boxblur->temp_size * ff_filter_get_nb_threads(ctx))))
        return AVERROR(ENOMEM);
-    if (!(boxblur->temp[1] = av_malloc(FFMAX(w, h)))) {
+    if (!(boxblur->temp[1] = av_malloc(boxblur->temp_size * ff_filter_get_nb_threads(ctx)))) {
         av_freep(&boxblur->temp[0]);
         return AVERROR(ENOMEM);
     }
@@ -281,30 +283,69 @@ static inline void blur_power(uint8_t *dst, int dst_step, const uint8_t *src, in
     }
 }
 
-static void hblur(uint8_t *dst, int dst_linesize, const uint8_t *src, int src_linesize,
-                  int w, int h, int radius, int power, uint8_t *temp[2])
-{
-    int y;
+typedef struct ThreadData {
+    AVFrame *in, *out;
+    int w[4], h[4];
+} ThreadData;
 
-    if (radius == 0 && dst == src)
-        return;
+/**
+ * Blur a band of rows of every plane horizontally, from in to out.
+ */
+static int hblur(AVFilterContext *ctx, void *arg, int jobnr, int nb_jobs)
+{
+    BoxBlurContext *boxblur = ctx->priv;
+    ThreadData *td = arg;
+    uint8_t *temp[2] = { boxblur->temp[0] + jobnr * boxblur->temp_size,
+                         boxblur->temp[1] + jobnr * boxblur->temp_size };
+    int plane, y;
+
+    for (plane = 0; td->in->data[plane] && plane < 4; plane++) {
+        int slice_start = (td->h[plane] *  jobnr   ) / nb_jobs;
+        int slice_end   = (td->h[plane] * (jobnr+1)) / nb_jobs;
+        uint8_t       *dst = td->out->data[plane];
+        const uint8_t *src = td->in ->data[plane];
+        int dst_linesize   = td->out->linesize[plane];
+        int src_linesize   = td->in ->linesize[plane];
+
+        if (boxblur->radius[plane] == 0 && dst == src)
+            continue;
+
+        for (y = slice_start; y < slice_end; y++)
+            blur_power(dst + y*dst_linesize, 1, src + y*src_linesize, 1,
+                       td->w[plane], boxblur->radius[plane],
+                       boxblur->power[plane], temp);
+    }
 
-    for (y = 0; y < h; y++)
-        blur_power(dst + y*dst_linesize, 1, src + y*src_linesize, 1,
-                   w, radius, power, temp);
+    return 0;
 }
 
-static void vblur(uint8_t *dst, int dst_linesize, const uint8_t *src, int src_linesize,
-                  int w, int h, int radius, int power, uint8_t *temp[2])
+/**
+ * Blur a band of columns of every plane vertically, in place in out.
+ */
+static int vblur(AVFilterContext *ctx, void *arg, int jobnr, int nb_jobs)
 {
-    int x;
-
-    if (radius == 0 && dst == src)
-        return;
+    BoxBlurContext *boxblur = ctx->priv;
+    ThreadData *td = arg;
+    uint8_t *temp[2] = { boxblur->temp[0] + jobnr * boxblur->temp_size,
+                         boxblur->temp[1] + jobnr * boxblur->temp_size };
+    int plane, x;
+
+    for (plane = 0; td->in->data[plane] && plane < 4; plane++) {
+        int slice_start = (td->w[plane] *  jobnr   ) / nb_jobs;
+        int slice_end   = (td->w[plane] * (jobnr+1)) / nb_jobs;
+        uint8_t *dst     = td->out->data[plane];
+        int dst_linesize = td->out->linesize[plane];
+
+        if (boxblur->radius[plane] == 0)
+            continue;
+
+        for (x = slice_start; x < slice_end; x++)
+            blur_power(dst + x, dst_linesize, dst + x, dst_linesize,
+                       td->h[plane], boxblur->radius[plane],
+                       boxblur->power[plane], temp);
+    }
 
-    for (x = 0; x < w; x++)
-        blur_power(dst + x, dst_linesize, src + x, src_linesize,
-                   h, radius, power, temp);
+    return 0;
 }
 
 static int filter_frame(AVFilterLink *inlink, AVFrame *in)
@@ -313,10 +354,11 @@ static int filter_frame(AVFilterLink *inlink, AVFrame *in)
     BoxBlurContext *boxblur = ctx->priv;
     AVFilterLink *outlink = inlink->dst->outputs[0];
     AVFrame *out;
-    int plane;
     int cw = inlink->w >> boxblur->hsub, ch = in->height >> boxblur->vsub;
-    int w[4] = { inlink->w, cw, cw, inlink->w };
-    int h[4] = { in->height, ch, ch, in->height };
+    ThreadData td = {
+        .w = { inlink->w, cw, cw, inlink->w },
+        .h = { in->height, ch, ch, in->height },
+    };
 
     out = ff_get_video_buffer(outlink, outlink->w, outlink->h);
     if (!out) {
@@ -325,17 +367,12 @@ static int filter_frame(AVFilterLink *inlink, AVFrame *in)
     }
     av_frame_copy_props(out, in);
 
-    for (plane = 0; in->data[plane] && plane < 4; plane++)
-        hblur(out->data[plane], out->linesize[plane],
-              in ->data[plane], in ->linesize[plane],
-              w[plane], h[plane], boxblur->radius[plane], boxblur->power[plane],
-              boxblur->temp);
+    td.in  = in;
+    td.out = out;
 
-    for (plane = 0; in->data[plane] && plane < 4; plane++)
-        vblur(out->data[plane], out->linesize[plane],
-              out->data[plane], out->linesize[plane],
-              w[plane], h[plane], boxblur->radius[plane], boxblur->power[plane],
-              boxblur->temp);
+    // vertical blurring needs the complete horizontal pass of its columns
+    ctx->internal->execute(ctx, hblur, &td, NULL, ff_filter_get_nb_threads(ctx));
+    ctx->internal->execute(ctx, vblur, &td, NULL, ff_filter_get_nb_threads(ctx));
 
     av_frame_free(&in);
 
@@ -370,4 +407,6 @@ AVFilter avfilter_vf_boxblur = {
 
     .inputs    = avfilter_vf_boxblur_inputs,
     .outputs   = avfilter_vf_boxblur_outputs,
+
+    .flags     = AVFILTER_FLAG_SLICE_THREADS,
 };
@@ -78,47 +78,91 @@ void ff_gradfun_blur_line_c(uint16_t *dc, uint16_t *buf, uint16_t *buf1, uint8_t
     }
 }
 
-static void filter(GradFunContext *ctx, uint8_t *dst, uint8_t *src, int width, int height, int dst_linesize, int src_linesize, int r)
+/**
+ * Compute the blurred, horizontally subsampled row dc used for rows y and
+ * y + 1. buf is a ring of r vertical running sums of 2x2 pixel blocks, the
+ * running sum for block row (y + r) / 2 is added to it first.
+ */
+static void blur_row(GradFunContext *ctx, uint16_t *dc, uint16_t *buf, int bstride,
+                     uint8_t *src, int src_linesize, int width, int r, int y,
+                     uint32_t dc_factor)
+{
+    int mod = ((y + r) / 2) % r;
+    uint16_t *buf0 = buf + mod * bstride;
+    uint16_t *buf1 = buf + (mod ? mod - 1 : r - 1) * bstride;
+    int x, v;
+
+    ctx->blur_line(dc, buf0, buf1, src + (y + r) * src_linesize, src_linesize, width / 2);
+    for (x = v = 0; x < r; x++)
+        v += dc[x];
+    for (; x < width / 2; x++) {
+        v += dc[x] - dc[x-r];
+        dc[x-r] = v * dc_factor >> 16;
+    }
+    for (; x < (width + r + 1) / 2; x++)
+        dc[x-r] = v * dc_factor >> 16;
+    for (x = -r / 2; x < 0; x++)
+        dc[x] = dc[0];
+}
+
+/**
+ * Filter rows slice_start to slice_end - 1 of a plane.
+ *
+ * The first r rows share the blurred row of row r, the last rows share the
+ * one of the last row that has r rows below it. The running sums only
+ * depend on the r block rows above, so any band can be started by summing
+ * those up first.
+ */
+static void filter(GradFunContext *ctx, uint16_t *buffer, uint8_t *dst, uint8_t *src,
+                   int width, int height, int dst_linesize, int src_linesize, int r,
+                   int slice_start, int slice_end)
 {
     int bstride = FFALIGN(width, 16) / 2;
-    int y;
+    int y, p;
     uint32_t dc_factor = (1 << 21) / (r * r);
-    uint16_t *dc = ctx->buf + 16;
-    uint16_t *buf = ctx->buf + bstride + 32;
+    uint16_t *dc = buffer + 16;
+    uint16_t *buf = buffer + bstride + 32;
     int thresh = ctx->thresh;
+    int last = (height - r - 1) & ~1;
+    int cur = av_clip(slice_start & ~1, r, last);
 
     memset(dc, 0, (bstride + 16) * sizeof(*buf));
-    for (y = 0; y < r; y++)
-        ctx->blur_line(dc, buf + y * bstride, buf + (y - 1) * bstride, src + 2 * y * src_linesize, src_linesize, width / 2);
-    for (;;) {
-        if (y < height - r) {
-            int mod = ((y + r) / 2) % r;
-            uint16_t *buf0 = buf + mod * bstride;
-            uint16_t *buf1 = buf + (mod ? mod - 1 : r - 1) * bstride;
-            int x, v;
-            ctx->blur_line(dc, buf0, buf1, src + (y + r) * src_linesize, src_linesize, width / 2);
-            for (x = v = 0; x < r; x++)
-                v += dc[x];
-            for (; x < width / 2; x++) {
-                v += dc[x] - dc[x-r];
-                dc[x-r] = v * dc_factor >> 16;
-            }
-            for (; x < (width + r + 1) / 2; x++)
-                dc[x-r] = v * dc_factor >> 16;
-            for (x = -r / 2; x < 0; x++)
-                dc[x] = dc[0];
+    p = (cur + r) / 2;
+    memset(buf + (p - 1) % r * bstride, 0, bstride * sizeof(*buf));
+    for (y = p - r; y < p; y++)
+        ctx->blur_line(dc, buf + y % r * bstride, buf + (y + r - 1) % r * bstride,
+                       src + 2 * y * src_linesize, src_linesize, width / 2);
+    blur_row(ctx, dc, buf, bstride, src, src_linesize, width, r, cur, dc_factor);
+
+    for (y = slice_start; y < slice_end; y++) {
+        if (av_clip(y & ~1, r, last) != cur) {
+            cur += 2;
+            blur_row(ctx, dc, buf, bstride, src, src_linesize, width, r, cur, dc_factor);
         }
-        if (y == r) {
-            for (y = 0; y < r; y++)
-                ctx->filter_line(dst + y * dst_linesize, src + y * src_linesize, dc - r / 2, width, thresh, dither[y & 7]);
-        }
-        ctx->filter_line(dst + y * dst_linesize, src + y * src_linesize, dc - r / 2, width, thresh, dither[y & 7]);
-        if (++y >= height) break;
         ctx->filter_line(dst + y * dst_linesize, src + y * src_linesize, dc - r / 2, width, thresh, dither[y & 7]);
-        if (++y >= height) break;
     }
 }
 
+typedef struct ThreadData {
+    uint8_t *dst, *src;
+    int width, height;
+    int dst_linesize, src_linesize;
+    int r;
+} ThreadData;
+
+static int filter_slice(AVFilterContext *ctx, void *arg, int jobnr, int nb_jobs)
+{
+    GradFunContext *gf = ctx->priv;
+    ThreadData *td = arg;
+
+    filter(gf, gf->buf + jobnr * gf->buf_size, td->dst, td->src,
+           td->width, td->height, td->dst_linesize, td->src_linesize, td->r,
+           (td->height *  jobnr   ) / nb_jobs,
+           (td->height * (jobnr+1)) / nb_jobs);
+
+    return 0;
+}
+
 static av_cold int init(AVFilterContext *ctx, const char *args)
 {
     GradFunContext *gf = ctx->priv;
@@ -166,12 +210,15 @@ static int query_formats(AVFilterContext *ctx)
 
 static int config_input(AVFilterLink *inlink)
 {
-    GradFunContext *gf = inlink->dst->priv;
+    AVFilterContext *ctx = inlink->dst;
+    GradFunContext *gf = ctx->priv;
     const AVPixFmtDescriptor *desc = av_pix_fmt_desc_get(inlink->format);
     int hsub = desc->log2_chroma_w;
     int vsub = desc->log2_chroma_h;
 
-    gf->buf = av_mallocz((FFALIGN(inlink->w, 16) * (gf->radius + 1) / 2 + 32) * sizeof(uint16_t));
+    av_freep(&gf->buf);
+    gf->buf_size = FFALIGN(inlink->w, 16) * (gf->radius + 1) / 2 + 32;
+    gf->buf = av_mallocz(gf->buf_size * ff_filter_get_nb_threads(ctx) * sizeof(uint16_t));
     if (!gf->buf)
         return AVERROR(ENOMEM);
 
@@ -184,12 +231,15 @@ static int config_input(AVFilterLink *inlink)
 
 static int filter_frame(AVFilterLink *inlink, AVFrame *in)
 {
-    GradFunContext *gf = inlink->dst->priv;
-    AVFilterLink *outlink = inlink->dst->outputs[0];
+    AVFilterContext *ctx = inlink->dst;
+    GradFunContext *gf = ctx->priv;
+    AVFilterLink *outlink = ctx->outputs[0];
     AVFrame *out;
-    int p, direct;
+    int p, direct = 0;
 
-    if (av_frame_is_writable(in)) {
+    /* the blur reads rows on both sides of a band, so bands running in
+     * parallel must not filter in place */
+    if (av_frame_is_writable(in) && ff_filter_get_nb_threads(ctx) == 1) {
         direct = 1;
         out = in;
     } else {
@@ -214,9 +264,20 @@ static int filter_frame(AVFilterLink *inlink, AVFrame *in)
             r = gf->chroma_r;
         }
 
-        if (FFMIN(w, h) > 2 * r)
-            filter(gf, out->data[p], in->data[p], w, h, out->linesize[p], in->linesize[p], r);
-        else if (out->data[p] != in->data[p])
+        if (FFMIN(w, h) > 2 * r) {
+            ThreadData td = {
+                .dst          = out->data[p],
+                .src          = in->data[p],
+                .width        = w,
+                .height       = h,
+                .dst_linesize = out->linesize[p],
+                .src_linesize = in->linesize[p],
+                .r            = r,
+            };
+            // every band sums up r block rows before its first row
+            ctx->internal->execute(ctx, filter_slice, &td, NULL,
+                                   FFMIN(h / r, ff_filter_get_nb_threads(ctx)));
+        } else if (out->data[p] != in->data[p])
             av_image_copy_plane(out->data[p], out->linesize[p], in->data[p], in->linesize[p], w, h);
     }
 
@@ -254,4 +315,6 @@ AVFilter avfilter_vf_gradfun = {
 
     .inputs    = avfilter_vf_gradfun_inputs,
     .outputs   = avfilter_vf_gradfun_outputs,
+
+    .flags     = AVFILTER_FLAG_SLICE_THREADS,
 };
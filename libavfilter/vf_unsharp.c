@@ -58,7 +58,7 @@ typedef struct FilterParam {
     int steps_y;                             ///< vertical step count
     int scalebits;                           ///< bits to shift pixel
     int32_t halfscale;                       ///< amount to add to pixel
-    uint32_t *sc[(MAX_SIZE * MAX_SIZE) - 1]; ///< finite state machine storage
+    uint32_t *sc;                            ///< finite state machine storage, one set per thread
 } FilterParam;
 
 typedef struct {
@@ -67,32 +67,55 @@ typedef struct {
     int hsub, vsub;
 } UnsharpContext;
 
-static void apply_unsharp(      uint8_t *dst, int dst_stride,
-                          const uint8_t *src, int src_stride,
-                          int width, int height, FilterParam *fp)
+typedef struct ThreadData {
+    FilterParam *fp;
+    uint8_t       *dst;
+    const uint8_t *src;
+    int dst_stride, src_stride;
+    int width, height;
+} ThreadData;
+
+/**
+ * Filter one horizontal band of a plane. The vertical state machine is a
+ * finite impulse response of 2 * steps_y + 1 rows, so starting it
+ * steps_y rows above the band gives the same output as filtering the
+ * whole plane in one go.
+ */
+static int apply_unsharp(AVFilterContext *ctx, void *arg, int jobnr, int nb_jobs)
 {
-    uint32_t **sc = fp->sc;
+    ThreadData *td  = arg;
+    FilterParam *fp = td->fp;
+    uint32_t *sc[(MAX_SIZE * MAX_SIZE) - 1];
     uint32_t sr[(MAX_SIZE * MAX_SIZE) - 1], tmp1, tmp2;
+    int width      = td->width;
+    int height     = td->height;
+    int sc_stride  = width + 2 * fp->steps_x;
+    int slice_start = (height *  jobnr   ) / nb_jobs;
+    int slice_end   = (height * (jobnr+1)) / nb_jobs;
 
     int32_t res;
     int x, y, z;
     const uint8_t *src2;
 
     if (!fp->amount) {
-        if (dst_stride == src_stride)
-            memcpy(dst, src, src_stride * height);
+        const uint8_t *src = td->src + slice_start * td->src_stride;
+        uint8_t       *dst = td->dst + slice_start * td->dst_stride;
+
+        if (td->dst_stride == td->src_stride)
+            memcpy(dst, src, td->src_stride * (slice_end - slice_start));
         else
-            for (y = 0; y < height; y++, dst += dst_stride, src += src_stride)
+            for (y = slice_start; y < slice_end; y++, dst += td->dst_stride, src += td->src_stride)
                 memcpy(dst, src, width);
-        return;
+        return 0;
     }
 
-    for (y = 0; y < 2 * fp->steps_y; y++)
-        memset(sc[y], 0, sizeof(sc[y][0]) * (width + 2 * fp->steps_x));
+    for (z = 0; z < 2 * fp->steps_y; z++) {
+        sc[z] = fp->sc + (jobnr * 2 * fp->steps_y + z) * sc_stride;
+        memset(sc[z], 0, sizeof(sc[z][0]) * sc_stride);
+    }
 
-    for (y = -fp->steps_y; y < height + fp->steps_y; y++) {
-        if (y < height)
-            src2 = src;
+    for (y = slice_start - fp->steps_y; y < slice_end + fp->steps_y; y++) {
+        src2 = td->src + av_clip(y, 0, height - 1) * td->src_stride;
 
         memset(sr, 0, sizeof(sr[0]) * (2 * fp->steps_x - 1));
         for (x = -fp->steps_x; x < width + fp->steps_x; x++) {
@@ -105,19 +128,17 @@ static void apply_unsharp(      uint8_t *dst, int dst_stride,
                 tmp2 = sc[z + 0][x + fp->steps_x] + tmp1; sc[z + 0][x + fp->steps_x] = tmp1;
                 tmp1 = sc[z + 1][x + fp->steps_x] + tmp2; sc[z + 1][x + fp->steps_x] = tmp2;
             }
-            if (x >= fp->steps_x && y >= fp->steps_y) {
-                const uint8_t *srx = src - fp->steps_y * src_stride + x - fp->steps_x;
-                uint8_t *dsx       = dst - fp->steps_y * dst_stride + x - fp->steps_x;
+            if (x >= fp->steps_x && y >= slice_start + fp->steps_y) {
+                const uint8_t *srx = td->src + (y - fp->steps_y) * td->src_stride + x - fp->steps_x;
+                uint8_t *dsx       = td->dst + (y - fp->steps_y) * td->dst_stride + x - fp->steps_x;
 
                 res = (int32_t)*srx + ((((int32_t) * srx - (int32_t)((tmp1 + fp->halfscale) >> fp->scalebits)) * fp->amount) >> 16);
                 *dsx = av_clip_uint8(res);
             }
         }
-        if (y >= 0) {
-            dst += dst_stride;
-            src += src_stride;
-        }
     }
+
+    return 0;
 }
 
 static void set_filter_param(FilterParam *fp, int msize_x, int msize_y, double amount)
@@ -170,9 +191,8 @@ static int query_formats(AVFilterContext *ctx)
     return 0;
 }
 
-static void init_filter_param(AVFilterContext *ctx, FilterParam *fp, const char *effect_type, int width)
+static int init_filter_param(AVFilterContext *ctx, FilterParam *fp, const char *effect_type, int width)
 {
-    int z;
     const char *effect;
 
     effect = fp->amount == 0 ? "none" : fp->amount < 0 ? "blur" : "sharpen";
@@ -180,30 +200,38 @@ static void init_filter_param(AVFilterContext *ctx, FilterParam *fp, const char
     av_log(ctx, AV_LOG_VERBOSE, "effect:%s type:%s msize_x:%d msize_y:%d amount:%0.2f\n",
            effect, effect_type, fp->msize_x, fp->msize_y, fp->amount / 65535.0);
 
-    for (z = 0; z < 2 * fp->steps_y; z++)
-        fp->sc[z] = av_malloc(sizeof(*(fp->sc[z])) * (width + 2 * fp->steps_x));
+    if (fp->amount && fp->steps_y) {
+        fp->sc = av_malloc(sizeof(*fp->sc) * ff_filter_get_nb_threads(ctx) *
+                           2 * fp->steps_y * (width + 2 * fp->steps_x));
+        if (!fp->sc)
+            return AVERROR(ENOMEM);
+    }
+
+    return 0;
 }
 
 static int config_props(AVFilterLink *link)
 {
     UnsharpContext *unsharp = link->dst->priv;
     const AVPixFmtDescriptor *desc = av_pix_fmt_desc_get(link->format);
+    int ret;
 
     unsharp->hsub = desc->log2_chroma_w;
     unsharp->vsub = desc->log2_chroma_h;
 
-    init_filter_param(link->dst, &unsharp->luma,   "luma",   link->w);
-    init_filter_param(link->dst, &unsharp->chroma, "chroma", SHIFTUP(link->w, unsharp->hsub));
+    ret = init_filter_param(link->dst, &unsharp->luma,   "luma",   link->w);
+    if (ret < 0)
+        return ret;
+    ret = init_filter_param(link->dst, &unsharp->chroma, "chroma", SHIFTUP(link->w, unsharp->hsub));
+    if (ret < 0)
+        return ret;
 
     return 0;
 }
 
 static void free_filter_param(FilterParam *fp)
 {
-    int z;
-
-    for (z = 0; z < 2 * fp->steps_y; z++)
-        av_free(fp->sc[z]);
+    av_freep(&fp->sc);
 }
 
 static av_cold void uninit(AVFilterContext *ctx)
@@ -216,11 +244,14 @@ static av_cold void uninit(AVFilterContext *ctx)
 
 static int filter_frame(AVFilterLink *link, AVFrame *in)
 {
-    UnsharpContext *unsharp = link->dst->priv;
-    AVFilterLink *outlink   = link->dst->outputs[0];
+    AVFilterContext *ctx    = link->dst;
+    UnsharpContext *unsharp = ctx->priv;
+    AVFilterLink *outlink   = ctx->outputs[0];
     AVFrame *out;
     int cw = SHIFTUP(link->w, unsharp->hsub);
     int ch = SHIFTUP(link->h, unsharp->vsub);
+    int nb_threads = ff_filter_get_nb_threads(ctx);
+    int plane;
 
     out = ff_get_video_buffer(outlink, outlink->w, outlink->h);
     if (!out) {
@@ -229,9 +260,19 @@ static int filter_frame(AVFilterLink *link, AVFrame *in)
     }
     av_frame_copy_props(out, in);
 
-    apply_unsharp(out->data[0], out->linesize[0], in->data[0], in->linesize[0], link->w, link->h, &unsharp->luma);
-    apply_unsharp(out->data[1], out->linesize[1], in->data[1], in->linesize[1], cw,      ch,      &unsharp->chroma);
-    apply_unsharp(out->data[2], out->linesize[2], in->data[2], in->linesize[2], cw,      ch,      &unsharp->chroma);
+    for (plane = 0; plane < 3; plane++) {
+        ThreadData td = {
+            .fp         = plane ? &unsharp->chroma : &unsharp->luma,
+            .dst        = out->data[plane],
+            .src        = in->data[plane],
+            .dst_stride = out->linesize[plane],
+            .src_stride = in->linesize[plane],
+            .width      = plane ? cw : link->w,
+            .height     = plane ? ch : link->h,
+        };
+        ctx->internal->execute(ctx, apply_unsharp, &td, NULL,
+                               FFMIN(td.height, nb_threads));
+    }
 
     av_frame_free(&in);
     return ff_filter_frame(outlink, out);
@@ -268,4 +309,6 @@ AVFilter avfilter_vf_unsharp = {
     .inputs    = avfilter_vf_unsharp_inputs,
 
     .outputs   = avfilter_vf_unsharp_outputs,
+
+    .flags     = AVFILTER_FLAG_SLICE_THREADS,
 };
@@ -165,18 +165,75 @@ static void filter_edges_16bit(void *dst1, void *prev1, void *cur1, void *next1,
     FILTER(w - 3, w)
 }
 
+typedef struct ThreadData {
+    AVFrame *frame;
+    int plane;
+    int w, h;
+    int parity;
+    int tff;
+} ThreadData;
+
+static int filter_slice(AVFilterContext *ctx, void *arg, int jobnr, int nb_jobs)
+{
+    YADIFContext *yadif = ctx->priv;
+    ThreadData *td  = arg;
+    int refs = yadif->cur->linesize[td->plane];
+    int df = (yadif->csp->comp[td->plane].depth_minus1 + 8) / 8;
+    int slice_start = (td->h *  jobnr   ) / nb_jobs;
+    int slice_end   = (td->h * (jobnr+1)) / nb_jobs;
+    int l_edge, l_edge_pix;
+    int y;
+
+    /* filtering reads 3 pixels to the left/right; to avoid invalid reads,
+     * we need to call the c variant which avoids this for border pixels
+     */
+    l_edge     = yadif->req_align;
+    l_edge_pix = l_edge / df;
+
+    for (y = slice_start; y < slice_end; y++) {
+        if ((y ^ td->parity) & 1) {
+            uint8_t *prev = &yadif->prev->data[td->plane][y * refs];
+            uint8_t *cur  = &yadif->cur ->data[td->plane][y * refs];
+            uint8_t *next = &yadif->next->data[td->plane][y * refs];
+            uint8_t *dst  = &td->frame->data[td->plane][y * td->frame->linesize[td->plane]];
+            int     mode  = y == 1 || y + 2 == td->h ? 2 : yadif->mode;
+            if (yadif->req_align) {
+                yadif->filter_line(dst + l_edge, prev + l_edge, cur + l_edge,
+                                   next + l_edge, td->w - l_edge_pix - 3,
+                                   y + 1 < td->h ? refs : -refs,
+                                   y ? -refs : refs,
+                                   td->parity ^ td->tff, mode);
+                yadif->filter_edges(dst, prev, cur, next, td->w,
+                                     y + 1 < td->h ? refs : -refs,
+                                     y ? -refs : refs,
+                                     td->parity ^ td->tff, mode, l_edge_pix);
+            } else {
+                yadif->filter_line(dst, prev, cur, next + l_edge, td->w,
+                                   y + 1 < td->h ? refs : -refs,
+                                   y ? -refs : refs,
+                                   td->parity ^ td->tff, mode);
+            }
+        } else {
+            memcpy(&td->frame->data[td->plane][y * td->frame->linesize[td->plane]],
+                   &yadif->cur->data[td->plane][y * refs], td->w * df);
+        }
+    }
+
+    emms_c();
+
+    return 0;
+}
+
 static void filter(AVFilterContext *ctx, AVFrame *dstpic,
                    int parity, int tff)
 {
     YADIFContext *yadif = ctx->priv;
-    int y, i;
+    ThreadData td = { .frame = dstpic, .parity = parity, .tff = tff };
+    int i;
 
     for (i = 0; i < yadif->csp->nb_components; i++) {
         int w = dstpic->width;
         int h = dstpic->height;
-        int refs = yadif->cur->linesize[i];
-        int df = (yadif->csp->comp[i].depth_minus1 + 8) / 8;
-        int l_edge, l_edge_pix;
 
         if (i == 1 || i == 2) {
         /* Why is this not part of the per-plane description thing? */
@@ -184,43 +241,13 @@ static void filter(AVFilterContext *ctx, AVFrame *dstpic,
             h >>= yadif->csp->log2_chroma_h;
         }
 
-        /* filtering reads 3 pixels to the left/right; to avoid invalid reads,
-         * we need to call the c variant which avoids this for border pixels
-         */
-        l_edge     = yadif->req_align;
-        l_edge_pix = l_edge / df;
-
-        for (y = 0; y < h; y++) {
-            if ((y ^ parity) & 1) {
-                uint8_t *prev = &yadif->prev->data[i][y * refs];
-                uint8_t *cur  = &yadif->cur ->data[i][y * refs];
-                uint8_t *next = &yadif->next->data[i][y * refs];
-                uint8_t *dst  = &dstpic->data[i][y * dstpic->linesize[i]];
-                int     mode  = y == 1 || y + 2 == h ? 2 : yadif->mode;
-                if (yadif->req_align) {
-                    yadif->filter_line(dst + l_edge, prev + l_edge, cur + l_edge,
-                                       next + l_edge, w - l_edge_pix - 3,
-                                       y + 1 < h ? refs : -refs,
-                                       y ? -refs : refs,
-                                       parity ^ tff, mode);
-                    yadif->filter_edges(dst, prev, cur, next, w,
-                                         y + 1 < h ? refs : -refs,
-                                         y ? -refs : refs,
-                                         parity ^ tff, mode, l_edge_pix);
-                } else {
-                    yadif->filter_line(dst, prev, cur, next + l_edge, w,
-                                       y + 1 < h ? refs : -refs,
-                                       y ? -refs : refs,
-                                       parity ^ tff, mode);
-                }
-            } else {
-                memcpy(&dstpic->data[i][y * dstpic->linesize[i]],
-                       &yadif->cur->data[i][y * refs], w * df);
-            }
-        }
-    }
+        td.w     = w;
+        td.h     = h;
+        td.plane = i;
 
-    emms_c();
+        ctx->internal->execute(ctx, filter_slice, &td, NULL,
+                               FFMIN(h, ff_filter_get_nb_threads(ctx)));
+    }
 }
 
 static AVFrame *get_video_buffer(AVFilterLink *link, int w, int h)
@@ -504,4 +531,6 @@ AVFilter avfilter_vf_yadif = {
     .inputs    = avfilter_vf_yadif_inputs,
 
     .outputs   = avfilter_vf_yadif_outputs,
+
+    .flags     = AVFILTER_FLAG_SLICE_THREADS,
 };
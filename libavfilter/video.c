@@ -24,6 +24,7 @@
 #include "libavutil/mem.h"
 
 #include "avfilter.h"
+#include "framepool.h"
 #include "internal.h"
 #include "video.h"
 
@@ -32,9 +33,6 @@ AVFrame *ff_null_get_video_buffer(AVFilterLink *link, int w, int h)
     return ff_get_video_buffer(link->dst->outputs[0], w, h);
 }
 
-/* TODO: set the buffer's priv member to a context structure for the whole
- * filter chain.  This will allow for a buffer pool instead of the constant
- * alloc & free cycle currently implemented. */
 AVFrame *ff_default_get_video_buffer(AVFilterLink *link, int w, int h)
 {
     AVFrame *frame = av_frame_alloc();
@@ -47,7 +45,7 @@ AVFrame *ff_default_get_video_buffer(AVFilterLink *link, int w, int h)
     frame->height = h;
     frame->format = link->format;
 
-    ret = av_frame_get_buffer(frame, 32);
+    ret = ff_frame_pool_get_video_buffer(&link->frame_pool, frame, 32);
     if (ret < 0)
         av_frame_free(&frame);
 
@@ -0,0 +1,440 @@
+/*
+ * Asynchronous read-ahead protocol
+ *
+ * This file is part of Libav.
+ *
+ * Libav is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation; either
+ * version 2.1 of the License, or (at your option) any later version.
+ *
+ * Libav is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with Libav; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA
+ */
+
+/**
+ * @file
+ * Asynchronous read-ahead protocol: a thread reads the nested URL into a
+ * ring buffer ahead of the caller, so that network or disk stalls do not
+ * block the demuxer. Seeks inside the buffered window are served from the
+ * buffer, other seeks interrupt the pending read of the nested URL.
+ */
+
+#include "config.h"
+
+#if HAVE_PTHREADS
+#include <pthread.h>
+#elif HAVE_W32THREADS
+#include "libavcodec/w32pthreads.h"
+#endif
+
+#include "libavutil/avstring.h"
+#include "libavutil/common.h"
+#include "libavutil/mem.h"
+#include "libavutil/opt.h"
+#include "avformat.h"
+#include "url.h"
+
+/* largest single read from the nested URL */
+#define READ_CHUNK_SIZE (64 * 1024)
+
+typedef struct AsyncContext {
+    const AVClass *class;
+    URLContext *inner;
+    int buffer_size;
+    int64_t file_size;          ///< size of the nested URL, or < 0
+
+    uint8_t *buf;               ///< ring buffer, byte pos is at pos % buffer_size
+    int back_size;              ///< already read bytes kept for backward seeks
+
+    /* all of the following is protected by mutex */
+    int64_t buf_start;          ///< position of the oldest byte in buf
+    int64_t buf_end;            ///< position after the newest byte in buf
+    int64_t read_pos;           ///< position of the caller
+    int eof;
+    int error;                  ///< sticky error of the nested URL
+
+    int seek_request;
+    int64_t seek_pos;
+    int64_t seek_ret;
+    int seek_done;
+
+    int abort_request;
+    pthread_t thread;
+    pthread_mutex_t mutex;
+    pthread_cond_t cond;        ///< signaled whenever any of the above changes
+} AsyncContext;
+
+/**
+ * Interrupt callback of the nested URL: pending reads are abandoned as soon
+ * as the caller seeks out of the buffer or closes the protocol.
+ */
+static int async_check_interrupt(void *arg)
+{
+    URLContext *h   = arg;
+    AsyncContext *c = h->priv_data;
+    int ret;
+
+    pthread_mutex_lock(&c->mutex);
+    ret = c->abort_request || c->seek_request;
+    pthread_mutex_unlock(&c->mutex);
+
+    return ret || ff_check_interrupt(&h->interrupt_callback);
+}
+
+static void *async_thread(void *arg)
+{
+    URLContext *h   = arg;
+    AsyncContext *c = h->priv_data;
+
+    pthread_mutex_lock(&c->mutex);
+    while (!c->abort_request) {
+        int64_t keep_start, pos;
+        int size, ret;
+
+        if (c->seek_request) {
+            int64_t seek_pos = c->seek_pos;
+
+            c->seek_request = 0;
+            pthread_mutex_unlock(&c->mutex);
+            ret = ffurl_seek(c->inner, seek_pos, SEEK_SET);
+            pthread_mutex_lock(&c->mutex);
+
+            c->seek_ret  = ret;
+            c->seek_done = 1;
+            if (ret >= 0) {
+                c->buf_start = c->buf_end = c->read_pos = ret;
+                c->eof       = 0;
+                c->error     = 0;
+            }
+            pthread_cond_broadcast(&c->cond);
+            continue;
+        }
+
+        /* keep back_size bytes behind the caller, refill the rest */
+        keep_start = FFMAX(c->buf_start, c->read_pos - c->back_size);
+        size       = c->buffer_size - (c->buf_end - keep_start);
+        if (c->eof || c->error || size <= 0) {
+            pthread_cond_wait(&c->cond, &c->mutex);
+            continue;
+        }
+        pos  = c->buf_end;
+        size = FFMIN(size, c->buffer_size - pos % c->buffer_size);
+        size = FFMIN(size, READ_CHUNK_SIZE);
+        /* the area about to be overwritten may not be seeked to anymore */
+        c->buf_start = FFMAX(c->buf_start, pos + size - c->buffer_size);
+
+        pthread_mutex_unlock(&c->mutex);
+        ret = ffurl_read(c->inner, c->buf + pos % c->buffer_size, size);
+        pthread_mutex_lock(&c->mutex);
+
+        /* the data is useless if the caller seeked away in the meantime */
+        if (c->seek_request)
+            continue;
+        if (ret > 0)
+            c->buf_end += ret;
+        else if (!ret || ret == AVERROR_EOF)
+            c->eof = 1;
+        else
+            c->error = ret;
+        pthread_cond_broadcast(&c->cond);
+    }
+    pthread_mutex_unlock(&c->mutex);
+
+    return NULL;
+}
+
+static int async_open(URLContext *h, const char *uri, int flags,
+                      AVDictionary **options)
+{
+    AsyncContext *c = h->priv_data;
+    AVIOInterruptCB cb = { async_check_interrupt, h };
+    const char *nested_url;
+    int ret;
+
+    if (!av_strstart(uri, "async:", &nested_url)) {
+        av_log(h, AV_LOG_ERROR, "Unsupported url %s\n", uri);
+        return AVERROR(EINVAL);
+    }
+    if (flags & AVIO_FLAG_WRITE) {
+        av_log(h, AV_LOG_ERROR, "Only reading is supported\n");
+        return AVERROR(ENOSYS);
+    }
+
+    /* the interrupt callback of the nested URL uses the mutex */
+    if ((ret = pthread_mutex_init(&c->mutex, NULL)))
+        return AVERROR(ret);
+    if ((ret = pthread_cond_init(&c->cond, NULL))) {
+        pthread_mutex_destroy(&c->mutex);
+        return AVERROR(ret);
+    }
+
+    if ((ret = ffurl_open(&c->inner, nested_url, AVIO_FLAG_READ, &cb,
+                          options)) < 0)
+        goto fail;
+
+    c->file_size   = ffurl_size(c->inner);
+    h->is_streamed = c->inner->is_streamed;
+
+    c->back_size = c->buffer_size / 4;
+    if (!(c->buf = av_malloc(c->buffer_size))) {
+        ret = AVERROR(ENOMEM);
+        goto fail;
+    }
+
+    if ((ret = pthread_create(&c->thread, NULL, async_thread, h))) {
+        ret = AVERROR(ret);
+        goto fail;
+    }
+    return 0;
+
+fail:
+    ffurl_close(c->inner);
+    c->inner = NULL;
+    av_freep(&c->buf);
+    pthread_cond_destroy(&c->cond);
+    pthread_mutex_destroy(&c->mutex);
+    return ret;
+}
+
+static int async_read(URLContext *h, unsigned char *buf, int size)
+{
+    AsyncContext *c = h->priv_data;
+    int ret;
+
+    pthread_mutex_lock(&c->mutex);
+    for (;;) {
+        int64_t avail = c->buf_end - c->read_pos;
+
+        if (avail > 0) {
+            int offset = c->read_pos % c->buffer_size;
+
+            size = FFMIN(size, avail);
+            size = FFMIN(size, c->buffer_size - offset);
+            memcpy(buf, c->buf + offset, size);
+            c->read_pos += size;
+            pthread_cond_broadcast(&c->cond);
+            ret = size;
+            break;
+        }
+        if (c->error) {
+            ret = c->error;
+            break;
+        }
+        if (c->eof) {
+            ret = AVERROR_EOF;
+            break;
+        }
+        if (h->flags & AVIO_FLAG_NONBLOCK) {
+            ret = AVERROR(EAGAIN);
+            break;
+        }
+        pthread_cond_wait(&c->cond, &c->mutex);
+    }
+    pthread_mutex_unlock(&c->mutex);
+
+    return ret;
+}
+
+static int64_t async_seek(URLContext *h, int64_t pos, int whence)
+{
+    AsyncContext *c = h->priv_data;
+    int64_t ret;
+
+    if (whence == AVSEEK_SIZE)
+        return c->file_size >= 0 ? c->file_size : AVERROR(ENOSYS);
+
+    pthread_mutex_lock(&c->mutex);
+    if (whence == SEEK_CUR) {
+        pos += c->read_pos;
+    } else if (whence == SEEK_END) {
+        if (c->file_size < 0) {
+            pthread_mutex_unlock(&c->mutex);
+            return AVERROR(ENOSYS);
+        }
+        pos += c->file_size;
+    } else if (whence != SEEK_SET) {
+        pthread_mutex_unlock(&c->mutex);
+        return AVERROR(EINVAL);
+    }
+
+    if (pos >= c->buf_start && pos <= c->buf_end) {
+        c->read_pos = pos;
+        pthread_cond_broadcast(&c->cond);
+        pthread_mutex_unlock(&c->mutex);
+        return pos;
+    }
+    if (h->is_streamed) {
+        pthread_mutex_unlock(&c->mutex);
+        return AVERROR(ENOSYS);
+    }
+
+    c->seek_request = 1;
+    c->seek_pos     = pos;
+    c->seek_done    = 0;
+    pthread_cond_broadcast(&c->cond);
+    while (!c->seek_done)
+        pthread_cond_wait(&c->cond, &c->mutex);
+    ret = c->seek_ret;
+    pthread_mutex_unlock(&c->mutex);
+
+    return ret;
+}
+
+static int async_close(URLContext *h)
+{
+    AsyncContext *c = h->priv_data;
+
+    pthread_mutex_lock(&c->mutex);
+    c->abort_request = 1;
+    pthread_cond_broadcast(&c->cond);
+    pthread_mutex_unlock(&c->mutex);
+    pthread_join(c->thread, NULL);
+
+    ffurl_close(c->inner);
+    av_freep(&c->buf);
+    pthread_cond_destroy(&c->cond);
+    pthread_mutex_destroy(&c->mutex);
+    return 0;
+}
+
+#define OFFSET(x) offsetof(AsyncContext, x)
+#define D AV_OPT_FLAG_DECODING_PARAM
+static const AVOption options[] = {
+    { "async_buffer_size", "Size of the read-ahead buffer in bytes, a quarter of it is kept for backward seeks",
+        OFFSET(buffer_size), AV_OPT_TYPE_INT, { .i64 = 4 * 1024 * 1024 }, 64 * 1024, INT_MAX / 2, D },
+    { NULL }
+};
+
+static const AVClass async_class = {
+    .class_name = "async",
+    .item_name  = av_default_item_name,
+    .option     = options,
+    .version    = LIBAVUTIL_VERSION_INT,
+};
+
+URLProtocol ff_async_protocol = {
+    .name            = "async",
+    .url_open2       = async_open,
+    .url_read        = async_read,
+    .url_seek        = async_seek,
+    .url_close       = async_close,
+    .priv_data_size  = sizeof(AsyncContext),
+    .priv_data_class = &async_class,
+};
+
+#ifdef TEST
+
+#include "libavutil/dict.h"
+
+#define TEST_SIZE (1024 * 1024)
+
+typedef struct TestContext {
+    int64_t pos;
+} TestContext;
+
+static uint8_t test_byte(int64_t pos)
+{
+    return (pos * 2654435761U) >> 24;
+}
+
+static int test_open(URLContext *h, const char *uri, int flags)
+{
+    return 0;
+}
+
+static int test_read(URLContext *h, unsigned char *buf, int size)
+{
+    TestContext *c = h->priv_data;
+    int i;
+
+    if (c->pos >= TEST_SIZE)
+        return AVERROR_EOF;
+    size = FFMIN(size, TEST_SIZE - c->pos);
+    for (i = 0; i < size; i++)
+        buf[i] = test_byte(c->pos + i);
+    c->pos += size;
+    return size;
+}
+
+static int64_t test_seek(URLContext *h, int64_t pos, int whence)
+{
+    TestContext *c = h->priv_data;
+
+    if (whence == AVSEEK_SIZE)
+        return TEST_SIZE;
+    if (whence != SEEK_SET || pos < 0 || pos > TEST_SIZE)
+        return AVERROR(EINVAL);
+    return c->pos = pos;
+}
+
+static URLProtocol test_protocol = {
+    .name           = "asynctest",
+    .url_open       = test_open,
+    .url_read       = test_read,
+    .url_seek       = test_seek,
+    .priv_data_size = sizeof(TestContext),
+};
+
+static int check_read(AVIOContext *pb, int size)
+{
+    uint8_t buf[4096];
+    int64_t pos = avio_tell(pb);
+    int i, len, total = 0, errors = 0;
+
+    while (total < size) {
+        len = avio_read(pb, buf, FFMIN(size - total, sizeof(buf)));
+        if (len <= 0)
+            break;
+        for (i = 0; i < len; i++)
+            errors += buf[i] != test_byte(pos + total + i);
+        total += len;
+    }
+    printf("read %d bytes at %"PRId64", %d errors\n", total, pos, errors);
+    return errors;
+}
+
+int main(void)
+{
+    static const int64_t seeks[] = {
+        512 * 1024 - 100,       // backward, inside the kept window
+        600 * 1024,             // forward, outside of the buffer
+        100,                    // backward, outside of the buffer
+        TEST_SIZE - 1000,       // close to the end
+        TEST_SIZE - 20000,      // backward after EOF
+    };
+    AVDictionary *opts = NULL;
+    AVIOContext *pb;
+    int i, ret;
+
+    av_register_all();
+    ffurl_register_protocol(&test_protocol, sizeof(test_protocol));
+
+    /* a small buffer to wrap around it many times */
+    av_dict_set(&opts, "async_buffer_size", "65536", 0);
+    ret = avio_open2(&pb, "async:asynctest:", AVIO_FLAG_READ, NULL, &opts);
+    av_dict_free(&opts);
+    if (ret < 0) {
+        fprintf(stderr, "Failed to open the test URL\n");
+        return 1;
+    }
+
+    printf("size %"PRId64"\n", avio_size(pb));
+    ret = check_read(pb, 512 * 1024);
+    for (i = 0; i < FF_ARRAY_ELEMS(seeks); i++) {
+        printf("seek to %"PRId64": %"PRId64"\n", seeks[i],
+               avio_seek(pb, seeks[i], SEEK_SET));
+        ret |= check_read(pb, 32 * 1024);
+    }
+
+    avio_close(pb);
+    return !!ret;
+}
+
+#endif /* TEST */
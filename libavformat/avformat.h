@@ -773,8 +773,10 @@ typedef struct AVStream {
     struct AVCodecParserContext *parser;
 
     /**
-     * last packet in packet_buffer for this stream when muxing.
+     * first and last packet in the interleaving queue of this stream when
+     * muxing.
      */
+    struct AVPacketList *first_in_packet_buffer;
     struct AVPacketList *last_in_packet_buffer;
     AVProbeData probe_data;
 #define MAX_REORDER_DELAY 16
@@ -784,6 +786,12 @@ typedef struct AVStream {
                                     support seeking natively. */
     int nb_index_entries;
     unsigned int index_entries_allocated_size;
+
+    /**
+     * Set by demuxers keeping a compact index of their own, called to fill
+     * index_entries the first time they are needed.
+     */
+    int (*build_index)(struct AVStream *st);
 } AVStream;
 
 #define AV_PROGRAM_RUNNING 1
@@ -1042,6 +1050,19 @@ typedef struct AVFormatContext {
      */
 #define RAW_PACKET_BUFFER_SIZE 2500000
     int raw_packet_buffer_remaining_size;
+
+    /**
+     * Muxing: indexes of the streams with queued packets, as a binary heap
+     * ordered by their first queued packet according to interleave_compare.
+     */
+    int *interleave_heap;
+    int nb_interleave_heap;
+    unsigned int interleave_heap_size;
+    int (*interleave_compare)(struct AVFormatContext *, AVPacket *, AVPacket *);
+    /**
+     * Muxing: unused AVPacketList nodes, reused for queueing packets.
+     */
+    struct AVPacketList *packet_pool;
 } AVFormatContext;
 
 typedef struct AVPacketList {
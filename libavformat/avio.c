@@ -345,6 +345,13 @@ int ffurl_get_file_handle(URLContext *h)
     return h->prot->url_get_file_handle(h);
 }
 
+int64_t ffurl_get_mapping(URLContext *h, AVBufferRef **buf)
+{
+    if (!h->prot->url_get_mapping)
+        return AVERROR(ENOSYS);
+    return h->prot->url_get_mapping(h, buf);
+}
+
 int ffurl_get_multi_file_handle(URLContext *h, int **handles, int *numhandles)
 {
     if (!h->prot->url_get_multi_file_handle) {
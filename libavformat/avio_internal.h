@@ -45,6 +45,21 @@ int ffio_init_context(AVIOContext *s,
  */
 int ffio_read_partial(AVIOContext *s, unsigned char *buf, int size);
 
+/**
+ * Read size bytes from AVIOContext, returning a pointer to them.
+ * If the data is already in the IO buffer, no copy is done and the returned
+ * pointer points into it, otherwise the data is read into buf.
+ * The returned data is only valid until the next call using the same
+ * IO context.
+ *
+ * @param buf buffer of at least size bytes, used if the data cannot be
+ *            returned directly
+ * @param data set to the location of the data read
+ * @return number of bytes read or AVERROR
+ */
+int ffio_read_indirect(AVIOContext *s, unsigned char *buf, int size,
+                       const unsigned char **data);
+
 void ffio_fill(AVIOContext *s, int b, int count);
 
 static av_always_inline void ffio_wfourcc(AVIOContext *pb, const uint8_t *s)
@@ -89,6 +104,27 @@ unsigned long ff_crc04C11DB7_update(unsigned long checksum, const uint8_t *buf,
  */
 int ffio_open_dyn_packet_buf(AVIOContext **s, int max_packet_size);
 
+/**
+ * Open a write only memory stream storing the data in a list of fixed size
+ * chunks. Unlike avio_open_dyn_buf(), growing the stream never moves the
+ * data already written, and the data is never gathered in one buffer.
+ *
+ * @param s new IO context
+ * @return zero if no error.
+ */
+int ffio_open_chunked_dyn_buf(AVIOContext **s);
+
+/**
+ * Write the content of a stream opened with ffio_open_chunked_dyn_buf()
+ * to pb, one chunk at a time, and free it.
+ *
+ * @param s IO context to close
+ * @param pb IO context receiving the data, NULL to discard it
+ * @return the size of the data, a negative error code if writing to the
+ *         memory stream failed (in which case nothing is written to pb)
+ */
+int64_t ffio_close_chunked_dyn_buf(AVIOContext *s, AVIOContext *pb);
+
 /**
  * Create and initialize a AVIOContext for accessing the
  * resource referenced by the URLContext h.
@@ -102,4 +138,24 @@ int ffio_open_dyn_packet_buf(AVIOContext **s, int max_packet_size);
  */
 int ffio_fdopen(AVIOContext **s, URLContext *h);
 
+/**
+ * Return the URLContext associated with the AVIOContext, or NULL if s was
+ * not created by ffio_fdopen().
+ */
+URLContext *ffio_geturlcontext(AVIOContext *s);
+
+/**
+ * Read size bytes from s without copying them, if the underlying
+ * URLContext provides a memory mapping of the resource.
+ *
+ * @param buf  set to a new reference to the mapping on success
+ * @param data set to the start of the data inside the mapping; it is
+ *             followed by at least FF_INPUT_BUFFER_PADDING_SIZE zero bytes
+ * @return size on success, 0 if the data cannot be provided without copying,
+ *         e.g. because the bytes following it in the resource are not zero
+ *         (in which case s is left untouched), <0 on error
+ */
+int ffio_read_mapped(AVIOContext *s, AVBufferRef **buf, uint8_t **data,
+                     int size);
+
 #endif /* AVFORMAT_AVIO_INTERNAL_H */
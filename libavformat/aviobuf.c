@@ -490,6 +490,19 @@ int avio_read(AVIOContext *s, unsigned char *buf, int size)
     return size1 - size;
 }
 
+int ffio_read_indirect(AVIOContext *s, unsigned char *buf, int size,
+                       const unsigned char **data)
+{
+    if (s->buf_end - s->buf_ptr >= size && !s->write_flag) {
+        *data = s->buf_ptr;
+        s->buf_ptr += size;
+        return size;
+    } else {
+        *data = buf;
+        return avio_read(s, buf, size);
+    }
+}
+
 int ffio_read_partial(AVIOContext *s, unsigned char *buf, int size)
 {
     int len;
@@ -689,6 +702,59 @@ int ffio_fdopen(AVIOContext **s, URLContext *h)
     return 0;
 }
 
+URLContext *ffio_geturlcontext(AVIOContext *s)
+{
+    if (s && s->av_class == &ffio_url_class)
+        return s->opaque;
+    return NULL;
+}
+
+int ffio_read_mapped(AVIOContext *s, AVBufferRef **buf, uint8_t **data,
+                     int size)
+{
+    URLContext *h = s->opaque;
+    AVBufferRef *map;
+    int64_t pos, map_size, offset;
+    int i;
+
+    if (s->read_packet != (int (*)(void *, uint8_t *, int))ffurl_read ||
+        s->write_flag || s->update_checksum || size <= 0)
+        return 0;
+
+    pos = avio_tell(s);
+    if (pos < 0 || (map_size = ffurl_get_mapping(h, &map)) < 0)
+        return 0;
+    /* the tail of the resource cannot provide the input padding */
+    if (pos + size + FF_INPUT_BUFFER_PADDING_SIZE > map_size) {
+        av_buffer_unref(&map);
+        return 0;
+    }
+    /* neither can the following data, unless it happens to be zeroed */
+    for (i = 0; i < FF_INPUT_BUFFER_PADDING_SIZE; i++)
+        if (map->data[pos + size + i]) {
+            av_buffer_unref(&map);
+            return 0;
+        }
+
+    offset = pos + size - (s->pos - (s->buf_end - s->buffer));
+    if (offset >= 0 && offset <= s->buf_end - s->buffer) {
+        s->buf_ptr = s->buffer + offset;
+    } else {
+        int64_t ret = s->seek(h, pos + size, SEEK_SET);
+        if (ret < 0) {
+            av_buffer_unref(&map);
+            return ret;
+        }
+        s->buf_ptr = s->buf_end = s->buffer;
+        s->pos     = pos + size;
+    }
+    s->eof_reached = 0;
+
+    *buf  = map;
+    *data = map->data + pos;
+    return size;
+}
+
 int ffio_set_buf_size(AVIOContext *s, int buf_size)
 {
     uint8_t *buffer;
@@ -963,3 +1029,102 @@ int avio_close_dyn_buf(AVIOContext *s, uint8_t **pbuffer)
     av_free(s);
     return size - padding;
 }
+
+/* output in a list of fixed size chunks */
+
+#define DYN_CHUNK_BITS 16
+#define DYN_CHUNK_SIZE (1 << DYN_CHUNK_BITS)
+
+typedef struct ChunkedDynBuffer {
+    uint8_t **chunks;
+    int nb_chunks, allocated_chunks;
+    int64_t pos, size;
+    uint8_t io_buffer[4096];
+} ChunkedDynBuffer;
+
+static int chunked_dyn_buf_write(void *opaque, uint8_t *buf, int buf_size)
+{
+    ChunkedDynBuffer *d = opaque;
+    int written = buf_size;
+
+    while (buf_size > 0) {
+        int64_t idx = d->pos >> DYN_CHUNK_BITS;
+        int off = d->pos & (DYN_CHUNK_SIZE - 1);
+        int len = FFMIN(DYN_CHUNK_SIZE - off, buf_size);
+
+        while (idx >= d->nb_chunks) {
+            if (d->nb_chunks == d->allocated_chunks) {
+                unsigned new_allocated = d->allocated_chunks * 2 + 16;
+                uint8_t **chunks;
+                if (new_allocated > INT_MAX / sizeof(*chunks))
+                    return AVERROR(ENOMEM);
+                chunks = av_realloc(d->chunks, new_allocated * sizeof(*chunks));
+                if (!chunks)
+                    return AVERROR(ENOMEM);
+                d->chunks           = chunks;
+                d->allocated_chunks = new_allocated;
+            }
+            if (!(d->chunks[d->nb_chunks] = av_malloc(DYN_CHUNK_SIZE)))
+                return AVERROR(ENOMEM);
+            d->nb_chunks++;
+        }
+        memcpy(d->chunks[idx] + off, buf, len);
+        d->pos   += len;
+        buf      += len;
+        buf_size -= len;
+    }
+    if (d->pos > d->size)
+        d->size = d->pos;
+    return written;
+}
+
+static int64_t chunked_dyn_buf_seek(void *opaque, int64_t offset, int whence)
+{
+    ChunkedDynBuffer *d = opaque;
+
+    if (whence == SEEK_CUR)
+        offset += d->pos;
+    else if (whence == SEEK_END)
+        offset += d->size;
+    if (offset < 0 || offset > d->size)
+        return -1;
+    d->pos = offset;
+    return 0;
+}
+
+int ffio_open_chunked_dyn_buf(AVIOContext **s)
+{
+    ChunkedDynBuffer *d = av_mallocz(sizeof(*d));
+
+    if (!d)
+        return AVERROR(ENOMEM);
+    *s = avio_alloc_context(d->io_buffer, sizeof(d->io_buffer), 1, d, NULL,
+                            chunked_dyn_buf_write, chunked_dyn_buf_seek);
+    if (!*s) {
+        av_free(d);
+        return AVERROR(ENOMEM);
+    }
+    return 0;
+}
+
+int64_t ffio_close_chunked_dyn_buf(AVIOContext *s, AVIOContext *pb)
+{
+    ChunkedDynBuffer *d = s->opaque;
+    int64_t size, left;
+    int i, ret;
+
+    avio_flush(s);
+    ret  = s->error;
+    size = d->size;
+
+    for (i = 0, left = size; i < d->nb_chunks; i++) {
+        if (pb && ret >= 0 && left > 0)
+            avio_write(pb, d->chunks[i], FFMIN(left, DYN_CHUNK_SIZE));
+        left -= DYN_CHUNK_SIZE;
+        av_free(d->chunks[i]);
+    }
+    av_free(d->chunks);
+    av_free(d);
+    av_free(s);
+    return ret < 0 ? ret : size;
+}
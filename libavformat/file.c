@@ -20,6 +20,7 @@
  */
 
 #include "libavutil/avstring.h"
+#include "libavutil/buffer.h"
 #include "libavutil/opt.h"
 #include "avformat.h"
 #include <fcntl.h>
@@ -29,6 +30,9 @@
 #if HAVE_UNISTD_H
 #include <unistd.h>
 #endif
+#if HAVE_MMAP
+#include <sys/mman.h>
+#endif
 #include <sys/stat.h>
 #include <stdlib.h>
 #include "os_support.h"
@@ -41,10 +45,15 @@ typedef struct FileContext {
     const AVClass *class;
     int fd;
     int trunc;
+    int use_mmap;
+    AVBufferRef *map;   ///< read-only mapping of the whole file, if any
+    int64_t map_size;
+    int64_t map_pos;
 } FileContext;
 
 static const AVOption file_options[] = {
     { "truncate", "Truncate existing files on write", offsetof(FileContext, trunc), AV_OPT_TYPE_INT, { 1 }, 0, 1, AV_OPT_FLAG_ENCODING_PARAM },
+    { "mmap", "Memory map files opened for reading", offsetof(FileContext, use_mmap), AV_OPT_TYPE_INT, { 0 }, 0, 1, AV_OPT_FLAG_DECODING_PARAM },
     { NULL }
 };
 
@@ -58,6 +67,15 @@ static const AVClass file_class = {
 static int file_read(URLContext *h, unsigned char *buf, int size)
 {
     FileContext *c = h->priv_data;
+
+    if (c->map) {
+        if (c->map_pos >= c->map_size)
+            return 0;
+        size = FFMIN(size, c->map_size - c->map_pos);
+        memcpy(buf, c->map->data + c->map_pos, size);
+        c->map_pos += size;
+        return size;
+    }
     return read(c->fd, buf, size);
 }
 
@@ -88,6 +106,53 @@ static int file_check(URLContext *h, int mask)
 
 #if CONFIG_FILE_PROTOCOL
 
+#if HAVE_MMAP
+static void file_unmap(void *opaque, uint8_t *data)
+{
+    munmap(data, (size_t)(uintptr_t)opaque);
+}
+
+static int file_map(URLContext *h)
+{
+    FileContext *c = h->priv_data;
+    struct stat st;
+    void *ptr;
+
+    if (fstat(c->fd, &st) < 0)
+        return AVERROR(errno);
+    if (!S_ISREG(st.st_mode) || st.st_size <= 0 ||
+        (size_t)st.st_size != st.st_size)
+        return AVERROR(EINVAL);
+
+    ptr = mmap(NULL, st.st_size, PROT_READ, MAP_SHARED, c->fd, 0);
+    if (ptr == MAP_FAILED)
+        return AVERROR(errno);
+
+    /* the buffer size is only informative, the mapping may exceed INT_MAX */
+    c->map = av_buffer_create(ptr, FFMIN(st.st_size, INT_MAX), file_unmap,
+                              (void *)(uintptr_t)st.st_size,
+                              AV_BUFFER_FLAG_READONLY);
+    if (!c->map) {
+        munmap(ptr, st.st_size);
+        return AVERROR(ENOMEM);
+    }
+    c->map_size = st.st_size;
+    c->map_pos  = 0;
+    return 0;
+}
+#endif
+
+static int64_t file_get_mapping(URLContext *h, AVBufferRef **buf)
+{
+    FileContext *c = h->priv_data;
+
+    if (!c->map)
+        return AVERROR(ENOSYS);
+    if (!(*buf = av_buffer_ref(c->map)))
+        return AVERROR(ENOMEM);
+    return c->map_size;
+}
+
 static int file_open(URLContext *h, const char *filename, int flags)
 {
     FileContext *c = h->priv_data;
@@ -114,6 +179,22 @@ static int file_open(URLContext *h, const char *filename, int flags)
     if (fd == -1)
         return AVERROR(errno);
     c->fd = fd;
+
+    if (c->use_mmap && !(flags & AVIO_FLAG_WRITE)) {
+#if HAVE_MMAP
+        int ret = file_map(h);
+        if (ret < 0) {
+            char errbuf[128];
+            av_strerror(ret, errbuf, sizeof(errbuf));
+            av_log(h, AV_LOG_WARNING,
+                   "Cannot map %s (%s), using regular reads\n",
+                   filename, errbuf);
+        }
+#else
+        av_log(h, AV_LOG_WARNING,
+               "Memory mapping is not supported, using regular reads\n");
+#endif
+    }
     return 0;
 }
 
@@ -123,6 +204,20 @@ static int64_t file_seek(URLContext *h, int64_t pos, int whence)
     FileContext *c = h->priv_data;
     int64_t ret;
 
+    if (c->map) {
+        if (whence == AVSEEK_SIZE)
+            return c->map_size;
+        if (whence == SEEK_CUR)
+            pos += c->map_pos;
+        else if (whence == SEEK_END)
+            pos += c->map_size;
+        else if (whence != SEEK_SET)
+            return AVERROR(EINVAL);
+        if (pos < 0)
+            return AVERROR(EINVAL);
+        return c->map_pos = pos;
+    }
+
     if (whence == AVSEEK_SIZE) {
         struct stat st;
 
@@ -138,6 +233,8 @@ static int64_t file_seek(URLContext *h, int64_t pos, int whence)
 static int file_close(URLContext *h)
 {
     FileContext *c = h->priv_data;
+    /* packets may still reference the mapping, it is unmapped with them */
+    av_buffer_unref(&c->map);
     return close(c->fd);
 }
 
@@ -158,7 +255,8 @@ URLProtocol ff_file_protocol = {
 	sizeof(FileContext),
 	&file_class,
 	0,
-	file_check
+	file_check,
+	file_get_mapping
 };
 
 #endif /* CONFIG_FILE_PROTOCOL */
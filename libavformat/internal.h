@@ -76,11 +76,24 @@ int ff_hex_to_data(uint8_t *data, const char *p);
 void ff_program_add_stream_index(AVFormatContext *ac, int progid, unsigned int idx);
 
 /**
- * Add packet to AVFormatContext->packet_buffer list, determining its
- * interleaved position using compare() function argument.
+ * Add packet to the interleaving queue of its stream. Packets are muxed in
+ * the order determined by the compare() function argument, which returns
+ * nonzero if next is to be muxed after pkt. The packets of each stream
+ * must be added in that order.
+ *
+ * @return 0 on success, a negative AVERROR on failure, in which case pkt
+ *         is freed
+ */
+int ff_interleave_add_packet(AVFormatContext *s, AVPacket *pkt,
+                             int (*compare)(AVFormatContext *, AVPacket *, AVPacket *));
+
+/**
+ * Remove the first packet from the interleaving queues, in the order given
+ * by the compare function passed to ff_interleave_add_packet().
+ *
+ * @return 1 if a packet was output, 0 if the queues are empty
  */
-void ff_interleave_add_packet(AVFormatContext *s, AVPacket *pkt,
-                              int (*compare)(AVFormatContext *, AVPacket *, AVPacket *));
+int ff_interleave_pop_packet(AVFormatContext *s, AVPacket *out);
 
 void ff_read_frame_flush(AVFormatContext *s);
 
@@ -375,6 +388,14 @@ enum AVCodecID ff_codec_get_id(const AVCodecTag *tags, unsigned int tag);
  */
 enum AVCodecID ff_get_pcm_codec_id(int bps, int flt, int be, int sflags);
 
+/**
+ * Like av_get_packet(), but if the input is memory mapped (e.g. by the file
+ * protocol's mmap option) and the bytes following the data in the mapping
+ * are zero, return a packet referencing the mapping instead of a copy of the
+ * data. The packet data and its padding must not be modified.
+ */
+int ff_get_packet_mapped(AVIOContext *s, AVPacket *pkt, int size);
+
 int ff_http_match_no_proxy(const char *no_proxy, const char *hostname);
 
 #endif /* AVFORMAT_INTERNAL_H */
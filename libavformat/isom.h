@@ -92,6 +92,24 @@ typedef struct MOVSbgp {
     unsigned int index;
 } MOVSbgp;
 
+/**
+ * Position of the demuxer in the sample tables of a track, used to resolve
+ * samples on demand instead of expanding them all into the AVStream index.
+ */
+typedef struct MOVIndexCursor {
+    unsigned int sample;       ///< sample number
+    unsigned int chunk;        ///< chunk containing the sample
+    unsigned int chunk_sample; ///< position of the sample in its chunk
+    unsigned int stsc_index;
+    unsigned int stts_index;
+    unsigned int stts_sample;
+    unsigned int stss_index;
+    unsigned int stps_index;
+    unsigned int rap_group_index;
+    unsigned int rap_group_sample;
+    AVIndexEntry entry;        ///< the sample itself, min_distance is not set
+} MOVIndexCursor;
+
 typedef struct MOVStreamContext {
     AVIOContext *pb;
     int ffindex;          ///< AVStream index
@@ -135,6 +153,10 @@ typedef struct MOVStreamContext {
     int64_t track_end;    ///< used for dts generation in fragmented movie files
     unsigned int rap_group_count;
     MOVSbgp *rap_group;
+    int64_t first_dts;    ///< dts of the first sample
+    int key_off;          ///< 1 if stss/stps sample numbers are 1-based
+    unsigned int compact_count; ///< number of samples in the compact index, 0 if the AVStream index is used
+    MOVIndexCursor cursor;
 } MOVStreamContext;
 
 typedef struct MOVContext {
@@ -84,6 +84,7 @@ typedef struct {
 
 typedef struct {
     int      size;
+    AVBufferRef *buf;
     uint8_t *data;
     int64_t  pos;
 } EbmlBin;
@@ -703,14 +704,18 @@ static int ebml_read_ascii(AVIOContext *pb, int size, char **str)
  */
 static int ebml_read_binary(AVIOContext *pb, int length, EbmlBin *bin)
 {
-    av_free(bin->data);
-    if (!(bin->data = av_malloc(length)))
+    av_buffer_unref(&bin->buf);
+    bin->data = NULL;
+    if (!(bin->buf = av_buffer_alloc(length + FF_INPUT_BUFFER_PADDING_SIZE)))
         return AVERROR(ENOMEM);
+    memset(bin->buf->data + length, 0, FF_INPUT_BUFFER_PADDING_SIZE);
 
+    bin->data = bin->buf->data;
     bin->size = length;
     bin->pos  = avio_tell(pb);
     if (avio_read(pb, bin->data, length) != length) {
-        av_freep(&bin->data);
+        av_buffer_unref(&bin->buf);
+        bin->data = NULL;
         return AVERROR(EIO);
     }
 
@@ -904,7 +909,7 @@ static void ebml_free(EbmlSyntax *syntax, void *data)
         switch (syntax[i].type) {
         case EBML_STR:
         case EBML_UTF8:  av_freep(data_off);                      break;
-        case EBML_BIN:   av_freep(&((EbmlBin *)data_off)->data);  break;
+        case EBML_BIN:   av_buffer_unref(&((EbmlBin *)data_off)->buf); break;
         case EBML_NEST:
             if (syntax[i].list_elem_size) {
                 EbmlList *list = data_off;
@@ -1467,8 +1472,19 @@ static int matroska_read_header(AVFormatContext *s)
                            "Failed to decode codec private data\n");
                 }
 
-                if (codec_priv != track->codec_priv.data)
-                    av_free(codec_priv);
+                if (codec_priv != track->codec_priv.data) {
+                    av_buffer_unref(&track->codec_priv.buf);
+                    if (track->codec_priv.data) {
+                        track->codec_priv.buf = av_buffer_create(track->codec_priv.data,
+                                                                 track->codec_priv.size,
+                                                                 NULL, NULL, 0);
+                        if (!track->codec_priv.buf) {
+                            av_freep(&track->codec_priv.data);
+                            track->codec_priv.size = 0;
+                            return AVERROR(ENOMEM);
+                        }
+                    }
+                }
             }
         }
 
@@ -1933,6 +1949,7 @@ static int matroska_parse_rm_audio(MatroskaDemuxContext *matroska,
 static int matroska_parse_frame(MatroskaDemuxContext *matroska,
                                 MatroskaTrack *track,
                                 AVStream *st,
+                                AVBufferRef *buf,
                                 uint8_t *data, int pkt_size,
                                 uint64_t timecode, uint64_t duration,
                                 int64_t pos, int is_keyframe)
@@ -1952,22 +1969,42 @@ static int matroska_parse_frame(MatroskaDemuxContext *matroska,
         offset = 8;
 
     pkt = av_mallocz(sizeof(AVPacket));
-    /* XXX: prevent data copy... */
-    if (av_new_packet(pkt, pkt_size + offset) < 0) {
-        av_free(pkt);
+    if (!pkt) {
+        if (pkt_data != data)
+            av_free(pkt_data);
         return AVERROR(ENOMEM);
     }
 
-    if (st->codec->codec_id == AV_CODEC_ID_PRORES) {
-        uint8_t *buf = pkt->data;
-        bytestream_put_be32(&buf, pkt_size);
-        bytestream_put_be32(&buf, MKBETAG('i', 'c', 'p', 'f'));
-    }
+    /* The frame is handed out as a reference to the block buffer, unless it
+     * has to be rewritten: merged SSA packets are grown in place. */
+    if (pkt_data == data && !offset &&
+        st->codec->codec_id != AV_CODEC_ID_SSA) {
+        av_init_packet(pkt);
+        if (!(pkt->buf = av_buffer_ref(buf))) {
+            av_free(pkt);
+            return AVERROR(ENOMEM);
+        }
+        pkt->data = data;
+        pkt->size = pkt_size;
+    } else {
+        if (av_new_packet(pkt, pkt_size + offset) < 0) {
+            av_free(pkt);
+            if (pkt_data != data)
+                av_free(pkt_data);
+            return AVERROR(ENOMEM);
+        }
 
-    memcpy(pkt->data + offset, pkt_data, pkt_size);
+        if (st->codec->codec_id == AV_CODEC_ID_PRORES) {
+            uint8_t *buf = pkt->data;
+            bytestream_put_be32(&buf, pkt_size);
+            bytestream_put_be32(&buf, MKBETAG('i', 'c', 'p', 'f'));
+        }
 
-    if (pkt_data != data)
-        av_free(pkt_data);
+        memcpy(pkt->data + offset, pkt_data, pkt_size);
+
+        if (pkt_data != data)
+            av_free(pkt_data);
+    }
 
     pkt->flags = is_keyframe;
     pkt->stream_index = st->index;
@@ -1999,8 +2036,9 @@ static int matroska_parse_frame(MatroskaDemuxContext *matroska,
     return 0;
 }
 
-static int matroska_parse_block(MatroskaDemuxContext *matroska, uint8_t *data,
-                                int size, int64_t pos, uint64_t cluster_time,
+static int matroska_parse_block(MatroskaDemuxContext *matroska, AVBufferRef *buf,
+                                uint8_t *data, int size, int64_t pos,
+                                uint64_t cluster_time,
                                 uint64_t block_duration, int is_keyframe,
                                 int64_t cluster_pos)
 {
@@ -2088,9 +2126,9 @@ static int matroska_parse_block(MatroskaDemuxContext *matroska, uint8_t *data,
                 goto end;
 
         } else {
-            res = matroska_parse_frame(matroska, track, st, data, lace_size[n],
-                                      timecode, duration,
-                                      pos, !n? is_keyframe : 0);
+            res = matroska_parse_frame(matroska, track, st, buf, data,
+                                       lace_size[n], timecode, duration,
+                                       pos, !n? is_keyframe : 0);
             if (res)
                 goto end;
         }
@@ -2148,7 +2186,7 @@ static int matroska_parse_cluster_incremental(MatroskaDemuxContext *matroska)
             int is_keyframe = blocks[i].non_simple ? !blocks[i].reference : -1;
             if (!blocks[i].non_simple)
                 blocks[i].duration = AV_NOPTS_VALUE;
-            res = matroska_parse_block(matroska,
+            res = matroska_parse_block(matroska, blocks[i].bin.buf,
                                        blocks[i].bin.data, blocks[i].bin.size,
                                        blocks[i].bin.pos,
                                        matroska->current_cluster.timecode,
@@ -2182,7 +2220,7 @@ static int matroska_parse_cluster(MatroskaDemuxContext *matroska)
             int is_keyframe = blocks[i].non_simple ? !blocks[i].reference : -1;
             if (!blocks[i].non_simple)
                 blocks[i].duration = AV_NOPTS_VALUE;
-            res=matroska_parse_block(matroska,
+            res=matroska_parse_block(matroska, blocks[i].bin.buf,
                                      blocks[i].bin.data, blocks[i].bin.size,
                                      blocks[i].bin.pos,  cluster.timecode,
                                      blocks[i].duration, is_keyframe,
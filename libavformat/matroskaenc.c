@@ -20,6 +20,7 @@
  */
 
 #include "avformat.h"
+#include "avio_internal.h"
 #include "internal.h"
 #include "riff.h"
 #include "isom.h"
@@ -1112,19 +1113,17 @@ static int mkv_write_srt_blocks(AVFormatContext *s, AVIOContext *pb, AVPacket *p
     return duration;
 }
 
-static void mkv_flush_dynbuf(AVFormatContext *s)
+static int mkv_flush_dynbuf(AVFormatContext *s)
 {
     MatroskaMuxContext *mkv = s->priv_data;
-    int bufsize;
-    uint8_t *dyn_buf;
+    int64_t ret;
 
     if (!mkv->dyn_bc)
-        return;
+        return 0;
 
-    bufsize = avio_close_dyn_buf(mkv->dyn_bc, &dyn_buf);
-    avio_write(s->pb, dyn_buf, bufsize);
-    av_free(dyn_buf);
+    ret = ffio_close_chunked_dyn_buf(mkv->dyn_bc, s->pb);
     mkv->dyn_bc = NULL;
+    return ret < 0 ? ret : 0;
 }
 
 static int mkv_write_packet_internal(AVFormatContext *s, AVPacket *pkt)
@@ -1143,8 +1142,8 @@ static int mkv_write_packet_internal(AVFormatContext *s, AVPacket *pkt)
     }
 
     if (!s->pb->seekable) {
-        if (!mkv->dyn_bc)
-            avio_open_dyn_buf(&mkv->dyn_bc);
+        if (!mkv->dyn_bc && (ret = ffio_open_chunked_dyn_buf(&mkv->dyn_bc)) < 0)
+            return ret;
         pb = mkv->dyn_bc;
     }
 
@@ -1197,8 +1196,11 @@ static int mkv_write_packet(AVFormatContext *s, AVPacket *pkt)
                " bytes, pts %" PRIu64 "\n", avio_tell(pb), ts);
         end_ebml_master(pb, mkv->cluster);
         mkv->cluster_pos = 0;
-        if (mkv->dyn_bc)
-            mkv_flush_dynbuf(s);
+        if (mkv->dyn_bc) {
+            ret = mkv_flush_dynbuf(s);
+            if (ret < 0)
+                return ret;
+        }
     }
 
     // check if we have an audio packet cached
@@ -1241,7 +1243,9 @@ static int mkv_write_trailer(AVFormatContext *s)
 
     if (mkv->dyn_bc) {
         end_ebml_master(mkv->dyn_bc, mkv->cluster);
-        mkv_flush_dynbuf(s);
+        ret = mkv_flush_dynbuf(s);
+        if (ret < 0)
+            return ret;
     } else if (mkv->cluster_pos) {
         end_ebml_master(pb, mkv->cluster);
     }
@@ -1761,33 +1761,22 @@ static int mov_read_sbgp(MOVContext *c, AVIOContext *pb, MOVAtom atom)
     return pb->eof_reached ? AVERROR_EOF : 0;
 }
 
-static void mov_build_index(MOVContext *mov, AVStream *st)
+/**
+ * Expand the sample tables of a track into its AVStream index.
+ * @param logctx context used for logging, may be NULL
+ */
+static int mov_build_index_entries(void *logctx, AVStream *st)
 {
     MOVStreamContext *sc = st->priv_data;
     int64_t current_offset;
-    int64_t current_dts = 0;
+    int64_t current_dts = sc->first_dts;
     unsigned int stts_index = 0;
     unsigned int stsc_index = 0;
     unsigned int stss_index = 0;
     unsigned int stps_index = 0;
     unsigned int i, j;
-    uint64_t stream_size = 0;
     AVIndexEntry *mem;
 
-    /* adjust first dts according to edit list */
-    if (sc->time_offset && mov->time_scale > 0) {
-        if (sc->time_offset < 0)
-            sc->time_offset = av_rescale(sc->time_offset, sc->time_scale, mov->time_scale);
-        current_dts = -sc->time_offset;
-        if (sc->ctts_data && sc->stts_data && sc->stts_data[0].duration &&
-            sc->ctts_data[0].duration / sc->stts_data[0].duration > 16) {
-            /* more than 16 frames delay, dts are likely wrong
-               this happens with files created by iMovie */
-            sc->wrong_dts = 1;
-            st->codec->has_b_frames = 1;
-        }
-    }
-
     /* only use old uncompressed audio chunk demuxing when stts specifies it */
     if (!(st->codec->codec_type == AVMEDIA_TYPE_AUDIO &&
           sc->stts_count == 1 && sc->stts_data[0].duration == 1)) {
@@ -1798,17 +1787,14 @@ static void mov_build_index(MOVContext *mov, AVStream *st)
         unsigned int rap_group_index = 0;
         unsigned int rap_group_sample = 0;
         int rap_group_present = sc->rap_group_count && sc->rap_group;
-        int key_off = (sc->keyframes && sc->keyframes[0] > 0) || (sc->stps_data && sc->stps_data[0] > 0);
-
-        current_dts -= sc->dts_shift;
 
         if (!sc->sample_count)
-            return;
+            return 0;
         if (sc->sample_count >= UINT_MAX / sizeof(*st->index_entries) - st->nb_index_entries)
-            return;
+            return AVERROR_INVALIDDATA;
         mem = av_realloc(st->index_entries, (st->nb_index_entries + sc->sample_count) * sizeof(*st->index_entries));
         if (!mem)
-            return;
+            return AVERROR(ENOMEM);
         st->index_entries = mem;
         st->index_entries_allocated_size = (st->nb_index_entries + sc->sample_count) * sizeof(*st->index_entries);
 
@@ -1820,15 +1806,15 @@ static void mov_build_index(MOVContext *mov, AVStream *st)
             for (j = 0; j < sc->stsc_data[stsc_index].count; j++) {
                 int keyframe = 0;
                 if (current_sample >= sc->sample_count) {
-                    av_log(mov->fc, AV_LOG_ERROR, "wrong sample count\n");
-                    return;
+                    av_log(logctx, AV_LOG_ERROR, "wrong sample count\n");
+                    return 0;
                 }
 
-                if (!sc->keyframe_absent && (!sc->keyframe_count || current_sample+key_off == sc->keyframes[stss_index])) {
+                if (!sc->keyframe_absent && (!sc->keyframe_count || current_sample+sc->key_off == sc->keyframes[stss_index])) {
                     keyframe = 1;
                     if (stss_index + 1 < sc->keyframe_count)
                         stss_index++;
-                } else if (sc->stps_count && current_sample+key_off == sc->stps_data[stps_index]) {
+                } else if (sc->stps_count && current_sample+sc->key_off == sc->stps_data[stps_index]) {
                     keyframe = 1;
                     if (stps_index + 1 < sc->stps_count)
                         stps_index++;
@@ -1852,13 +1838,12 @@ static void mov_build_index(MOVContext *mov, AVStream *st)
                     e->size = sample_size;
                     e->min_distance = distance;
                     e->flags = keyframe ? AVINDEX_KEYFRAME : 0;
-                    av_dlog(mov->fc, "AVIndex stream %d, sample %d, offset %"PRIx64", dts %"PRId64", "
+                    av_dlog(logctx, "AVIndex stream %d, sample %d, offset %"PRIx64", dts %"PRId64", "
                             "size %d, distance %d, keyframe %d\n", st->index, current_sample,
                             current_offset, current_dts, sample_size, distance, keyframe);
                 }
 
                 current_offset += sample_size;
-                stream_size += sample_size;
                 current_dts += sc->stts_data[stts_index].duration;
                 distance++;
                 stts_sample++;
@@ -1869,8 +1854,6 @@ static void mov_build_index(MOVContext *mov, AVStream *st)
                 }
             }
         }
-        if (st->duration > 0)
-            st->codec->bit_rate = stream_size*8*sc->time_scale/st->duration;
     } else {
         unsigned chunk_samples, total = 0;
 
@@ -1881,8 +1864,8 @@ static void mov_build_index(MOVContext *mov, AVStream *st)
             chunk_samples = sc->stsc_data[i].count;
             if (i != sc->stsc_count - 1 &&
                 sc->samples_per_frame && chunk_samples % sc->samples_per_frame) {
-                av_log(mov->fc, AV_LOG_ERROR, "error unaligned chunk\n");
-                return;
+                av_log(logctx, AV_LOG_ERROR, "error unaligned chunk\n");
+                return AVERROR_INVALIDDATA;
             }
 
             if (sc->samples_per_frame >= 160) { // gsm
@@ -1901,12 +1884,12 @@ static void mov_build_index(MOVContext *mov, AVStream *st)
             total += chunk_count * count;
         }
 
-        av_dlog(mov->fc, "chunk count %d\n", total);
+        av_dlog(logctx, "chunk count %d\n", total);
         if (total >= UINT_MAX / sizeof(*st->index_entries) - st->nb_index_entries)
-            return;
+            return AVERROR_INVALIDDATA;
         mem = av_realloc(st->index_entries, (st->nb_index_entries + total) * sizeof(*st->index_entries));
         if (!mem)
-            return;
+            return AVERROR(ENOMEM);
         st->index_entries = mem;
         st->index_entries_allocated_size = (st->nb_index_entries + total) * sizeof(*st->index_entries);
 
@@ -1937,8 +1920,8 @@ static void mov_build_index(MOVContext *mov, AVStream *st)
                 }
 
                 if (st->nb_index_entries >= total) {
-                    av_log(mov->fc, AV_LOG_ERROR, "wrong chunk count %d\n", total);
-                    return;
+                    av_log(logctx, AV_LOG_ERROR, "wrong chunk count %d\n", total);
+                    return AVERROR_INVALIDDATA;
                 }
                 e = &st->index_entries[st->nb_index_entries++];
                 e->pos = current_offset;
@@ -1946,7 +1929,7 @@ static void mov_build_index(MOVContext *mov, AVStream *st)
                 e->size = size;
                 e->min_distance = 0;
                 e->flags = AVINDEX_KEYFRAME;
-                av_dlog(mov->fc, "AVIndex stream %d, chunk %d, offset %"PRIx64", dts %"PRId64", "
+                av_dlog(logctx, "AVIndex stream %d, chunk %d, offset %"PRIx64", dts %"PRId64", "
                         "size %d, duration %d\n", st->index, i, current_offset, current_dts,
                         size, samples);
 
@@ -1956,6 +1939,390 @@ static void mov_build_index(MOVContext *mov, AVStream *st)
             }
         }
     }
+    return 0;
+}
+
+/* AVStream.build_index callback of tracks using the compact index */
+static int mov_materialize_index(AVStream *st)
+{
+    return mov_build_index_entries(NULL, st);
+}
+
+static int mov_stss_match(MOVStreamContext *sc, MOVIndexCursor *c)
+{
+    return !sc->keyframe_absent &&
+           (!sc->keyframe_count ||
+            c->sample + sc->key_off == sc->keyframes[c->stss_index]);
+}
+
+static int mov_stps_match(MOVStreamContext *sc, MOVIndexCursor *c)
+{
+    return sc->stps_count &&
+           c->sample + sc->key_off == sc->stps_data[c->stps_index];
+}
+
+/* fill the index entry of the sample the cursor points to */
+static void mov_cursor_load(MOVStreamContext *sc, MOVIndexCursor *c)
+{
+    int keyframe = mov_stss_match(sc, c) || mov_stps_match(sc, c);
+
+    if (sc->rap_group_count && sc->rap_group &&
+        c->rap_group_index < sc->rap_group_count &&
+        sc->rap_group[c->rap_group_index].index > 0)
+        keyframe = 1;
+    c->entry.size  = sc->sample_size > 0 ? sc->sample_size : sc->sample_sizes[c->sample];
+    c->entry.flags = keyframe ? AVINDEX_KEYFRAME : 0;
+}
+
+/* move the cursor to the next sample, in the order of mov_build_index_entries() */
+static void mov_cursor_next(MOVStreamContext *sc)
+{
+    MOVIndexCursor *c = &sc->cursor;
+
+    if (mov_stss_match(sc, c)) {
+        if (c->stss_index + 1 < sc->keyframe_count)
+            c->stss_index++;
+    } else if (mov_stps_match(sc, c)) {
+        if (c->stps_index + 1 < sc->stps_count)
+            c->stps_index++;
+    }
+    if (sc->rap_group_count && sc->rap_group &&
+        c->rap_group_index < sc->rap_group_count &&
+        ++c->rap_group_sample == sc->rap_group[c->rap_group_index].count) {
+        c->rap_group_sample = 0;
+        c->rap_group_index++;
+    }
+
+    c->entry.pos       += c->entry.size;
+    c->entry.timestamp += sc->stts_data[c->stts_index].duration;
+    c->stts_sample++;
+    if (c->stts_index + 1 < sc->stts_count &&
+        c->stts_sample == sc->stts_data[c->stts_index].count) {
+        c->stts_sample = 0;
+        c->stts_index++;
+    }
+
+    if (++c->sample >= sc->compact_count)
+        return;
+    c->chunk_sample++;
+    while (c->chunk_sample >= sc->stsc_data[c->stsc_index].count) {
+        c->chunk++;
+        c->chunk_sample = 0;
+        c->entry.pos    = sc->chunk_offsets[c->chunk];
+        if (c->stsc_index + 1 < sc->stsc_count &&
+            c->chunk + 1 == sc->stsc_data[c->stsc_index + 1].first)
+            c->stsc_index++;
+    }
+    mov_cursor_load(sc, c);
+}
+
+/**
+ * Compute the dts of a sample from the stts runs.
+ * @param index, index_sample set to the stts position of the sample
+ */
+static int64_t mov_sample_dts(MOVStreamContext *sc, unsigned int sample,
+                              unsigned int *index, unsigned int *index_sample)
+{
+    int64_t dts = sc->first_dts;
+    unsigned int i = 0;
+
+    while (i + 1 < sc->stts_count && sc->stts_data[i].count &&
+           sample >= sc->stts_data[i].count) {
+        dts    += (int64_t)sc->stts_data[i].count * sc->stts_data[i].duration;
+        sample -= sc->stts_data[i].count;
+        i++;
+    }
+    *index        = i;
+    *index_sample = sample;
+    return dts + (int64_t)sample * sc->stts_data[i].duration;
+}
+
+/* index of the first entry of a sorted table not smaller than value */
+static unsigned int mov_lower_bound(const unsigned *table, unsigned int count,
+                                    int64_t value)
+{
+    unsigned int a = 0, b = count;
+
+    while (a < b) {
+        unsigned int m = (a + b) >> 1;
+        if (table[m] < value)
+            a = m + 1;
+        else
+            b = m;
+    }
+    return a;
+}
+
+/* move the cursor to an arbitrary sample */
+static void mov_cursor_seek(MOVStreamContext *sc, unsigned int sample)
+{
+    MOVIndexCursor *c = &sc->cursor;
+    unsigned int i, first = 0, left;
+
+    memset(c, 0, sizeof(*c));
+    c->sample = sample;
+    c->entry.timestamp = mov_sample_dts(sc, sample, &c->stts_index, &c->stts_sample);
+    if (sample >= sc->compact_count)
+        return;
+
+    for (i = 0; i < sc->stsc_count; i++) {
+        unsigned int end = i + 1 < sc->stsc_count ? sc->stsc_data[i + 1].first - 1
+                                                  : sc->chunk_count;
+        uint64_t samples = (uint64_t)(end - (sc->stsc_data[i].first - 1)) *
+                           sc->stsc_data[i].count;
+        if (sample - first < samples) {
+            c->stsc_index   = i;
+            c->chunk        = sc->stsc_data[i].first - 1 +
+                              (sample - first) / sc->stsc_data[i].count;
+            c->chunk_sample = (sample - first) % sc->stsc_data[i].count;
+            break;
+        }
+        first += samples;
+    }
+    c->entry.pos = sc->chunk_offsets[c->chunk];
+    if (sc->sample_size > 0) {
+        c->entry.pos += (int64_t)c->chunk_sample * sc->sample_size;
+    } else {
+        for (i = sample - c->chunk_sample; i < sample; i++)
+            c->entry.pos += sc->sample_sizes[i];
+    }
+
+    if (sc->keyframe_count)
+        c->stss_index = FFMIN(mov_lower_bound((unsigned *)sc->keyframes, sc->keyframe_count,
+                                              (int64_t)sample + sc->key_off),
+                              sc->keyframe_count - 1);
+    if (sc->stps_count)
+        c->stps_index = FFMIN(mov_lower_bound(sc->stps_data, sc->stps_count,
+                                              (int64_t)sample + sc->key_off),
+                              sc->stps_count - 1);
+
+    if (sc->rap_group) {
+        left = sample;
+        while (c->rap_group_index < sc->rap_group_count &&
+               sc->rap_group[c->rap_group_index].count &&
+               left >= sc->rap_group[c->rap_group_index].count)
+            left -= sc->rap_group[c->rap_group_index++].count;
+        c->rap_group_sample = left;
+    }
+    mov_cursor_load(sc, c);
+}
+
+/* merge the closest sync sample of a stss or stps table into best */
+static int64_t mov_keyframe_candidate(MOVStreamContext *sc, const unsigned *table,
+                                      unsigned int count, int64_t sample,
+                                      int backward, int64_t best)
+{
+    unsigned int i;
+
+    if (backward) {
+        i = mov_lower_bound(table, count, sample + sc->key_off + 1);
+        if (i > 0)
+            best = FFMAX(best, (int64_t)table[i - 1] - sc->key_off);
+    } else {
+        i = mov_lower_bound(table, count, sample + sc->key_off);
+        if (i < count)
+            best = FFMIN(best, (int64_t)table[i] - sc->key_off);
+    }
+    return best;
+}
+
+/**
+ * Find the closest keyframe at or before (backward) or at or after a sample.
+ * @return sample number, -1 or compact_count if there is none
+ */
+static int64_t mov_find_keyframe(MOVStreamContext *sc, int64_t sample, int backward)
+{
+    int64_t best = backward ? -1 : (int64_t)sc->compact_count;
+    int64_t start = 0;
+    unsigned int i;
+
+    if (!sc->keyframe_absent && !sc->keyframe_count)
+        return sample;
+
+    if (!sc->keyframe_absent)
+        best = mov_keyframe_candidate(sc, (unsigned *)sc->keyframes,
+                                      sc->keyframe_count, sample, backward, best);
+    if (sc->stps_count)
+        best = mov_keyframe_candidate(sc, sc->stps_data, sc->stps_count,
+                                      sample, backward, best);
+
+    if (sc->rap_group) {
+        for (i = 0; i < sc->rap_group_count; i++) {
+            int64_t end = sc->rap_group[i].count ? start + sc->rap_group[i].count
+                                                 : INT64_MAX;
+            if (backward && start > sample)
+                break;
+            if (sc->rap_group[i].index > 0) {
+                if (backward)
+                    best = FFMAX(best, FFMIN(sample, end - 1));
+                else if (end > sample) {
+                    best = FFMIN(best, FFMAX(sample, start));
+                    break;
+                }
+            }
+            start = end;
+        }
+    }
+    return best;
+}
+
+/**
+ * Equivalent of av_index_search_timestamp() on the compact index.
+ */
+static int mov_index_search_timestamp(MOVStreamContext *sc, int64_t timestamp,
+                                      int flags)
+{
+    int64_t dts = sc->first_dts, a = -1, m;
+    unsigned int i, index, index_sample;
+    uint64_t sample = 0;
+
+    /* a: last sample with a dts not after timestamp */
+    for (i = 0; timestamp >= dts && i < sc->stts_count; i++) {
+        unsigned int count = sc->stts_data[i].count;
+        int duration = sc->stts_data[i].duration;
+
+        if (i + 1 == sc->stts_count || !count) {
+            a = duration > 0 ? sample + (timestamp - dts) / duration : INT64_MAX;
+            break;
+        }
+        if (duration > 0 && timestamp < dts + (int64_t)count * duration) {
+            a = sample + (timestamp - dts) / duration;
+            break;
+        }
+        dts    += (int64_t)count * duration;
+        sample += count;
+        if (sample >= sc->compact_count) {
+            a = INT64_MAX;
+            break;
+        }
+    }
+    a = FFMIN(a, (int64_t)sc->compact_count - 1);
+
+    if (flags & AVSEEK_FLAG_BACKWARD)
+        m = a;
+    else if (a >= 0 && mov_sample_dts(sc, a, &index, &index_sample) == timestamp)
+        m = a;
+    else
+        m = a + 1;
+
+    if (!(flags & AVSEEK_FLAG_ANY) && m >= 0 && m < sc->compact_count)
+        m = mov_find_keyframe(sc, m, flags & AVSEEK_FLAG_BACKWARD);
+
+    if (m >= sc->compact_count)
+        return -1;
+    return m;
+}
+
+/**
+ * Prepare the index of a track. The sample tables are kept and resolved on
+ * demand when possible, the AVStream index is only filled when it is used.
+ */
+static void mov_build_index(MOVContext *mov, AVStream *st)
+{
+    MOVStreamContext *sc = st->priv_data;
+    uint64_t stream_size = 0, samples = 0;
+    unsigned int i, n;
+
+    sc->first_dts = 0;
+    /* adjust first dts according to edit list */
+    if (sc->time_offset && mov->time_scale > 0) {
+        if (sc->time_offset < 0)
+            sc->time_offset = av_rescale(sc->time_offset, sc->time_scale, mov->time_scale);
+        sc->first_dts = -sc->time_offset;
+        if (sc->ctts_data && sc->stts_data && sc->stts_data[0].duration &&
+            sc->ctts_data[0].duration / sc->stts_data[0].duration > 16) {
+            /* more than 16 frames delay, dts are likely wrong
+               this happens with files created by iMovie */
+            sc->wrong_dts = 1;
+            st->codec->has_b_frames = 1;
+        }
+    }
+
+    /* uncompressed audio chunks are indexed in blocks of samples */
+    if (st->codec->codec_type == AVMEDIA_TYPE_AUDIO &&
+        sc->stts_count == 1 && sc->stts_data[0].duration == 1) {
+        mov_build_index_entries(mov->fc, st);
+        return;
+    }
+
+    sc->first_dts -= sc->dts_shift;
+    sc->key_off = (sc->keyframes && sc->keyframes[0] > 0) || (sc->stps_data && sc->stps_data[0] > 0);
+
+    if (!sc->sample_count || !sc->chunk_count)
+        return;
+
+    /* keep the stsc entries that are actually used when walking the chunks,
+     * so that they map to increasing chunk ranges */
+    sc->stsc_data[0].first = 1;
+    for (i = n = 1; i < sc->stsc_count; i++) {
+        if (sc->stsc_data[i].first < sc->stsc_data[n - 1].first ||
+            sc->stsc_data[i].first > sc->chunk_count)
+            break;
+        if (sc->stsc_data[i].first > sc->stsc_data[n - 1].first)
+            n++;
+        sc->stsc_data[n - 1] = sc->stsc_data[i];
+    }
+    sc->stsc_count = n;
+
+    for (i = 0; i < sc->stsc_count; i++) {
+        unsigned int end = i + 1 < sc->stsc_count ? sc->stsc_data[i + 1].first - 1
+                                                  : sc->chunk_count;
+        samples += (uint64_t)(end - (sc->stsc_data[i].first - 1)) *
+                   (unsigned)sc->stsc_data[i].count;
+    }
+    if (samples > sc->sample_count) {
+        av_log(mov->fc, AV_LOG_ERROR, "wrong sample count\n");
+        samples = sc->sample_count;
+    }
+    if (sc->sample_size > 0) {
+        stream_size = samples * sc->sample_size;
+    } else {
+        for (i = 0; i < samples; i++)
+            stream_size += sc->sample_sizes[i];
+    }
+    if (st->duration > 0)
+        st->codec->bit_rate = stream_size*8*sc->time_scale/st->duration;
+
+    for (i = 0; i < sc->stsc_count && sc->pseudo_stream_id != -1; i++) {
+        if (sc->stsc_data[i].id - 1 != sc->pseudo_stream_id) {
+            /* only some of the samples belong to this stream */
+            mov_build_index_entries(mov->fc, st);
+            return;
+        }
+    }
+
+    sc->compact_count = samples;
+    st->build_index   = mov_materialize_index;
+    mov_cursor_seek(sc, 0);
+}
+
+/**
+ * Return the sample the demuxer is positioned on, NULL at the end of the track.
+ */
+static AVIndexEntry *mov_current_sample(AVStream *st)
+{
+    MOVStreamContext *sc = st->priv_data;
+
+    if (sc->compact_count)
+        return sc->current_sample < sc->compact_count ? &sc->cursor.entry : NULL;
+    return sc->current_sample < st->nb_index_entries ?
+           &st->index_entries[sc->current_sample] : NULL;
+}
+
+/**
+ * Switch a track from the compact index to the AVStream index.
+ */
+static int mov_expand_index(AVStream *st)
+{
+    MOVStreamContext *sc = st->priv_data;
+    int ret = 0;
+
+    if (st->build_index) {
+        ret = st->build_index(st);
+        st->build_index = NULL;
+    }
+    sc->compact_count = 0;
+    return ret;
 }
 
 static int mov_open_dref(AVIOContext **pb, char *src, MOVDref *ref,
@@ -2002,6 +2369,17 @@ static int mov_open_dref(AVIOContext **pb, char *src, MOVDref *ref,
     return AVERROR(ENOENT);
 }
 
+static void mov_free_sample_tables(MOVStreamContext *sc)
+{
+    av_freep(&sc->chunk_offsets);
+    av_freep(&sc->stsc_data);
+    av_freep(&sc->sample_sizes);
+    av_freep(&sc->keyframes);
+    av_freep(&sc->stts_data);
+    av_freep(&sc->stps_data);
+    av_freep(&sc->rap_group);
+}
+
 static int mov_read_trak(MOVContext *c, AVIOContext *pb, MOVAtom atom)
 {
     AVStream *st;
@@ -2084,14 +2462,9 @@ static int mov_read_trak(MOVContext *c, AVIOContext *pb, MOVAtom atom)
         break;
     }
 
-    /* Do not need those anymore. */
-    av_freep(&sc->chunk_offsets);
-    av_freep(&sc->stsc_data);
-    av_freep(&sc->sample_sizes);
-    av_freep(&sc->keyframes);
-    av_freep(&sc->stts_data);
-    av_freep(&sc->stps_data);
-    av_freep(&sc->rap_group);
+    /* Do not need those anymore, unless they are the index. */
+    if (!sc->compact_count)
+        mov_free_sample_tables(sc);
 
     return 0;
 }
@@ -2276,7 +2649,7 @@ static int mov_read_trun(MOVContext *c, AVIOContext *pb, MOVAtom atom)
     int64_t dts;
     int data_offset = 0;
     unsigned entries, first_sample_flags = frag->flags;
-    int flags, distance, i, found_keyframe = 0;
+    int flags, distance, i, ret, found_keyframe = 0;
 
     for (i = 0; i < c->fc->nb_streams; i++) {
         if (c->fc->streams[i]->id == frag->track_id) {
@@ -2291,6 +2664,9 @@ static int mov_read_trun(MOVContext *c, AVIOContext *pb, MOVAtom atom)
     sc = st->priv_data;
     if (sc->pseudo_stream_id+1 != frag->stsd_id)
         return 0;
+    /* fragment samples are appended to the AVStream index */
+    if (sc->compact_count && (ret = mov_expand_index(st)) < 0)
+        return ret;
     avio_r8(pb); /* version */
     flags = avio_rb24(pb);
     entries = avio_rb32(pb);
@@ -2678,6 +3054,8 @@ static void mov_read_chapters(AVFormatContext *s)
     st->discard = AVDISCARD_ALL;
     sc = st->priv_data;
     cur_pos = avio_tell(sc->pb);
+    if (mov_expand_index(st) < 0)
+        return;
 
     for (i = 0; i < st->nb_index_entries; i++) {
         AVIndexEntry *sample = &st->index_entries[i];
@@ -2736,6 +3114,7 @@ static int mov_read_close(AVFormatContext *s)
         MOVStreamContext *sc = st->priv_data;
 
         av_freep(&sc->ctts_data);
+        mov_free_sample_tables(sc);
         for (j = 0; j < sc->drefs_count; j++) {
             av_freep(&sc->drefs[j].path);
             av_freep(&sc->drefs[j].dir);
@@ -2810,8 +3189,8 @@ static AVIndexEntry *mov_find_next_sample(AVFormatContext *s, AVStream **st)
     for (i = 0; i < s->nb_streams; i++) {
         AVStream *avst = s->streams[i];
         MOVStreamContext *msc = avst->priv_data;
-        if (msc->pb && msc->current_sample < avst->nb_index_entries) {
-            AVIndexEntry *current_sample = &avst->index_entries[msc->current_sample];
+        AVIndexEntry *current_sample = mov_current_sample(avst);
+        if (msc->pb && current_sample) {
             int64_t dts = av_rescale(current_sample->timestamp, AV_TIME_BASE, msc->time_scale);
             av_dlog(s, "stream %d, sample %d, dts %"PRId64"\n", i, msc->current_sample, dts);
             if (!sample || (!s->pb->seekable && current_sample->pos < sample->pos) ||
@@ -2832,7 +3211,7 @@ static int mov_read_packet(AVFormatContext *s, AVPacket *pkt)
 {
     MOVContext *mov = s->priv_data;
     MOVStreamContext *sc;
-    AVIndexEntry *sample;
+    AVIndexEntry *sample, current;
     AVStream *st = NULL;
     int ret;
  retry:
@@ -2854,6 +3233,11 @@ static int mov_read_packet(AVFormatContext *s, AVPacket *pkt)
     sc = st->priv_data;
     /* must be done just before reading, to avoid infinite loop on sample */
     sc->current_sample++;
+    if (sc->compact_count) {
+        current = *sample;
+        sample  = &current;
+        mov_cursor_next(sc);
+    }
 
     if (st->discard != AVDISCARD_ALL) {
         if (avio_seek(sc->pb, sample->pos, SEEK_SET) != sample->pos) {
@@ -2861,7 +3245,10 @@ static int mov_read_packet(AVFormatContext *s, AVPacket *pkt)
                    sc->ffindex, sample->pos);
             return AVERROR_INVALIDDATA;
         }
-        ret = av_get_packet(sc->pb, pkt, sample->size);
+        if (mov->dv_demux && sc->dv_audio_container)
+            ret = av_get_packet(sc->pb, pkt, sample->size);
+        else
+            ret = ff_get_packet_mapped(sc->pb, pkt, sample->size);
         if (ret < 0)
             return ret;
         if (sc->has_palette) {
@@ -2901,8 +3288,8 @@ static int mov_read_packet(AVFormatContext *s, AVPacket *pkt)
         if (sc->wrong_dts)
             pkt->dts = AV_NOPTS_VALUE;
     } else {
-        int64_t next_dts = (sc->current_sample < st->nb_index_entries) ?
-            st->index_entries[sc->current_sample].timestamp : st->duration;
+        AVIndexEntry *next = mov_current_sample(st);
+        int64_t next_dts = next ? next->timestamp : st->duration;
         pkt->duration = next_dts - pkt->dts;
         pkt->pts = pkt->dts;
     }
@@ -2921,13 +3308,21 @@ static int mov_seek_stream(AVFormatContext *s, AVStream *st, int64_t timestamp,
     int sample, time_sample;
     int i;
 
-    sample = av_index_search_timestamp(st, timestamp, flags);
+    if (sc->compact_count) {
+        sample = mov_index_search_timestamp(sc, timestamp, flags);
+        if (sample < 0 && timestamp < sc->first_dts)
+            sample = 0;
+    } else {
+        sample = av_index_search_timestamp(st, timestamp, flags);
+        if (sample < 0 && st->nb_index_entries && timestamp < st->index_entries[0].timestamp)
+            sample = 0;
+    }
     av_dlog(s, "stream %d, timestamp %"PRId64", sample %d\n", st->index, timestamp, sample);
-    if (sample < 0 && st->nb_index_entries && timestamp < st->index_entries[0].timestamp)
-        sample = 0;
     if (sample < 0) /* not sure what to do */
         return AVERROR_INVALIDDATA;
     sc->current_sample = sample;
+    if (sc->compact_count)
+        mov_cursor_seek(sc, sample);
     av_dlog(s, "stream %d, found sample %d\n", st->index, sc->current_sample);
     /* adjust ctts index */
     if (sc->ctts_data) {
@@ -2963,7 +3358,7 @@ static int mov_read_seek(AVFormatContext *s, int stream_index, int64_t sample_ti
         return sample;
 
     /* adjust seek timestamp to found sample timestamp */
-    seek_timestamp = st->index_entries[sample].timestamp;
+    seek_timestamp = mov_current_sample(st)->timestamp;
 
     for (i = 0; i < s->nb_streams; i++) {
         st = s->streams[i];
@@ -51,6 +51,7 @@ static const AVOption options[] = {
     { "separate_moof", "Write separate moof/mdat atoms for each track", 0, AV_OPT_TYPE_CONST, {FF_MOV_FLAG_SEPARATE_MOOF}, INT_MIN, INT_MAX, AV_OPT_FLAG_ENCODING_PARAM, "movflags" },
     { "frag_custom", "Flush fragments on caller requests", 0, AV_OPT_TYPE_CONST, {FF_MOV_FLAG_FRAG_CUSTOM}, INT_MIN, INT_MAX, AV_OPT_FLAG_ENCODING_PARAM, "movflags" },
     { "isml", "Create a live smooth streaming feed (for pushing to a publishing point)", 0, AV_OPT_TYPE_CONST, {FF_MOV_FLAG_ISML}, INT_MIN, INT_MAX, AV_OPT_FLAG_ENCODING_PARAM, "movflags" },
+    { "faststart", "Run a second pass to put the moov atom at the start of the file", 0, AV_OPT_TYPE_CONST, {FF_MOV_FLAG_FASTSTART}, INT_MIN, INT_MAX, AV_OPT_FLAG_ENCODING_PARAM, "movflags" },
     FF_RTP_FLAG_OPTS(MOVMuxContext, rtp_flags),
     { "skip_iods", "Skip writing iods atom.", offsetof(MOVMuxContext, iods_skip), AV_OPT_TYPE_INT, {0}, 0, 1, AV_OPT_FLAG_ENCODING_PARAM},
     { "iods_audio_profile", "iods audio profile atom.", offsetof(MOVMuxContext, iods_audio_profile), AV_OPT_TYPE_INT, {-1}, -1, 255, AV_OPT_FLAG_ENCODING_PARAM},
@@ -88,7 +89,8 @@ static int mov_write_stco_tag(AVIOContext *pb, MOVTrack *track)
     int mode64 = 0; //   use 32 bit size variant if possible
     int64_t pos = avio_tell(pb);
     avio_wb32(pb, 0); /* size */
-    if (pos > UINT32_MAX) {
+    if (track->entry &&
+        track->cluster[track->entry - 1].pos + track->data_offset > UINT32_MAX) {
         mode64 = 1;
         ffio_wfourcc(pb, "co64");
     } else
@@ -2667,15 +2669,14 @@ static void mov_parse_vc1_frame(AVPacket *pkt, MOVTrack *trk, int fragment)
 static int mov_flush_fragment(AVFormatContext *s)
 {
     MOVMuxContext *mov = s->priv_data;
-    int i, first_track = -1;
-    int64_t mdat_size = 0;
+    int i, ret, first_track = -1;
+    int64_t mdat_size = 0, written;
 
     if (!(mov->flags & FF_MOV_FLAG_FRAGMENT))
         return 0;
 
     if (!(mov->flags & FF_MOV_FLAG_EMPTY_MOOV) && mov->fragments == 0) {
         int64_t pos = avio_tell(s->pb);
-        int ret;
         AVIOContext *moov_buf;
         uint8_t *buf;
         int buf_size;
@@ -2687,6 +2688,14 @@ static int mov_flush_fragment(AVFormatContext *s)
         if (i < mov->nb_streams)
             return 0;
 
+        /* the mdat size is written before the buffer is copied out */
+        avio_flush(mov->mdat_buf);
+        if ((ret = mov->mdat_buf->error) < 0) {
+            ffio_close_chunked_dyn_buf(mov->mdat_buf, NULL);
+            mov->mdat_buf = NULL;
+            return ret;
+        }
+
         if ((ret = avio_open_dyn_buf(&moov_buf)) < 0)
             return ret;
         mov_write_moov_tag(moov_buf, mov, s);
@@ -2697,12 +2706,12 @@ static int mov_flush_fragment(AVFormatContext *s)
 
         mov_write_moov_tag(s->pb, mov, s);
 
-        buf_size = avio_close_dyn_buf(mov->mdat_buf, &buf);
-        mov->mdat_buf = NULL;
-        avio_wb32(s->pb, buf_size + 8);
+        avio_wb32(s->pb, avio_tell(mov->mdat_buf) + 8);
         ffio_wfourcc(s->pb, "mdat");
-        avio_write(s->pb, buf, buf_size);
-        av_free(buf);
+        written = ffio_close_chunked_dyn_buf(mov->mdat_buf, s->pb);
+        mov->mdat_buf = NULL;
+        if (written < 0)
+            return written;
 
         mov->fragments++;
         mov->mdat_size = 0;
@@ -2725,6 +2734,12 @@ static int mov_flush_fragment(AVFormatContext *s)
             track->data_offset = mdat_size;
         if (!track->mdat_buf)
             continue;
+        avio_flush(track->mdat_buf);
+        if ((ret = track->mdat_buf->error) < 0) {
+            ffio_close_chunked_dyn_buf(track->mdat_buf, NULL);
+            track->mdat_buf = NULL;
+            return ret;
+        }
         mdat_size += avio_tell(track->mdat_buf);
         if (first_track < 0)
             first_track = i;
@@ -2735,8 +2750,7 @@ static int mov_flush_fragment(AVFormatContext *s)
 
     for (i = 0; i < mov->nb_streams; i++) {
         MOVTrack *track = &mov->tracks[i];
-        int buf_size, write_moof = 1, moof_tracks = -1;
-        uint8_t *buf;
+        int write_moof = 1, moof_tracks = -1;
         int64_t duration = 0;
 
         if (track->entry)
@@ -2777,11 +2791,10 @@ static int mov_flush_fragment(AVFormatContext *s)
         track->entry = 0;
         if (!track->mdat_buf)
             continue;
-        buf_size = avio_close_dyn_buf(track->mdat_buf, &buf);
+        written = ffio_close_chunked_dyn_buf(track->mdat_buf, s->pb);
         track->mdat_buf = NULL;
-
-        avio_write(s->pb, buf, buf_size);
-        av_free(buf);
+        if (written < 0)
+            return written;
     }
 
     mov->mdat_size = 0;
@@ -2804,13 +2817,13 @@ int ff_mov_write_packet(AVFormatContext *s, AVPacket *pkt)
         int ret;
         if (mov->fragments > 0) {
             if (!trk->mdat_buf) {
-                if ((ret = avio_open_dyn_buf(&trk->mdat_buf)) < 0)
+                if ((ret = ffio_open_chunked_dyn_buf(&trk->mdat_buf)) < 0)
                     return ret;
             }
             pb = trk->mdat_buf;
         } else {
             if (!mov->mdat_buf) {
-                if ((ret = avio_open_dyn_buf(&mov->mdat_buf)) < 0)
+                if ((ret = ffio_open_chunked_dyn_buf(&mov->mdat_buf)) < 0)
                     return ret;
             }
             pb = mov->mdat_buf;
@@ -2927,8 +2940,8 @@ int ff_mov_write_packet(AVFormatContext *s, AVPacket *pkt)
 static int mov_write_packet(AVFormatContext *s, AVPacket *pkt)
 {
     if (!pkt) {
-        mov_flush_fragment(s);
-        return 1;
+        int ret = mov_flush_fragment(s);
+        return ret < 0 ? ret : 1;
     } else {
         MOVMuxContext *mov = s->priv_data;
         MOVTrack *trk = &mov->tracks[pkt->stream_index];
@@ -2948,8 +2961,11 @@ static int mov_write_packet(AVFormatContext *s, AVPacket *pkt)
              (mov->flags & FF_MOV_FLAG_FRAG_KEYFRAME &&
               enc->codec_type == AVMEDIA_TYPE_VIDEO &&
               trk->entry && pkt->flags & AV_PKT_FLAG_KEY)) {
-            if (frag_duration >= mov->min_fragment_duration)
-                mov_flush_fragment(s);
+            if (frag_duration >= mov->min_fragment_duration) {
+                int ret = mov_flush_fragment(s);
+                if (ret < 0)
+                    return ret;
+            }
         }
 
         return ff_mov_write_packet(s, pkt);
@@ -3144,6 +3160,14 @@ static int mov_write_header(AVFormatContext *s)
                       FF_MOV_FLAG_FRAGMENT;
     }
 
+    if (mov->flags & FF_MOV_FLAG_FASTSTART) {
+        if (mov->flags & FF_MOV_FLAG_FRAGMENT) {
+            av_log(s, AV_LOG_WARNING, "faststart is ignored with fragmented output\n");
+            mov->flags &= ~FF_MOV_FLAG_FASTSTART;
+        } else
+            mov->reserved_moov_pos = avio_tell(pb);
+    }
+
     if (!(mov->flags & FF_MOV_FLAG_FRAGMENT))
         mov_write_mdat_tag(pb, mov);
 
@@ -3183,6 +3207,96 @@ static int mov_write_header(AVFormatContext *s)
     return -1;
 }
 
+static int get_moov_size(AVFormatContext *s)
+{
+    MOVMuxContext *mov = s->priv_data;
+    AVIOContext *moov_buf;
+    uint8_t *buf;
+    int ret, size;
+
+    if ((ret = avio_open_dyn_buf(&moov_buf)) < 0)
+        return ret;
+    mov_write_moov_tag(moov_buf, mov, s);
+    size = avio_close_dyn_buf(moov_buf, &buf);
+    av_free(buf);
+    return size;
+}
+
+/**
+ * Offset the chunks by the size of the moov atom placed in front of them.
+ * @return size of the moov atom
+ */
+static int compute_moov_size(AVFormatContext *s)
+{
+    MOVMuxContext *mov = s->priv_data;
+    int i, moov_size, moov_size2;
+
+    if ((moov_size = get_moov_size(s)) < 0)
+        return moov_size;
+    for (i = 0; i < mov->nb_streams; i++)
+        mov->tracks[i].data_offset += moov_size;
+
+    /* the new offsets may need co64 instead of stco */
+    if ((moov_size2 = get_moov_size(s)) < 0)
+        return moov_size2;
+    for (i = 0; i < mov->nb_streams; i++)
+        mov->tracks[i].data_offset += moov_size2 - moov_size;
+
+    return moov_size2;
+}
+
+#define FASTSTART_BLOCK_SIZE (1 << 20)
+
+/**
+ * Move the data written after reserved_moov_pos forward by shift bytes.
+ */
+static int shift_data(AVFormatContext *s, int shift)
+{
+    MOVMuxContext *mov = s->priv_data;
+    int64_t pos = mov->reserved_moov_pos, pos_end = avio_tell(s->pb);
+    int block_size = FFMAX(shift, FASTSTART_BLOCK_SIZE);
+    int cur = 0, size[2];
+    uint8_t *buf[2];
+    AVIOContext *read_pb;
+    int ret;
+
+    buf[0] = av_malloc(2 * block_size);
+    if (!buf[0])
+        return AVERROR(ENOMEM);
+    buf[1] = buf[0] + block_size;
+
+    /* the output context is write only, read the data back through
+     * a second one */
+    avio_flush(s->pb);
+    if ((ret = avio_open(&read_pb, s->filename, AVIO_FLAG_READ)) < 0) {
+        av_log(s, AV_LOG_ERROR, "Unable to reopen %s for the faststart pass\n",
+               s->filename);
+        goto end;
+    }
+    avio_seek(read_pb, pos, SEEK_SET);
+    avio_seek(s->pb, pos + shift, SEEK_SET);
+
+    /* a block is written only once the next one is read, since it
+     * overwrites up to shift bytes of it */
+    size[cur] = avio_read(read_pb, buf[cur], FFMIN(block_size, pos_end - pos));
+    while (size[cur] > 0) {
+        pos += size[cur];
+        size[!cur] = pos < pos_end ?
+                     avio_read(read_pb, buf[!cur], FFMIN(block_size, pos_end - pos)) : 0;
+        avio_write(s->pb, buf[cur], size[cur]);
+        cur = !cur;
+    }
+    avio_close(read_pb);
+    if (pos != pos_end) {
+        av_log(s, AV_LOG_ERROR, "Short read at %"PRId64" during the faststart pass\n", pos);
+        ret = AVERROR(EIO);
+    }
+
+end:
+    av_free(buf[0]);
+    return ret;
+}
+
 static int mov_write_trailer(AVFormatContext *s)
 {
     MOVMuxContext *mov = s->priv_data;
@@ -3208,12 +3322,25 @@ static int mov_write_trailer(AVFormatContext *s)
         }
         avio_seek(pb, moov_pos, SEEK_SET);
 
+        if (mov->flags & FF_MOV_FLAG_FASTSTART) {
+            av_log(s, AV_LOG_INFO, "Starting second pass: moving the moov atom to the start of the file\n");
+            res = compute_moov_size(s);
+            if (res < 0)
+                goto error;
+            res = shift_data(s, res);
+            if (res < 0)
+                goto error;
+            avio_seek(pb, mov->reserved_moov_pos, SEEK_SET);
+        }
         mov_write_moov_tag(pb, mov, s);
     } else {
-        mov_flush_fragment(s);
+        res = mov_flush_fragment(s);
+        if (res < 0)
+            goto error;
         mov_write_mfra_tag(pb, mov);
     }
 
+error:
     if (mov->chapter_track)
         av_freep(&mov->tracks[mov->chapter_track].enc);
 
@@ -126,6 +126,12 @@ struct MpegTSContext {
 
     /** filters for various streams specified by PMT + for the PAT and PMT */
     MpegTSFilter *pids[NB_PID_MAX];
+
+    /** per pid combination of PID_USED and PID_DISCARDED, according to the
+     *  programs comprising it                                              */
+    uint8_t discard_pids[NB_PID_MAX];
+    /** discard_pids has to be rebuilt before its next use                  */
+    int discard_pids_dirty;
 };
 
 static const AVOption options[] = {
@@ -187,12 +193,14 @@ static void clear_program(MpegTSContext *ts, unsigned int programid)
     for(i=0; i<ts->nb_prg; i++)
         if(ts->prg[i].id == programid)
             ts->prg[i].nb_pids = 0;
+    ts->discard_pids_dirty = 1;
 }
 
 static void clear_programs(MpegTSContext *ts)
 {
     av_freep(&ts->prg);
     ts->nb_prg=0;
+    ts->discard_pids_dirty = 1;
 }
 
 static void add_pat_entry(MpegTSContext *ts, unsigned int programid)
@@ -206,6 +214,7 @@ static void add_pat_entry(MpegTSContext *ts, unsigned int programid)
     p->id = programid;
     p->nb_pids = 0;
     ts->nb_prg++;
+    ts->discard_pids_dirty = 1;
 }
 
 static void add_pid_to_pmt(MpegTSContext *ts, unsigned int programid, unsigned int pid)
@@ -224,6 +233,33 @@ static void add_pid_to_pmt(MpegTSContext *ts, unsigned int programid, unsigned i
     if(p->nb_pids >= MAX_PIDS_PER_PROGRAM)
         return;
     p->pids[p->nb_pids++] = pid;
+    ts->discard_pids_dirty = 1;
+}
+
+#define PID_USED      1
+#define PID_DISCARDED 2
+
+/**
+ * Rebuild the discard_pids table from the programs selection.
+ */
+static void update_discard_pids(MpegTSContext *ts)
+{
+    int i, j, k;
+
+    memset(ts->discard_pids, 0, sizeof(ts->discard_pids));
+    for (i = 0; i < ts->nb_prg; i++) {
+        struct Program *p = &ts->prg[i];
+        for (k = 0; k < ts->stream->nb_programs; k++) {
+            int flag;
+            if (ts->stream->programs[k]->id != p->id)
+                continue;
+            flag = ts->stream->programs[k]->discard == AVDISCARD_ALL ?
+                   PID_DISCARDED : PID_USED;
+            for (j = 0; j < p->nb_pids; j++)
+                ts->discard_pids[p->pids[j]] |= flag;
+        }
+    }
+    ts->discard_pids_dirty = 0;
 }
 
 /**
@@ -236,27 +272,9 @@ static void add_pid_to_pmt(MpegTSContext *ts, unsigned int programid, unsigned i
  */
 static int discard_pid(MpegTSContext *ts, unsigned int pid)
 {
-    int i, j, k;
-    int used = 0, discarded = 0;
-    struct Program *p;
-    for(i=0; i<ts->nb_prg; i++) {
-        p = &ts->prg[i];
-        for(j=0; j<p->nb_pids; j++) {
-            if(p->pids[j] != pid)
-                continue;
-            //is program with id p->id set to be discarded?
-            for(k=0; k<ts->stream->nb_programs; k++) {
-                if(ts->stream->programs[k]->id == p->id) {
-                    if(ts->stream->programs[k]->discard == AVDISCARD_ALL)
-                        discarded++;
-                    else
-                        used++;
-                }
-            }
-        }
-    }
-
-    return !used && discarded;
+    if (ts->discard_pids_dirty)
+        update_discard_pids(ts);
+    return ts->discard_pids[pid] == PID_DISCARDED;
 }
 
 /**
@@ -1725,44 +1743,62 @@ static int handle_packet(MpegTSContext *ts, const uint8_t *packet)
 static int mpegts_resync(AVFormatContext *s)
 {
     AVIOContext *pb = s->pb;
-    int c, i;
-
-    for(i = 0;i < MAX_RESYNC_SIZE; i++) {
-        c = avio_r8(pb);
-        if (pb->eof_reached)
-            return -1;
-        if (c == 0x47) {
-            avio_seek(pb, -1, SEEK_CUR);
+    const uint8_t *sync;
+    int len, i;
+
+    for(i = 0;i < MAX_RESYNC_SIZE; i += len) {
+        if (pb->buf_ptr >= pb->buf_end) {
+            /* refill the IO buffer */
+            int c = avio_r8(pb);
+            if (pb->eof_reached)
+                return -1;
+            if (c == 0x47) {
+                avio_seek(pb, -1, SEEK_CUR);
+                return 0;
+            }
+            len = 1;
+            continue;
+        }
+        /* search the sync byte in what is already buffered */
+        len  = FFMIN(pb->buf_end - pb->buf_ptr, MAX_RESYNC_SIZE - i);
+        sync = memchr(pb->buf_ptr, 0x47, len);
+        if (sync) {
+            avio_skip(pb, sync - pb->buf_ptr);
             return 0;
         }
+        avio_skip(pb, len);
     }
     av_log(s, AV_LOG_ERROR, "max resync size reached, could not find sync byte\n");
     /* no sync found */
     return -1;
 }
 
-/* return -1 if error or EOF. Return 0 if OK. */
-static int read_packet(AVFormatContext *s, uint8_t *buf, int raw_packet_size)
+/**
+ * Read one packet, including its FEC or timestamp bytes if any.
+ * @param buf buffer of at least raw_packet_size bytes, used if the packet
+ *            is not entirely in the IO buffer
+ * @param data set to the packet data, valid until the next read from s->pb
+ * @return -1 if error or EOF. Return 0 if OK.
+ */
+static int read_packet(AVFormatContext *s, uint8_t *buf, int raw_packet_size,
+                       const uint8_t **data)
 {
     AVIOContext *pb = s->pb;
-    int skip, len;
+    int len;
 
     for(;;) {
-        len = avio_read(pb, buf, TS_PACKET_SIZE);
-        if (len != TS_PACKET_SIZE)
+        len = ffio_read_indirect(pb, buf, raw_packet_size, data);
+        if (len < TS_PACKET_SIZE)
             return len < 0 ? len : AVERROR_EOF;
         /* check packet sync byte */
-        if (buf[0] != 0x47) {
+        if ((*data)[0] != 0x47) {
             /* find a new packet start */
-            avio_seek(pb, -TS_PACKET_SIZE, SEEK_CUR);
+            avio_seek(pb, -len, SEEK_CUR);
             if (mpegts_resync(s) < 0)
                 return AVERROR(EAGAIN);
             else
                 continue;
         } else {
-            skip = raw_packet_size - TS_PACKET_SIZE;
-            if (skip > 0)
-                avio_skip(pb, skip);
             break;
         }
     }
@@ -1772,7 +1808,8 @@ static int read_packet(AVFormatContext *s, uint8_t *buf, int raw_packet_size)
 static int handle_packets(MpegTSContext *ts, int nb_packets)
 {
     AVFormatContext *s = ts->stream;
-    uint8_t packet[TS_PACKET_SIZE+FF_INPUT_BUFFER_PADDING_SIZE];
+    uint8_t packet[TS_MAX_PACKET_SIZE + FF_INPUT_BUFFER_PADDING_SIZE];
+    const uint8_t *data;
     int packet_num, ret = 0;
 
     if (avio_tell(s->pb) != ts->last_pos) {
@@ -1792,6 +1829,8 @@ static int handle_packets(MpegTSContext *ts, int nb_packets)
         }
     }
 
+    /* the programs selection may have changed since the last call */
+    ts->discard_pids_dirty = 1;
     ts->stop_parse = 0;
     packet_num = 0;
     memset(packet + TS_PACKET_SIZE, 0, FF_INPUT_BUFFER_PADDING_SIZE);
@@ -1801,10 +1840,10 @@ static int handle_packets(MpegTSContext *ts, int nb_packets)
         packet_num++;
         if (nb_packets != 0 && packet_num >= nb_packets)
             break;
-        ret = read_packet(s, packet, ts->raw_packet_size);
+        ret = read_packet(s, packet, ts->raw_packet_size, &data);
         if (ret != 0)
             break;
-        ret = handle_packet(ts, packet);
+        ret = handle_packet(ts, data);
         if (ret != 0)
             break;
     }
@@ -1907,7 +1946,8 @@ static int mpegts_read_header(AVFormatContext *s)
         int pcr_pid, pid, nb_packets, nb_pcrs, ret, pcr_l;
         int64_t pcrs[2], pcr_h;
         int packet_count[2];
-        uint8_t packet[TS_PACKET_SIZE];
+        uint8_t packet[TS_MAX_PACKET_SIZE];
+        const uint8_t *data;
 
         /* only read packets */
 
@@ -1923,12 +1963,12 @@ static int mpegts_read_header(AVFormatContext *s)
         nb_pcrs = 0;
         nb_packets = 0;
         for(;;) {
-            ret = read_packet(s, packet, ts->raw_packet_size);
+            ret = read_packet(s, packet, ts->raw_packet_size, &data);
             if (ret < 0)
                 return -1;
-            pid = AV_RB16(packet + 1) & 0x1fff;
+            pid = AV_RB16(data + 1) & 0x1fff;
             if ((pcr_pid == -1 || pcr_pid == pid) &&
-                parse_pcr(&pcr_h, &pcr_l, packet) == 0) {
+                parse_pcr(&pcr_h, &pcr_l, data) == 0) {
                 pcr_pid = pid;
                 packet_count[nb_pcrs] = nb_packets;
                 pcrs[nb_pcrs] = pcr_h * 300 + pcr_l;
@@ -1966,15 +2006,18 @@ static int mpegts_raw_read_packet(AVFormatContext *s,
     int64_t pcr_h, next_pcr_h, pos;
     int pcr_l, next_pcr_l;
     uint8_t pcr_buf[12];
+    uint8_t packet[TS_MAX_PACKET_SIZE];
+    const uint8_t *data;
 
     if (av_new_packet(pkt, TS_PACKET_SIZE) < 0)
         return AVERROR(ENOMEM);
     pkt->pos= avio_tell(s->pb);
-    ret = read_packet(s, pkt->data, ts->raw_packet_size);
+    ret = read_packet(s, packet, ts->raw_packet_size, &data);
     if (ret < 0) {
         av_free_packet(pkt);
         return ret;
     }
+    memcpy(pkt->data, data, TS_PACKET_SIZE);
     if (ts->mpeg2ts_compute_pcr) {
         /* compute exact PCR for each packet */
         if (parse_pcr(&pcr_h, &pcr_l, pkt->data) == 0) {
@@ -26,6 +26,7 @@
 #include "libavutil/opt.h"
 #include "libavcodec/mpegvideo.h"
 #include "avformat.h"
+#include "avio_internal.h"
 #include "internal.h"
 #include "mpegts.h"
 
@@ -598,6 +599,12 @@ static int mpegts_write_header(AVFormatContext *s)
             (TS_PACKET_SIZE * 8 * 1000);
 
         ts->first_pcr = av_rescale(s->max_delay, PCR_TIME_BASE, AV_TIME_BASE);
+
+#if CONFIG_UDP_PROTOCOL
+        /* let the udp protocol pace its output at the mux rate */
+        if (ffio_geturlcontext(s->pb))
+            ff_udp_set_bitrate(ffio_geturlcontext(s->pb), ts->mux_rate);
+#endif
     } else {
         /* Arbitrary values, PAT/PMT could be written on key frames */
         ts->sdt_packet_period = 200;
@@ -413,50 +413,126 @@ int av_write_frame(AVFormatContext *s, AVPacket *pkt)
     return ret;
 }
 
-void ff_interleave_add_packet(AVFormatContext *s, AVPacket *pkt,
-                              int (*compare)(AVFormatContext *, AVPacket *, AVPacket *))
+/* return 1 if the first queued packet of stream a is to be muxed before the
+ * first queued packet of stream b */
+static int interleave_heap_less(AVFormatContext *s, int a, int b)
 {
-    AVPacketList **next_point, *this_pktl;
+    return s->interleave_compare(s, &s->streams[b]->first_in_packet_buffer->pkt,
+                                    &s->streams[a]->first_in_packet_buffer->pkt);
+}
+
+static void interleave_heap_sift_up(AVFormatContext *s, int i)
+{
+    int *heap = s->interleave_heap;
 
-    this_pktl      = av_mallocz(sizeof(AVPacketList));
-    this_pktl->pkt = *pkt;
+    while (i > 0) {
+        int parent = (i - 1) >> 1;
+        if (!interleave_heap_less(s, heap[i], heap[parent]))
+            break;
+        FFSWAP(int, heap[i], heap[parent]);
+        i = parent;
+    }
+}
+
+static void interleave_heap_sift_down(AVFormatContext *s, int i)
+{
+    int *heap = s->interleave_heap;
+    int n     = s->nb_interleave_heap;
+
+    for (;;) {
+        int child = 2 * i + 1;
+        if (child >= n)
+            break;
+        if (child + 1 < n && interleave_heap_less(s, heap[child + 1], heap[child]))
+            child++;
+        if (!interleave_heap_less(s, heap[child], heap[i]))
+            break;
+        FFSWAP(int, heap[i], heap[child]);
+        i = child;
+    }
+}
+
+int ff_interleave_add_packet(AVFormatContext *s, AVPacket *pkt,
+                             int (*compare)(AVFormatContext *, AVPacket *, AVPacket *))
+{
+    AVStream *st = s->streams[pkt->stream_index];
+    AVPacketList *this_pktl;
+
+    if (!st->last_in_packet_buffer &&
+        s->nb_interleave_heap >= s->interleave_heap_size) {
+        int *heap = av_realloc(s->interleave_heap,
+                               s->nb_streams * sizeof(*heap));
+        if (!heap) {
+            av_free_packet(pkt);
+            return AVERROR(ENOMEM);
+        }
+        s->interleave_heap      = heap;
+        s->interleave_heap_size = s->nb_streams;
+    }
+
+    if (s->packet_pool) {
+        this_pktl      = s->packet_pool;
+        s->packet_pool = this_pktl->next;
+    } else if (!(this_pktl = av_malloc(sizeof(AVPacketList)))) {
+        av_free_packet(pkt);
+        return AVERROR(ENOMEM);
+    }
+    this_pktl->pkt  = *pkt;
+    this_pktl->next = NULL;
 #if FF_API_DESTRUCT_PACKET
-    pkt->destruct  = NULL;           // do not free original but only the copy
+    pkt->destruct   = NULL;          // do not free original but only the copy
 #endif
-    pkt->buf       = NULL;
+    pkt->buf        = NULL;
     av_dup_packet(&this_pktl->pkt);  // duplicate the packet if it uses non-alloced memory
 
-    if (s->streams[pkt->stream_index]->last_in_packet_buffer) {
-        next_point = &(s->streams[pkt->stream_index]->last_in_packet_buffer->next);
-    } else
-        next_point = &s->packet_buffer;
-
-    if (*next_point) {
-        if (compare(s, &s->packet_buffer_end->pkt, pkt)) {
-            while (!compare(s, &(*next_point)->pkt, pkt))
-                next_point = &(*next_point)->next;
-            goto next_non_null;
-        } else {
-            next_point = &(s->packet_buffer_end->next);
-        }
+    s->interleave_compare = compare;
+    if (st->last_in_packet_buffer) {
+        st->last_in_packet_buffer->next = this_pktl;
+    } else {
+        st->first_in_packet_buffer = this_pktl;
+        s->interleave_heap[s->nb_interleave_heap++] = pkt->stream_index;
+        interleave_heap_sift_up(s, s->nb_interleave_heap - 1);
     }
-    assert(!*next_point);
+    st->last_in_packet_buffer = this_pktl;
+    return 0;
+}
 
-    s->packet_buffer_end = this_pktl;
-next_non_null:
+int ff_interleave_pop_packet(AVFormatContext *s, AVPacket *out)
+{
+    AVStream *st;
+    AVPacketList *pktl;
 
-    this_pktl->next = *next_point;
+    if (!s->nb_interleave_heap)
+        return 0;
+
+    st   = s->streams[s->interleave_heap[0]];
+    pktl = st->first_in_packet_buffer;
+    *out = pktl->pkt;
 
-    s->streams[pkt->stream_index]->last_in_packet_buffer =
-        *next_point                                      = this_pktl;
+    st->first_in_packet_buffer = pktl->next;
+    if (!pktl->next) {
+        st->last_in_packet_buffer = NULL;
+        s->interleave_heap[0] = s->interleave_heap[--s->nb_interleave_heap];
+    }
+    interleave_heap_sift_down(s, 0);
+
+    pktl->next     = s->packet_pool;
+    s->packet_pool = pktl;
+    return 1;
 }
 
 static int ff_interleave_compare_dts(AVFormatContext *s, AVPacket *next, AVPacket *pkt)
 {
     AVStream *st  = s->streams[pkt->stream_index];
     AVStream *st2 = s->streams[next->stream_index];
-    int comp      = av_compare_ts(next->dts, st2->time_base, pkt->dts,
-                                  st->time_base);
+    int comp;
+
+    if (st->time_base.num == st2->time_base.num &&
+        st->time_base.den == st2->time_base.den)
+        comp = (next->dts > pkt->dts) - (next->dts < pkt->dts);
+    else
+        comp = av_compare_ts(next->dts, st2->time_base, pkt->dts,
+                             st->time_base);
 
     if (comp == 0)
         return pkt->stream_index < next->stream_index;
@@ -466,29 +542,18 @@ static int ff_interleave_compare_dts(AVFormatContext *s, AVPacket *next, AVPacke
 int ff_interleave_packet_per_dts(AVFormatContext *s, AVPacket *out,
                                  AVPacket *pkt, int flush)
 {
-    AVPacketList *pktl;
-    int stream_count = 0;
-    int i;
+    int ret;
 
     if (pkt) {
-        ff_interleave_add_packet(s, pkt, ff_interleave_compare_dts);
+        ret = ff_interleave_add_packet(s, pkt, ff_interleave_compare_dts);
+        if (ret < 0)
+            return ret;
     }
 
-    for (i = 0; i < s->nb_streams; i++)
-        stream_count += !!s->streams[i]->last_in_packet_buffer;
-
-    if (stream_count && (s->nb_streams == stream_count || flush)) {
-        pktl = s->packet_buffer;
-        *out = pktl->pkt;
-
-        s->packet_buffer = pktl->next;
-        if (!s->packet_buffer)
-            s->packet_buffer_end = NULL;
-
-        if (s->streams[out->stream_index]->last_in_packet_buffer == pktl)
-            s->streams[out->stream_index]->last_in_packet_buffer = NULL;
-        av_freep(&pktl);
-        return 1;
+    /* the heap holds the streams with queued packets */
+    if (s->nb_interleave_heap &&
+        (s->nb_streams == s->nb_interleave_heap || flush)) {
+        return ff_interleave_pop_packet(s, out);
     } else {
         av_init_packet(out);
         return 0;
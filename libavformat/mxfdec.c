@@ -2042,7 +2042,7 @@ static int mxf_read_packet_old(AVFormatContext *s, AVPacket *pkt)
                     return -1;
                 }
             } else {
-                int ret = av_get_packet(s->pb, pkt, klv.length);
+                int ret = ff_get_packet_mapped(s->pb, pkt, klv.length);
                 if (ret < 0)
                     return ret;
             }
@@ -2118,7 +2118,7 @@ static int mxf_read_packet(AVFormatContext *s, AVPacket *pkt)
     if ((ret64 = avio_seek(s->pb, pos, SEEK_SET)) < 0)
         return ret64;
 
-        if ((ret = av_get_packet(s->pb, pkt, size)) != size)
+        if ((ret = ff_get_packet_mapped(s->pb, pkt, size)) != size)
             return ret < 0 ? ret : AVERROR_EOF;
 
     if (st->codec->codec_type == AVMEDIA_TYPE_VIDEO && t->ptses &&
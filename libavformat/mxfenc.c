@@ -1816,53 +1816,55 @@ static int mxf_write_footer(AVFormatContext *s)
     return 0;
 }
 
-static int mxf_interleave_get_packet(AVFormatContext *s, AVPacket *out, AVPacket *pkt, int flush)
+static int mxf_compare_timestamps(AVFormatContext *s, AVPacket *next, AVPacket *pkt)
 {
-    int i, stream_count = 0;
+    MXFStreamContext *sc  = s->streams[pkt ->stream_index]->priv_data;
+    MXFStreamContext *sc2 = s->streams[next->stream_index]->priv_data;
 
-    for (i = 0; i < s->nb_streams; i++)
-        stream_count += !!s->streams[i]->last_in_packet_buffer;
+    return next->dts > pkt->dts ||
+        (next->dts == pkt->dts && sc->order < sc2->order);
+}
+
+static int mxf_interleave_get_packet(AVFormatContext *s, AVPacket *out, AVPacket *pkt, int flush)
+{
+    int stream_count = s->nb_interleave_heap;
 
     if (stream_count && (s->nb_streams == stream_count || flush)) {
-        AVPacketList *pktl = s->packet_buffer;
         if (s->nb_streams != stream_count) {
-            AVPacketList *last = NULL;
-            // find last packet in edit unit
-            while (pktl) {
-                if (!stream_count || pktl->pkt.stream_index == 0)
-                    break;
-                last = pktl;
-                pktl = pktl->next;
-                stream_count--;
+            AVPacket *edit_unit = av_malloc((stream_count + 1) * sizeof(*edit_unit));
+            int i, ret, nb = 0, done = 0;
+
+            if (!edit_unit)
+                return AVERROR(ENOMEM);
+            // keep the packets up to the last one of the edit unit,
+            // purge the rest of the packet queue
+            while (ff_interleave_pop_packet(s, &edit_unit[nb])) {
+                if (!done && nb < stream_count && edit_unit[nb].stream_index != 0)
+                    nb++;
+                else {
+                    done = 1;
+                    av_free_packet(&edit_unit[nb]);
+                }
             }
-            // purge packet queue
-            while (pktl) {
-                AVPacketList *next = pktl->next;
-
-                if(s->streams[pktl->pkt.stream_index]->last_in_packet_buffer == pktl)
-                    s->streams[pktl->pkt.stream_index]->last_in_packet_buffer= NULL;
-                av_free_packet(&pktl->pkt);
-                av_freep(&pktl);
-                pktl = next;
+            for (i = 1; i < nb; i++) {
+                ret = ff_interleave_add_packet(s, &edit_unit[i], mxf_compare_timestamps);
+                if (ret < 0) {
+                    while (++i < nb)
+                        av_free_packet(&edit_unit[i]);
+                    av_free_packet(&edit_unit[0]);
+                    av_free(edit_unit);
+                    return ret;
+                }
             }
-            if (last)
-                last->next = NULL;
-            else {
-                s->packet_buffer = NULL;
-                s->packet_buffer_end= NULL;
+            if (nb)
+                *out = edit_unit[0];
+            av_free(edit_unit);
+            if (!nb)
                 goto out;
-            }
-            pktl = s->packet_buffer;
-        }
+        } else
+            ff_interleave_pop_packet(s, out);
 
-        *out = pktl->pkt;
         av_dlog(s, "out st:%d dts:%lld\n", (*out).stream_index, (*out).dts);
-        s->packet_buffer = pktl->next;
-        if(s->streams[pktl->pkt.stream_index]->last_in_packet_buffer == pktl)
-            s->streams[pktl->pkt.stream_index]->last_in_packet_buffer= NULL;
-        if(!s->packet_buffer)
-            s->packet_buffer_end= NULL;
-        av_freep(&pktl);
         return 1;
     } else {
     out:
@@ -1871,15 +1873,6 @@ static int mxf_interleave_get_packet(AVFormatContext *s, AVPacket *out, AVPacket
     }
 }
 
-static int mxf_compare_timestamps(AVFormatContext *s, AVPacket *next, AVPacket *pkt)
-{
-    MXFStreamContext *sc  = s->streams[pkt ->stream_index]->priv_data;
-    MXFStreamContext *sc2 = s->streams[next->stream_index]->priv_data;
-
-    return next->dts > pkt->dts ||
-        (next->dts == pkt->dts && sc->order < sc2->order);
-}
-
 static int mxf_interleave(AVFormatContext *s, AVPacket *out, AVPacket *pkt, int flush)
 {
     return ff_audio_rechunk_interleave(s, out, pkt, flush,
@@ -25,16 +25,27 @@
  */
 
 #define _BSD_SOURCE     /* Needed for using struct ip_mreq with recent glibc */
+#define _GNU_SOURCE     /* Needed for recvmmsg() and sendmmsg() */
 
 #include "avformat.h"
 #include "avio_internal.h"
+#include "libavutil/fifo.h"
+#include "libavutil/intreadwrite.h"
+#include "libavutil/mathematics.h"
 #include "libavutil/parseutils.h"
 #include "libavutil/avstring.h"
+#include "libavutil/time.h"
 #include "internal.h"
 #include "network.h"
 #include "os_support.h"
 #include "url.h"
 
+#if HAVE_PTHREADS
+#include <pthread.h>
+#elif HAVE_W32THREADS
+#include "libavcodec/w32pthreads.h"
+#endif
+
 #ifndef IPV6_ADD_MEMBERSHIP
 #define IPV6_ADD_MEMBERSHIP IPV6_JOIN_GROUP
 #define IPV6_DROP_MEMBERSHIP IPV6_LEAVE_GROUP
@@ -50,10 +61,45 @@ typedef struct {
     struct sockaddr_storage dest_addr;
     int dest_addr_len;
     int is_connected;
+
+    /* input circular buffer, filled by a separate receiving thread */
+    int circular_buffer_size;
+    int overrun_nonfatal;
+    AVFifoBuffer *fifo;         ///< datagrams, each preceded by its 32-bit size
+    uint8_t *recv_buf;          ///< UDP_RECV_BATCH slots of recv_slot_size bytes
+    int recv_slot_size;
+    int circular_buffer_error;
+    int close_req;
+    int overrun_count;          ///< datagrams dropped in the current overrun
+    int64_t overrun_total;
+    /* output batching and pacing */
+    int batch_size;
+    uint8_t *send_buf;          ///< batch_size slots of send_slot_size bytes
+    int send_slot_size;
+    int *send_lens;
+    int nb_queued;
+    int pacing;
+    int64_t bitrate;            ///< pacing rate in bits per second, 0 if unknown
+    int64_t pacing_start;       ///< time at which pacing_bytes started being sent
+    int64_t pacing_bytes;
+
+#if HAVE_THREADS
+    int thread_started;
+    pthread_t circular_buffer_thread;
+    pthread_mutex_t mutex;
+    pthread_cond_t cond;
+#endif
 } UDPContext;
 
 #define UDP_TX_BUF_SIZE 32768
 #define UDP_MAX_PKT_SIZE 65536
+/* maximum number of datagrams received per system call */
+#define UDP_RECV_BATCH 32
+/* maximum number of datagrams sent per system call */
+#define UDP_SEND_BATCH 64
+#define UDP_MAX_SEND_BATCH 1024
+/* when the output is late by more than this, restart pacing from now */
+#define UDP_MAX_PACING_LAG 1000000
 
 static void log_net_error(void *ctx, int level, const char* prefix)
 {
@@ -317,6 +363,11 @@ static int udp_port(struct sockaddr_storage *addr, int addr_len)
  *         'localport=n' : set the local port
  *         'pkt_size=n'  : set max packet size
  *         'reuse=1'     : enable reusing the socket
+ *         'fifo_size=n' : receive into a circular buffer of n*188 bytes
+ *         'overrun_nonfatal=1' : drop datagrams on buffer overrun
+ *         'batch_size=n': send up to n datagrams per system call
+ *         'pacing=1'    : spread the datagrams evenly at the bitrate
+ *         'bitrate=n'   : set the pacing bitrate in bits per second
  *
  * @param h media file context
  * @param uri of the remote server
@@ -367,6 +418,29 @@ int ff_udp_get_local_port(URLContext *h)
     return s->local_port;
 }
 
+/**
+ * Set the bitrate used for pacing the output, unless one has been set with
+ * the bitrate URL option.
+ * @param h media file context
+ * @param bitrate bits per second
+ * @return zero if no error.
+ */
+int ff_udp_set_bitrate(URLContext *h, int64_t bitrate)
+{
+    UDPContext *s;
+
+    if (strcmp(h->prot->name, "udp") || bitrate <= 0)
+        return AVERROR(EINVAL);
+    s = h->priv_data;
+    if (!s->bitrate) {
+        s->bitrate = bitrate;
+        if (s->pacing)
+            av_log(h, AV_LOG_VERBOSE, "Pacing the output at %"PRId64
+                   " bits/s\n", bitrate);
+    }
+    return 0;
+}
+
 /**
  * Return the udp file handle for select() usage to wait for several RTP
  * streams at the same time.
@@ -378,6 +452,128 @@ static int udp_get_file_handle(URLContext *h)
     return s->udp_fd;
 }
 
+#if HAVE_THREADS
+/**
+ * Receive up to UDP_RECV_BATCH pending datagrams into s->recv_buf.
+ * @return the number of datagrams received, their sizes are set in lens
+ */
+static int udp_recv_batch(UDPContext *s, int *lens)
+{
+    int i, ret;
+#if HAVE_RECVMMSG
+    struct mmsghdr msgs[UDP_RECV_BATCH];
+    struct iovec iovs[UDP_RECV_BATCH];
+
+    memset(msgs, 0, sizeof(msgs));
+    for (i = 0; i < UDP_RECV_BATCH; i++) {
+        iovs[i].iov_base           = s->recv_buf + i * s->recv_slot_size;
+        iovs[i].iov_len            = s->recv_slot_size;
+        msgs[i].msg_hdr.msg_iov    = &iovs[i];
+        msgs[i].msg_hdr.msg_iovlen = 1;
+    }
+    ret = recvmmsg(s->udp_fd, msgs, UDP_RECV_BATCH, 0, NULL);
+    if (ret < 0)
+        return ff_neterrno();
+    for (i = 0; i < ret; i++)
+        lens[i] = msgs[i].msg_len;
+    return ret;
+#else
+    for (i = 0; i < UDP_RECV_BATCH; i++) {
+        ret = recv(s->udp_fd, s->recv_buf + i * s->recv_slot_size,
+                   s->recv_slot_size, 0);
+        if (ret < 0) {
+            ret = ff_neterrno();
+            return i ? i : ret;
+        }
+        lens[i] = ret;
+    }
+    return i;
+#endif
+}
+
+static void *circular_buffer_task(void *arg)
+{
+    URLContext *h = arg;
+    UDPContext *s = h->priv_data;
+    int lens[UDP_RECV_BATCH];
+
+    pthread_mutex_lock(&s->mutex);
+    while (!s->close_req) {
+        int i, ret;
+
+        pthread_mutex_unlock(&s->mutex);
+        ret = ff_network_wait_fd(s->udp_fd, 0);
+        if (!ret)
+            ret = udp_recv_batch(s, lens);
+        pthread_mutex_lock(&s->mutex);
+
+        if (ret < 0) {
+            if (ret != AVERROR(EAGAIN) && ret != AVERROR(EINTR)) {
+                s->circular_buffer_error = ret;
+                break;
+            }
+            /* wake up blocked readers so that they can check for interrupts */
+            pthread_cond_signal(&s->cond);
+            continue;
+        }
+
+        for (i = 0; i < ret; i++) {
+            uint8_t size[4];
+
+            if (av_fifo_space(s->fifo) < lens[i] + 4) {
+                if (!s->overrun_nonfatal) {
+                    av_log(h, AV_LOG_ERROR, "Circular buffer overrun. "
+                           "Increase the fifo_size URL option to avoid it, "
+                           "or set overrun_nonfatal to drop the excess "
+                           "datagrams instead.\n");
+                    s->circular_buffer_error = AVERROR(EIO);
+                    goto end;
+                }
+                if (!s->overrun_count++)
+                    av_log(h, AV_LOG_WARNING,
+                           "Circular buffer overrun, dropping datagrams\n");
+                s->overrun_total++;
+                continue;
+            }
+            if (s->overrun_count) {
+                av_log(h, AV_LOG_WARNING, "Circular buffer overrun: %d "
+                       "datagrams dropped, %"PRId64" in total\n",
+                       s->overrun_count, s->overrun_total);
+                s->overrun_count = 0;
+            }
+            AV_WL32(size, lens[i]);
+            av_fifo_generic_write(s->fifo, size, 4, NULL);
+            av_fifo_generic_write(s->fifo, s->recv_buf + i * s->recv_slot_size,
+                                  lens[i], NULL);
+        }
+        pthread_cond_signal(&s->cond);
+    }
+
+end:
+    pthread_cond_signal(&s->cond);
+    pthread_mutex_unlock(&s->mutex);
+    return NULL;
+}
+#endif
+
+static void udp_free_circular_buffer(UDPContext *s)
+{
+#if HAVE_THREADS
+    if (s->thread_started) {
+        pthread_mutex_lock(&s->mutex);
+        s->close_req = 1;
+        pthread_mutex_unlock(&s->mutex);
+        pthread_join(s->circular_buffer_thread, NULL);
+        pthread_mutex_destroy(&s->mutex);
+        pthread_cond_destroy(&s->cond);
+        s->thread_started = 0;
+    }
+#endif
+    av_fifo_free(s->fifo);
+    s->fifo = NULL;
+    av_freep(&s->recv_buf);
+}
+
 /* put it in UDP context */
 /* return non zero if error */
 static int udp_open(URLContext *h, const char *uri, int flags)
@@ -401,6 +597,8 @@ static int udp_open(URLContext *h, const char *uri, int flags)
 
     s->ttl = 16;
     s->buffer_size = is_output ? UDP_TX_BUF_SIZE : UDP_MAX_PKT_SIZE;
+    s->circular_buffer_size = 0;
+    s->batch_size = 1;
 
     p = strchr(uri, '?');
     if (p) {
@@ -430,6 +628,43 @@ static int udp_open(URLContext *h, const char *uri, int flags)
         if (av_find_info_tag(buf, sizeof(buf), "localaddr", p)) {
             av_strlcpy(localaddr, buf, sizeof(localaddr));
         }
+        if (av_find_info_tag(buf, sizeof(buf), "fifo_size", p)) {
+            s->circular_buffer_size = strtol(buf, NULL, 10);
+            if (s->circular_buffer_size < 0 ||
+                s->circular_buffer_size > INT_MAX / 188) {
+                av_log(h, AV_LOG_ERROR, "Invalid fifo_size\n");
+                goto fail;
+            }
+            s->circular_buffer_size *= 188;
+        }
+        if (av_find_info_tag(buf, sizeof(buf), "batch_size", p)) {
+            s->batch_size = strtol(buf, NULL, 10);
+            if (s->batch_size < 1 || s->batch_size > UDP_MAX_SEND_BATCH) {
+                av_log(h, AV_LOG_ERROR, "Invalid batch_size\n");
+                goto fail;
+            }
+        }
+        if (av_find_info_tag(buf, sizeof(buf), "pacing", p)) {
+            char *endptr = NULL;
+            s->pacing = strtol(buf, &endptr, 10);
+            /* assume if no digits were found it is a request to enable it */
+            if (buf == endptr)
+                s->pacing = 1;
+        }
+        if (av_find_info_tag(buf, sizeof(buf), "bitrate", p)) {
+            s->bitrate = strtoll(buf, NULL, 10);
+            if (s->bitrate < 0) {
+                av_log(h, AV_LOG_ERROR, "Invalid bitrate\n");
+                goto fail;
+            }
+        }
+        if (av_find_info_tag(buf, sizeof(buf), "overrun_nonfatal", p)) {
+            char *endptr = NULL;
+            s->overrun_nonfatal = strtol(buf, &endptr, 10);
+            /* assume if no digits were found it is a request to enable it */
+            if (buf == endptr)
+                s->overrun_nonfatal = 1;
+        }
         if (av_find_info_tag(buf, sizeof(buf), "sources", p))
             include = 1;
         if (include || av_find_info_tag(buf, sizeof(buf), "block", p)) {
@@ -552,8 +787,46 @@ static int udp_open(URLContext *h, const char *uri, int flags)
         av_free(sources[i]);
 
     s->udp_fd = udp_fd;
+
+    if (is_output && (s->batch_size > 1 || s->pacing)) {
+        s->send_slot_size = h->max_packet_size;
+        s->send_buf  = av_malloc(s->batch_size * s->send_slot_size);
+        s->send_lens = av_malloc(s->batch_size * sizeof(*s->send_lens));
+        if (!s->send_buf || !s->send_lens)
+            goto fail;
+    }
+
+    if (!is_output && s->circular_buffer_size) {
+#if HAVE_THREADS
+        int ret;
+
+        s->recv_slot_size = FFMIN(FFMAX(h->max_packet_size, 1472),
+                                  UDP_MAX_PKT_SIZE);
+        s->recv_buf = av_malloc(UDP_RECV_BATCH * s->recv_slot_size);
+        s->fifo     = av_fifo_alloc(s->circular_buffer_size);
+        if (!s->recv_buf || !s->fifo)
+            goto fail;
+        pthread_mutex_init(&s->mutex, NULL);
+        pthread_cond_init(&s->cond, NULL);
+        ret = pthread_create(&s->circular_buffer_thread, NULL,
+                             circular_buffer_task, h);
+        if (ret) {
+            av_log(h, AV_LOG_ERROR, "pthread_create failed\n");
+            pthread_mutex_destroy(&s->mutex);
+            pthread_cond_destroy(&s->cond);
+            goto fail;
+        }
+        s->thread_started = 1;
+#else
+        av_log(h, AV_LOG_WARNING, "fifo_size is not supported without "
+               "thread support, ignoring it\n");
+#endif
+    }
     return 0;
  fail:
+    udp_free_circular_buffer(s);
+    av_freep(&s->send_buf);
+    av_freep(&s->send_lens);
     if (udp_fd >= 0)
         closesocket(udp_fd);
     for (i = 0; i < num_sources; i++)
@@ -566,6 +839,38 @@ static int udp_read(URLContext *h, uint8_t *buf, int size)
     UDPContext *s = h->priv_data;
     int ret;
 
+#if HAVE_THREADS
+    if (s->fifo) {
+        pthread_mutex_lock(&s->mutex);
+        if (!av_fifo_size(s->fifo) && !s->circular_buffer_error &&
+            !(h->flags & AVIO_FLAG_NONBLOCK))
+            /* the thread signals at least every 100 ms */
+            pthread_cond_wait(&s->cond, &s->mutex);
+        if (av_fifo_size(s->fifo)) {
+            uint8_t tmp[4];
+            int len;
+
+            av_fifo_generic_read(s->fifo, tmp, 4, NULL);
+            len = AV_RL32(tmp);
+            if (len > size) {
+                av_log(h, AV_LOG_WARNING, "Part of datagram lost due to "
+                       "insufficient buffer size\n");
+                av_fifo_generic_read(s->fifo, buf, size, NULL);
+                av_fifo_drain(s->fifo, len - size);
+                len = size;
+            } else {
+                av_fifo_generic_read(s->fifo, buf, len, NULL);
+            }
+            ret = len;
+        } else {
+            ret = s->circular_buffer_error ? s->circular_buffer_error
+                                           : AVERROR(EAGAIN);
+        }
+        pthread_mutex_unlock(&s->mutex);
+        return ret;
+    }
+#endif
+
     if (!(h->flags & AVIO_FLAG_NONBLOCK)) {
         ret = ff_network_wait_fd(s->udp_fd, 0);
         if (ret < 0)
@@ -575,17 +880,10 @@ static int udp_read(URLContext *h, uint8_t *buf, int size)
     return ret < 0 ? ff_neterrno() : ret;
 }
 
-static int udp_write(URLContext *h, const uint8_t *buf, int size)
+static int udp_send(UDPContext *s, const uint8_t *buf, int size)
 {
-    UDPContext *s = h->priv_data;
     int ret;
 
-    if (!(h->flags & AVIO_FLAG_NONBLOCK)) {
-        ret = ff_network_wait_fd(s->udp_fd, 1);
-        if (ret < 0)
-            return ret;
-    }
-
     if (!s->is_connected) {
         ret = sendto (s->udp_fd, buf, size, 0,
                       (struct sockaddr *) &s->dest_addr,
@@ -596,10 +894,119 @@ static int udp_write(URLContext *h, const uint8_t *buf, int size)
     return ret < 0 ? ff_neterrno() : ret;
 }
 
+/**
+ * Send all the queued datagrams, using as few system calls as possible.
+ * Datagrams that cannot be sent because of an error are dropped.
+ */
+static int udp_flush_queue(UDPContext *s)
+{
+    int i = 0, ret = 0;
+
+#if HAVE_SENDMMSG
+    while (i < s->nb_queued) {
+        struct mmsghdr msgs[UDP_SEND_BATCH];
+        struct iovec iovs[UDP_SEND_BATCH];
+        int j, n = FFMIN(s->nb_queued - i, UDP_SEND_BATCH);
+
+        memset(msgs, 0, n * sizeof(*msgs));
+        for (j = 0; j < n; j++) {
+            iovs[j].iov_base           = s->send_buf + (i + j) * s->send_slot_size;
+            iovs[j].iov_len            = s->send_lens[i + j];
+            msgs[j].msg_hdr.msg_iov    = &iovs[j];
+            msgs[j].msg_hdr.msg_iovlen = 1;
+            if (!s->is_connected) {
+                msgs[j].msg_hdr.msg_name    = &s->dest_addr;
+                msgs[j].msg_hdr.msg_namelen = s->dest_addr_len;
+            }
+        }
+        ret = sendmmsg(s->udp_fd, msgs, n, 0);
+        if (ret < 0) {
+            ret = ff_neterrno();
+            if (ret == AVERROR(EINTR))
+                continue;
+            break;
+        }
+        i += ret;
+    }
+#else
+    for (; i < s->nb_queued; i++) {
+        ret = udp_send(s, s->send_buf + i * s->send_slot_size, s->send_lens[i]);
+        if (ret < 0)
+            break;
+    }
+#endif
+    s->nb_queued = 0;
+    return ret < 0 ? ret : 0;
+}
+
+static int udp_write_queued(URLContext *h, const uint8_t *buf, int size)
+{
+    UDPContext *s = h->priv_data;
+    int ret;
+
+    if (size > s->send_slot_size) {
+        if ((ret = udp_flush_queue(s)) < 0)
+            return ret;
+        return udp_send(s, buf, size);
+    }
+
+    if (s->pacing && s->bitrate) {
+        int64_t now = av_gettime();
+        int64_t due = s->pacing_start +
+                      av_rescale(s->pacing_bytes, 8 * 1000000, s->bitrate);
+
+        if (!s->pacing_bytes || now - due > UDP_MAX_PACING_LAG) {
+            s->pacing_start = due = now;
+            s->pacing_bytes = 0;
+        }
+        if (due > now) {
+            if ((ret = udp_flush_queue(s)) < 0)
+                return ret;
+            av_usleep(due - now);
+        }
+        s->pacing_bytes += size;
+    }
+
+    memcpy(s->send_buf + s->nb_queued * s->send_slot_size, buf, size);
+    s->send_lens[s->nb_queued++] = size;
+
+    /* when pacing, only keep queueing while the output is late */
+    if (s->nb_queued >= s->batch_size ||
+        (s->pacing && s->bitrate &&
+         s->pacing_start + av_rescale(s->pacing_bytes, 8 * 1000000, s->bitrate) >
+         av_gettime())) {
+        if ((ret = udp_flush_queue(s)) < 0)
+            return ret;
+    }
+    return size;
+}
+
+static int udp_write(URLContext *h, const uint8_t *buf, int size)
+{
+    UDPContext *s = h->priv_data;
+    int ret;
+
+    if (s->send_buf)
+        return udp_write_queued(h, buf, size);
+
+    if (!(h->flags & AVIO_FLAG_NONBLOCK)) {
+        ret = ff_network_wait_fd(s->udp_fd, 1);
+        if (ret < 0)
+            return ret;
+    }
+    return udp_send(s, buf, size);
+}
+
 static int udp_close(URLContext *h)
 {
     UDPContext *s = h->priv_data;
 
+    udp_free_circular_buffer(s);
+    if (s->send_buf) {
+        udp_flush_queue(s);
+        av_freep(&s->send_buf);
+        av_freep(&s->send_lens);
+    }
     if (s->is_multicast && (h->flags & AVIO_FLAG_READ))
         udp_leave_multicast_group(s->udp_fd, (struct sockaddr *)&s->dest_addr);
     closesocket(s->udp_fd);
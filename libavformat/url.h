@@ -28,6 +28,7 @@
 #include "avio.h"
 #include "libavformat/version.h"
 
+#include "libavutil/buffer.h"
 #include "libavutil/dict.h"
 #include "libavutil/log.h"
 
@@ -88,6 +89,12 @@ typedef struct URLProtocol {
     const AVClass *priv_data_class;
     int flags;
     int (*url_check)(URLContext *h, int mask);
+    /**
+     * Return a new reference to a read-only mapping of the whole resource
+     * in *buf and the size of the mapping, or a negative error code if
+     * the resource is not mapped.
+     */
+    int64_t (*url_get_mapping)(URLContext *h, AVBufferRef **buf);
 } URLProtocol;
 
 /**
@@ -203,6 +210,16 @@ int64_t ffurl_size(URLContext *h);
  */
 int ffurl_get_file_handle(URLContext *h);
 
+/**
+ * Return a reference to a read-only memory mapping of the whole resource.
+ *
+ * @param buf set to a new reference to the mapping, which starts at offset
+ *            0 of the resource; it must be unreferenced by the caller
+ * @return the size of the mapping in bytes, or <0 on error (e.g.
+ *         AVERROR(ENOSYS) if the resource is not mapped)
+ */
+int64_t ffurl_get_mapping(URLContext *h, AVBufferRef **buf);
+
 /**
  * Return the file descriptors associated with this URL.
  *
@@ -245,5 +262,6 @@ URLProtocol *ffurl_protocol_next(URLProtocol *prev);
 /* udp.c */
 int ff_udp_set_remote_url(URLContext *h, const char *uri);
 int ff_udp_get_local_port(URLContext *h);
+int ff_udp_set_bitrate(URLContext *h, int64_t bitrate);
 
 #endif /* AVFORMAT_URL_H */
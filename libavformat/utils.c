@@ -233,6 +233,25 @@ int av_get_packet(AVIOContext *s, AVPacket *pkt, int size)
     return ret;
 }
 
+int ff_get_packet_mapped(AVIOContext *s, AVPacket *pkt, int size)
+{
+    AVBufferRef *buf;
+    uint8_t *data;
+    int64_t pos = avio_tell(s);
+    int ret = ffio_read_mapped(s, &buf, &data, size);
+
+    if (ret <= 0)
+        return ret < 0 ? ret : av_get_packet(s, pkt, size);
+
+    av_init_packet(pkt);
+    pkt->buf  = buf;
+    pkt->data = data;
+    pkt->size = size;
+    pkt->pos  = pos;
+
+    return size;
+}
+
 int av_append_packet(AVIOContext *s, AVPacket *pkt, int size)
 {
     int ret;
@@ -1447,6 +1466,10 @@ int ff_index_search_timestamp(const AVIndexEntry *entries, int nb_entries,
 int av_index_search_timestamp(AVStream *st, int64_t wanted_timestamp,
                               int flags)
 {
+    if (st->build_index) {
+        st->build_index(st);
+        st->build_index = NULL;
+    }
     return ff_index_search_timestamp(st->index_entries, st->nb_index_entries,
                                      wanted_timestamp, flags);
 }
@@ -2675,6 +2698,7 @@ void avformat_free_context(AVFormatContext *s)
     for(i=0;i<s->nb_streams;i++) {
         /* free all data in a stream component */
         st = s->streams[i];
+        free_packet_buffer(&st->first_in_packet_buffer, &st->last_in_packet_buffer);
         if (st->parser) {
             av_parser_close(st->parser);
         }
@@ -2703,6 +2727,12 @@ void avformat_free_context(AVFormatContext *s)
     av_freep(&s->chapters);
     av_dict_free(&s->metadata);
     av_freep(&s->streams);
+    av_freep(&s->interleave_heap);
+    while (s->packet_pool) {
+        AVPacketList *pktl = s->packet_pool;
+        s->packet_pool = pktl->next;
+        av_free(pktl);
+    }
     av_free(s);
 }
 
@@ -0,0 +1,191 @@
+/*
+ * This file is part of Libav.
+ *
+ * Libav is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation; either
+ * version 2.1 of the License, or (at your option) any later version.
+ *
+ * Libav is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with Libav; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA
+ */
+
+/**
+ * @file
+ * Worker threads for scaling the bands of an image concurrently
+ */
+
+#include "config.h"
+
+#include "libavutil/common.h"
+#include "libavutil/mem.h"
+
+#include "swscale_internal.h"
+
+#if HAVE_PTHREADS
+#include <pthread.h>
+#elif HAVE_W32THREADS
+#include "libavcodec/w32pthreads.h"
+#endif
+
+typedef struct ThreadContext {
+    SwsContext *ctx;
+
+    int nb_threads;                 ///< worker threads plus the calling thread
+    pthread_t *workers;
+
+    /* parameters of the current ff_sws_execute() call */
+    sws_job_func *func;
+    void *arg;
+    int *rets;
+    int nb_rets;
+    int nb_jobs;
+
+    int current_job;                ///< next job to hand out
+    int finished;                   ///< number of jobs completed
+
+    pthread_cond_t current_job_cond; ///< signaled when jobs are submitted or the threads should exit
+    pthread_cond_t last_job_cond;   ///< signaled when the last job of a batch completes
+    pthread_mutex_t current_job_lock;
+    int done;
+} ThreadContext;
+
+/**
+ * Run the next job of the current batch. Must be called with
+ * current_job_lock held, returns with it held.
+ */
+static void run_job(ThreadContext *c)
+{
+    int jobnr = c->current_job++;
+
+    pthread_mutex_unlock(&c->current_job_lock);
+    c->rets[jobnr % c->nb_rets] = c->func(c->ctx, c->arg, jobnr, c->nb_jobs);
+    pthread_mutex_lock(&c->current_job_lock);
+
+    if (++c->finished == c->nb_jobs)
+        pthread_cond_signal(&c->last_job_cond);
+}
+
+static void* attribute_align_arg worker(void *v)
+{
+    ThreadContext *c = v;
+
+    pthread_mutex_lock(&c->current_job_lock);
+    for (;;) {
+        while (c->current_job >= c->nb_jobs && !c->done)
+            pthread_cond_wait(&c->current_job_cond, &c->current_job_lock);
+        if (c->done)
+            break;
+        run_job(c);
+    }
+    pthread_mutex_unlock(&c->current_job_lock);
+
+    return NULL;
+}
+
+void ff_sws_execute(SwsContext *ctx, sws_job_func *func, void *arg,
+                    int *rets, int nb_jobs)
+{
+    ThreadContext *c = ctx->thread;
+    int dummy_ret;
+
+    if (nb_jobs <= 0)
+        return;
+
+    pthread_mutex_lock(&c->current_job_lock);
+
+    c->func = func;
+    c->arg  = arg;
+    if (rets) {
+        c->rets    = rets;
+        c->nb_rets = nb_jobs;
+    } else {
+        c->rets    = &dummy_ret;
+        c->nb_rets = 1;
+    }
+    c->finished    = 0;
+    c->current_job = 0;
+    c->nb_jobs     = nb_jobs;
+
+    if (nb_jobs > 1)
+        pthread_cond_broadcast(&c->current_job_cond);
+
+    while (c->current_job < c->nb_jobs)
+        run_job(c);
+    while (c->finished < c->nb_jobs)
+        pthread_cond_wait(&c->last_job_cond, &c->current_job_lock);
+
+    pthread_mutex_unlock(&c->current_job_lock);
+}
+
+static void thread_uninit(ThreadContext *c)
+{
+    int i;
+
+    pthread_mutex_lock(&c->current_job_lock);
+    c->done = 1;
+    pthread_cond_broadcast(&c->current_job_cond);
+    pthread_mutex_unlock(&c->current_job_lock);
+
+    for (i = 0; i < c->nb_threads - 1; i++)
+        pthread_join(c->workers[i], NULL);
+
+    pthread_mutex_destroy(&c->current_job_lock);
+    pthread_cond_destroy(&c->current_job_cond);
+    pthread_cond_destroy(&c->last_job_cond);
+    av_freep(&c->workers);
+}
+
+int ff_sws_thread_init(SwsContext *ctx, int nb_threads)
+{
+    ThreadContext *c;
+    int i, ret;
+
+#if HAVE_W32THREADS
+    w32thread_init();
+#endif
+
+    c = ctx->thread = av_mallocz(sizeof(*c));
+    if (!c)
+        return AVERROR(ENOMEM);
+    c->ctx = ctx;
+
+    c->workers = av_mallocz(sizeof(*c->workers) * (nb_threads - 1));
+    if (!c->workers) {
+        av_freep(&ctx->thread);
+        return AVERROR(ENOMEM);
+    }
+
+    c->nb_threads  = 1;
+    c->current_job = 0;
+    c->nb_jobs     = 0;
+    c->done        = 0;
+
+    pthread_cond_init(&c->current_job_cond, NULL);
+    pthread_cond_init(&c->last_job_cond, NULL);
+    pthread_mutex_init(&c->current_job_lock, NULL);
+
+    for (i = 0; i < nb_threads - 1; i++) {
+        ret = pthread_create(&c->workers[i], NULL, worker, c);
+        if (ret) {
+            ff_sws_thread_free(ctx);
+            return AVERROR(ret);
+        }
+        c->nb_threads++;
+    }
+
+    return 0;
+}
+
+void ff_sws_thread_free(SwsContext *ctx)
+{
+    if (ctx->thread)
+        thread_uninit(ctx->thread);
+    av_freep(&ctx->thread);
+}
@@ -0,0 +1,332 @@
+/*
+ * This file is part of Libav.
+ *
+ * Libav is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation; either
+ * version 2.1 of the License, or (at your option) any later version.
+ *
+ * Libav is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with Libav; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA
+ */
+
+/**
+ * @file
+ * Scaler kernel microbenchmark.
+ * Creates contexts for increasing sets of cpu flags and prints the number of
+ * cycles per call of the horizontal (hyScale) and vertical (yuv2planeX)
+ * scaling functions they select. Each optimized kernel must produce the same
+ * output as the previously measured one when both use the same filter, so
+ * this doubles as a test of the SIMD scalers.
+ * Finally the cost of creating a context is measured with an empty and a
+ * filled filter cache, and contexts with the same geometry are checked to
+ * share their filters.
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "libavutil/cpu.h"
+#include "libavutil/lfg.h"
+#include "libavutil/mem.h"
+#include "libavutil/time.h"
+#include "libavutil/timer.h"
+
+#include "swscale.h"
+#include "swscale_internal.h"
+
+#ifndef AV_READ_TIME
+#define AV_READ_TIME av_gettime
+#endif
+
+#define DST_W 1920
+#define RUNS  256
+
+static const struct {
+    const char *name;
+    int flags;
+} cpu_levels[] = {
+    { "c",     0 },
+#if ARCH_X86
+    { "mmx",   AV_CPU_FLAG_MMX | AV_CPU_FLAG_MMXEXT | AV_CPU_FLAG_CMOV },
+    { "sse2",  AV_CPU_FLAG_MMX | AV_CPU_FLAG_MMXEXT | AV_CPU_FLAG_CMOV |
+               AV_CPU_FLAG_SSE | AV_CPU_FLAG_SSE2 },
+    { "ssse3", AV_CPU_FLAG_MMX | AV_CPU_FLAG_MMXEXT | AV_CPU_FLAG_CMOV |
+               AV_CPU_FLAG_SSE | AV_CPU_FLAG_SSE2 | AV_CPU_FLAG_SSE3 |
+               AV_CPU_FLAG_SSSE3 },
+    { "sse4",  AV_CPU_FLAG_MMX | AV_CPU_FLAG_MMXEXT | AV_CPU_FLAG_CMOV |
+               AV_CPU_FLAG_SSE | AV_CPU_FLAG_SSE2 | AV_CPU_FLAG_SSE3 |
+               AV_CPU_FLAG_SSSE3 | AV_CPU_FLAG_SSE4 | AV_CPU_FLAG_SSE42 },
+    { "avx",   AV_CPU_FLAG_MMX | AV_CPU_FLAG_MMXEXT | AV_CPU_FLAG_CMOV |
+               AV_CPU_FLAG_SSE | AV_CPU_FLAG_SSE2 | AV_CPU_FLAG_SSE3 |
+               AV_CPU_FLAG_SSSE3 | AV_CPU_FLAG_SSE4 | AV_CPU_FLAG_SSE42 |
+               AV_CPU_FLAG_AVX },
+#endif
+};
+
+/* The scale factor selects the bicubic filter size: once padded to the SIMD
+ * filter alignment, upscaling uses 4 taps, 2:1 downscaling 8 and 3:1
+ * downscaling 12. */
+static const int src_widths[] = { DST_W / 2, DST_W * 2, DST_W * 3 };
+
+static const struct {
+    int in_bits, out_bits;
+    enum AVPixelFormat src_fmt, dst_fmt;
+} hscale_tests[] = {
+    {  8, 15, AV_PIX_FMT_YUV420P,     AV_PIX_FMT_YUV420P     },
+    {  9, 15, AV_PIX_FMT_YUV420P9LE,  AV_PIX_FMT_YUV420P     },
+    { 10, 15, AV_PIX_FMT_YUV420P10LE, AV_PIX_FMT_YUV420P     },
+    { 16, 15, AV_PIX_FMT_YUV420P16LE, AV_PIX_FMT_YUV420P     },
+    {  8, 19, AV_PIX_FMT_YUV420P,     AV_PIX_FMT_YUV420P16LE },
+    {  9, 19, AV_PIX_FMT_YUV420P9LE,  AV_PIX_FMT_YUV420P16LE },
+    { 10, 19, AV_PIX_FMT_YUV420P10LE, AV_PIX_FMT_YUV420P16LE },
+    { 16, 19, AV_PIX_FMT_YUV420P16LE, AV_PIX_FMT_YUV420P16LE },
+};
+
+static const struct {
+    int out_bits;
+    enum AVPixelFormat dst_fmt;
+} vscale_tests[] = {
+    {  8, AV_PIX_FMT_YUV420P     },
+    {  9, AV_PIX_FMT_YUV420P9LE  },
+    { 10, AV_PIX_FMT_YUV420P10LE },
+    { 16, AV_PIX_FMT_YUV420P16LE },
+};
+
+static AVLFG rand_ctx;
+
+static void fill_random(uint16_t *buf, int n, int bits)
+{
+    int i;
+
+    for (i = 0; i < n; i++)
+        buf[i] = av_lfg_get(&rand_ctx) & ((1 << bits) - 1);
+}
+
+static SwsContext *get_context(int level, int src_w, int dst_w,
+                               enum AVPixelFormat src_fmt,
+                               enum AVPixelFormat dst_fmt)
+{
+    SwsContext *c;
+
+    av_set_cpu_flags_mask(cpu_levels[level].flags);
+    /* the same scale factor vertically gives comparable vertical filters */
+    c = sws_getContext(src_w, src_w, src_fmt, dst_w, dst_w, dst_fmt,
+                       SWS_BICUBIC, NULL, NULL, NULL);
+    av_set_cpu_flags_mask(~0);
+    return c;
+}
+
+static int bench_hscale(int test, int filter, uint8_t *src, uint8_t *dst,
+                        uint8_t *ref)
+{
+    const int bytes = hscale_tests[test].out_bits == 15 ? 2 : 4;
+    const int src_w = src_widths[filter];
+    void (*prev_fn)(void) = NULL;
+    double base = 0;
+    int prev_size = 0;
+    int level;
+
+    fill_random((uint16_t *)src, src_w + 64, hscale_tests[test].in_bits);
+
+    for (level = 0; level < FF_ARRAY_ELEMS(cpu_levels); level++) {
+        uint64_t best = UINT64_MAX;
+        SwsContext *c;
+        int i;
+
+        if ((av_get_cpu_flags() & cpu_levels[level].flags) !=
+            cpu_levels[level].flags)
+            break;
+
+        c = get_context(level, src_w, DST_W, hscale_tests[test].src_fmt,
+                        hscale_tests[test].dst_fmt);
+        if (!c)
+            return AVERROR(ENOMEM);
+        if ((void (*)(void))c->hyScale == prev_fn) {
+            sws_freeContext(c);
+            continue;
+        }
+
+        for (i = 0; i < RUNS; i++) {
+            uint64_t t = AV_READ_TIME();
+            c->hyScale(c, (int16_t *)dst, DST_W, src, c->hLumFilter,
+                       c->hLumFilterPos, c->hLumFilterSize);
+            t = AV_READ_TIME() - t;
+            best = FFMIN(best, t);
+        }
+        if (!level)
+            base = best;
+
+        printf("hscale %2d -> %2d %2d taps %-5s %8"PRIu64" cycles %6.2fx\n",
+               hscale_tests[test].in_bits, hscale_tests[test].out_bits,
+               c->hLumFilterSize, cpu_levels[level].name, best, base / best);
+
+        if (c->hLumFilterSize == prev_size &&
+            memcmp(dst, ref, DST_W * bytes)) {
+            fprintf(stderr, "%s hscale output differs from the previous "
+                    "kernel\n", cpu_levels[level].name);
+            sws_freeContext(c);
+            return 1;
+        }
+        memcpy(ref, dst, DST_W * bytes);
+        prev_size = c->hLumFilterSize;
+        prev_fn   = (void (*)(void))c->hyScale;
+        sws_freeContext(c);
+    }
+    return 0;
+}
+
+static int bench_vscale(int test, int filter, int16_t **lines, uint8_t *dst,
+                        uint8_t *ref)
+{
+    static const uint8_t dither[8] = { 36, 68, 60, 92, 34, 66, 58, 90 };
+    const int bytes = vscale_tests[test].out_bits == 8 ? 1 : 2;
+    const int in_bits = vscale_tests[test].out_bits == 16 ? 19 : 15;
+    const int src_w = src_widths[filter];
+    void (*prev_fn)(void) = NULL;
+    double base = 0;
+    int prev_size = 0;
+    int level, i;
+
+    for (i = 0; i < MAX_FILTER_SIZE; i++) {
+        if (in_bits == 19) {
+            int32_t *line = (int32_t *)lines[i];
+            int x;
+            for (x = 0; x < DST_W + 64; x++)
+                line[x] = av_lfg_get(&rand_ctx) & ((1 << in_bits) - 1);
+        } else {
+            fill_random((uint16_t *)lines[i], DST_W + 64, in_bits);
+        }
+    }
+
+    for (level = 0; level < FF_ARRAY_ELEMS(cpu_levels); level++) {
+        uint64_t best = UINT64_MAX;
+        SwsContext *c;
+
+        if ((av_get_cpu_flags() & cpu_levels[level].flags) !=
+            cpu_levels[level].flags)
+            break;
+
+        c = get_context(level, src_w, DST_W, AV_PIX_FMT_YUV420P,
+                        vscale_tests[test].dst_fmt);
+        if (!c)
+            return AVERROR(ENOMEM);
+        if ((void (*)(void))c->yuv2planeX == prev_fn) {
+            sws_freeContext(c);
+            continue;
+        }
+
+        for (i = 0; i < RUNS; i++) {
+            uint64_t t = AV_READ_TIME();
+            c->yuv2planeX(c->vLumFilter, c->vLumFilterSize,
+                          (const int16_t **)lines, dst, DST_W, dither, 0);
+            t = AV_READ_TIME() - t;
+            best = FFMIN(best, t);
+        }
+        if (!level)
+            base = best;
+
+        printf("vscale %2d -> %2d %2d taps %-5s %8"PRIu64" cycles %6.2fx\n",
+               in_bits, vscale_tests[test].out_bits, c->vLumFilterSize,
+               cpu_levels[level].name, best, base / best);
+
+        if (c->vLumFilterSize == prev_size &&
+            memcmp(dst, ref, DST_W * bytes)) {
+            fprintf(stderr, "%s vscale output differs from the previous "
+                    "kernel\n", cpu_levels[level].name);
+            sws_freeContext(c);
+            return 1;
+        }
+        memcpy(ref, dst, DST_W * bytes);
+        prev_size = c->vLumFilterSize;
+        prev_fn   = (void (*)(void))c->yuv2planeX;
+        sws_freeContext(c);
+    }
+    return 0;
+}
+
+static int bench_context_init(void)
+{
+    SwsContext *c, *c2;
+    uint64_t cold, warm = UINT64_MAX;
+    int i, ret = 0;
+
+    /* an unusual geometry, so that the cache is empty the first time */
+    cold = AV_READ_TIME();
+    c = sws_getContext(1918, 1078, AV_PIX_FMT_YUV420P, 1278, 718,
+                       AV_PIX_FMT_YUV420P, SWS_BICUBIC, NULL, NULL, NULL);
+    cold = AV_READ_TIME() - cold;
+    if (!c)
+        return AVERROR(ENOMEM);
+
+    for (i = 0; i < RUNS / 16; i++) {
+        uint64_t t = AV_READ_TIME();
+        c2 = sws_getContext(1918, 1078, AV_PIX_FMT_YUV420P, 1278, 718,
+                            AV_PIX_FMT_YUV420P, SWS_BICUBIC, NULL, NULL, NULL);
+        t = AV_READ_TIME() - t;
+        warm = FFMIN(warm, t);
+        if (!c2) {
+            ret = AVERROR(ENOMEM);
+            break;
+        }
+        if (c2->hLumFilter != c->hLumFilter ||
+            c2->vChrFilter != c->vChrFilter) {
+            fprintf(stderr, "contexts with the same geometry do not share "
+                    "their filters\n");
+            ret = 1;
+        }
+        sws_freeContext(c2);
+        if (ret)
+            break;
+    }
+    sws_freeContext(c);
+
+    if (!ret)
+        printf("sws_getContext cold %8"PRIu64" cycles, cached %8"PRIu64
+               " cycles %6.2fx\n", cold, warm, (double)cold / warm);
+    return ret;
+}
+
+int main(void)
+{
+    int16_t *lines[MAX_FILTER_SIZE] = { NULL };
+    uint8_t *src, *dst, *ref;
+    int i, j, ret = AVERROR(ENOMEM);
+
+    av_lfg_init(&rand_ctx, 1);
+
+    /* room for the 3:1 downscale source and for the SIMD overwrites */
+    src = av_malloc((DST_W * 3 + 64) * 2);
+    dst = av_malloc((DST_W + 64) * 4);
+    ref = av_malloc((DST_W + 64) * 4);
+    if (!src || !dst || !ref)
+        goto end;
+    for (i = 0; i < MAX_FILTER_SIZE; i++)
+        if (!(lines[i] = av_malloc((DST_W + 64) * 4)))
+            goto end;
+
+    for (i = 0; i < FF_ARRAY_ELEMS(src_widths); i++) {
+        for (j = 0; j < FF_ARRAY_ELEMS(hscale_tests); j++)
+            if ((ret = bench_hscale(j, i, src, dst, ref)))
+                goto end;
+        for (j = 0; j < FF_ARRAY_ELEMS(vscale_tests); j++)
+            if ((ret = bench_vscale(j, i, lines, dst, ref)))
+                goto end;
+    }
+    ret = bench_context_init();
+
+end:
+    for (i = 0; i < MAX_FILTER_SIZE; i++)
+        av_free(lines[i]);
+    av_free(src);
+    av_free(dst);
+    av_free(ref);
+    return ret < 0 ? 2 : ret;
+}
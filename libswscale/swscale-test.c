@@ -31,6 +31,8 @@
 #include "libavutil/crc.h"
 #include "libavutil/pixdesc.h"
 #include "libavutil/lfg.h"
+#include "libavutil/opt.h"
+#include "libavutil/time.h"
 #include "swscale.h"
 
 /* HACK Duplicated from swscale_internal.h.
@@ -334,6 +336,140 @@ static int fileTest(uint8_t *ref[4], int refStride[4], int w, int h, FILE *fp,
     return 0;
 }
 
+#define BENCH_TIME 1000000 ///< microseconds spent scaling per thread count
+
+static struct SwsContext *getThreadedContext(int srcW, int srcH,
+                                             enum AVPixelFormat srcFormat,
+                                             int dstW, int dstH,
+                                             enum AVPixelFormat dstFormat,
+                                             int flags, int threads)
+{
+    const int *coeffs = sws_getCoefficients(SWS_CS_DEFAULT);
+    struct SwsContext *c = sws_alloc_context();
+
+    if (!c)
+        return NULL;
+
+    av_opt_set_int(c, "srcw",       srcW,      0);
+    av_opt_set_int(c, "srch",       srcH,      0);
+    av_opt_set_int(c, "src_format", srcFormat, 0);
+    av_opt_set_int(c, "dstw",       dstW,      0);
+    av_opt_set_int(c, "dsth",       dstH,      0);
+    av_opt_set_int(c, "dst_format", dstFormat, 0);
+    av_opt_set_int(c, "sws_flags",  flags,     0);
+    av_opt_set_int(c, "threads",    threads,   0);
+    sws_setColorspaceDetails(c, coeffs, 0, coeffs, 0, 0, 1 << 16, 1 << 16);
+
+    if (sws_init_context(c, NULL, NULL) < 0) {
+        sws_freeContext(c);
+        return NULL;
+    }
+    return c;
+}
+
+static uint32_t getImageCRC(uint8_t *data[4], int stride[4],
+                            enum AVPixelFormat format, int w, int h)
+{
+    const AVPixFmtDescriptor *desc = av_pix_fmt_desc_get(format);
+    int linesize[4];
+    uint32_t crc = 0;
+    int i, y;
+
+    av_image_fill_linesizes(linesize, format, w);
+    for (i = 0; i < 4 && linesize[i]; i++) {
+        int lines = i == 1 || i == 2 ? -((-h) >> desc->log2_chroma_h) : h;
+
+        for (y = 0; y < lines; y++)
+            crc = av_crc(av_crc_get_table(AV_CRC_32_IEEE), crc,
+                         data[i] + y * stride[i], linesize[i]);
+    }
+    return crc;
+}
+
+/* Measure the throughput of a 2160p -> 1080p bicubic conversion with
+ * increasing numbers of threads and check that the output does not depend
+ * on the number of threads. */
+static int benchTest(enum AVPixelFormat srcFormat,
+                     enum AVPixelFormat dstFormat, int max_threads)
+{
+    const int srcW = 3840, srcH = 2160, dstW = 1920, dstH = 1080;
+    const AVPixFmtDescriptor *desc_src = av_pix_fmt_desc_get(srcFormat);
+    const AVPixFmtDescriptor *desc_dst = av_pix_fmt_desc_get(dstFormat);
+    uint8_t *src[4], *dst[4];
+    int srcStride[4], dstStride[4];
+    uint32_t ref_crc = 0;
+    double base = 0;
+    AVLFG rand;
+    int i, size, dst_size, res = 0;
+
+    if ((size = av_image_alloc(src, srcStride, srcW, srcH, srcFormat, 32)) < 0)
+        return -1;
+    if ((dst_size = av_image_alloc(dst, dstStride, dstW, dstH, dstFormat, 32)) < 0) {
+        av_free(src[0]);
+        return -1;
+    }
+
+    av_lfg_init(&rand, 1);
+    for (i = 0; i < size; i++)
+        src[0][i] = av_lfg_get(&rand);
+
+    for (i = 1; i <= max_threads; i++) {
+        struct SwsContext *c;
+        int64_t start, elapsed = 0;
+        int frames = 0;
+        uint32_t crc;
+        double fps;
+
+        /* powers of two and the maximum */
+        if (i & (i - 1) && i != max_threads)
+            continue;
+
+        c = getThreadedContext(srcW, srcH, srcFormat, dstW, dstH, dstFormat,
+                               SWS_BICUBIC, i);
+        if (!c) {
+            fprintf(stderr, "Failed to get %s ---> %s\n",
+                    desc_src->name, desc_dst->name);
+            res = -1;
+            break;
+        }
+
+        /* poison the output before each call, so that lines a thread
+         * count fails to write show up in the CRC; only the scaling is
+         * timed */
+        do {
+            memset(dst[0], 0xA5, dst_size);
+            start = av_gettime();
+            sws_scale(c, src, srcStride, 0, srcH, dst, dstStride);
+            elapsed += av_gettime() - start;
+            frames++;
+        } while (elapsed < BENCH_TIME);
+        sws_freeContext(c);
+
+        crc = getImageCRC(dst, dstStride, dstFormat, dstW, dstH);
+        fps = frames * 1000000.0 / elapsed;
+        if (i == 1) {
+            ref_crc = crc;
+            base    = fps;
+        }
+
+        printf(" %s %dx%d -> %s %dx%d threads %2d: %8.2f fps %6.2fx CRC=%08x\n",
+               desc_src->name, srcW, srcH, desc_dst->name, dstW, dstH,
+               i, fps, fps / base, crc);
+        fflush(stdout);
+
+        if (crc != ref_crc) {
+            fprintf(stderr, "output with %d threads differs from the output "
+                    "with 1 thread\n", i);
+            res = 1;
+            break;
+        }
+    }
+
+    av_free(src[0]);
+    av_free(dst[0]);
+    return res;
+}
+
 #define W 96
 #define H 96
 
@@ -351,6 +487,7 @@ int main(int argc, char **argv)
     struct SwsContext *sws;
     AVLFG rand;
     int res = -1;
+    int bench_threads = 0;
     int i;
 
     if (!rgb_data || !data)
@@ -392,6 +529,12 @@ int main(int argc, char **argv)
                 fprintf(stderr, "invalid pixel format %s\n", argv[i + 1]);
                 return -1;
             }
+        } else if (!strcmp(argv[i], "-bench")) {
+            bench_threads = atoi(argv[i + 1]);
+            if (bench_threads < 1) {
+                fprintf(stderr, "invalid number of threads %s\n", argv[i + 1]);
+                return -1;
+            }
         } else {
 bad_option:
             fprintf(stderr, "bad option or argument missing (%s)\n", argv[i]);
@@ -399,6 +542,13 @@ bad_option:
         }
     }
 
+    if (bench_threads) {
+        res = benchTest(srcFormat != AV_PIX_FMT_NONE ? srcFormat : AV_PIX_FMT_YUV420P,
+                        dstFormat != AV_PIX_FMT_NONE ? dstFormat : AV_PIX_FMT_YUV420P,
+                        bench_threads);
+        goto error;
+    }
+
     selfTest(src, stride, W, H, srcFormat, dstFormat);
 end:
     res = 0;
@@ -346,6 +346,8 @@ static int swScale(SwsContext *c, const uint8_t *src[],
     const int srcW                   = c->srcW;
     const int dstW                   = c->dstW;
     const int dstH                   = c->dstH;
+    const int dstSliceEnd            = c->dstSliceH ? c->dstSliceY + c->dstSliceH
+                                                    : dstH;
     const int chrDstW                = c->chrDstW;
     const int chrSrcW                = c->chrSrcW;
     const int lumXInc                = c->lumXInc;
@@ -434,7 +436,7 @@ static int swScale(SwsContext *c, const uint8_t *src[],
     if (srcSliceY == 0) {
         lumBufIndex  = -1;
         chrBufIndex  = -1;
-        dstY         = 0;
+        dstY         = c->dstSliceY;
         lastInLumBuf = -1;
         lastInChrBuf = -1;
     }
@@ -444,7 +446,7 @@ static int swScale(SwsContext *c, const uint8_t *src[],
     }
     lastDstY = dstY;
 
-    for (; dstY < dstH; dstY++) {
+    for (; dstY < dstSliceEnd; dstY++) {
         const int chrDstY = dstY >> c->chrDstVSubSample;
         uint8_t *dest[4]  = {
             dst[0] + dstStride[0] * dstY,
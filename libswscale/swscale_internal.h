@@ -346,6 +346,18 @@ typedef struct SwsContext {
     uint8_t *lumMmxextFilterCode; ///< Runtime-generated MMXEXT horizontal fast bilinear scaler code for luma/alpha planes.
     uint8_t *chrMmxextFilterCode; ///< Runtime-generated MMXEXT horizontal fast bilinear scaler code for chroma planes.
 
+    /**
+     * Filter cache entries owning the filters and the MMXEXT scaler code
+     * above. They are shared with the other contexts using the same filters,
+     * so the filters must not be modified.
+     */
+    //@{
+    struct SwsFilterEntry *hLumFilterEntry;
+    struct SwsFilterEntry *hChrFilterEntry;
+    struct SwsFilterEntry *vLumFilterEntry;
+    struct SwsFilterEntry *vChrFilterEntry;
+    //@}
+
     int canMMXEXTBeUsed;
 
     int dstY;                     ///< Last destination vertical line output from last slice.
@@ -557,6 +569,23 @@ typedef struct SwsContext {
     void (*chrConvertRange)(int16_t *dst1, int16_t *dst2, int width);
 
     int needs_hcscale; ///< Set if there are chroma planes to be converted.
+
+    /**
+     * @name Slice threading.
+     * A threaded context splits the destination image into horizontal bands
+     * and renders each of them with its own slice context, which has its own
+     * ring buffers and starts filling them at the first source line its band
+     * needs. This is only done when sws_scale() gets the whole source image
+     * in one call, the output is identical to rendering it in one go.
+     */
+    //@{
+    int nb_threads;               ///< Number of threads requested by the user, 0 for auto.
+    struct SwsContext **slice_ctx; ///< Contexts rendering the bands.
+    int nb_slice_ctx;
+    void *thread;                 ///< Worker threads running the bands.
+    int dstSliceY;                ///< First destination line rendered by a slice context.
+    int dstSliceH;                ///< Number of destination lines rendered by a slice context, 0 for all.
+    //@}
 } SwsContext;
 //FIXME check init (where 0)
 
@@ -748,4 +777,30 @@ void ff_sws_init_output_funcs(SwsContext *c,
 void ff_sws_init_swScale_altivec(SwsContext *c);
 void ff_sws_init_swScale_mmx(SwsContext *c);
 
+#define MAX_SLICE_THREADS 64
+
+typedef int (sws_job_func)(SwsContext *c, void *arg, int jobnr, int nb_jobs);
+
+/**
+ * Start nb_threads - 1 worker threads for c, the thread calling
+ * ff_sws_execute() runs jobs as well.
+ *
+ * @return 0 on success, a negative AVERROR code on failure
+ */
+int ff_sws_thread_init(SwsContext *c, int nb_threads);
+
+/**
+ * Stop the worker threads started by ff_sws_thread_init().
+ */
+void ff_sws_thread_free(SwsContext *c);
+
+/**
+ * Run func for every jobnr from 0 to nb_jobs - 1 on the threads of c and
+ * return once all of them are done.
+ *
+ * @param rets if not NULL, the return values of the jobs are stored there
+ */
+void ff_sws_execute(SwsContext *c, sws_job_func *func, void *arg,
+                    int *rets, int nb_jobs);
+
 #endif /* SWSCALE_SWSCALE_INTERNAL_H */
@@ -29,6 +29,7 @@
 #include "rgb2rgb.h"
 #include "libavutil/intreadwrite.h"
 #include "libavutil/cpu.h"
+#include "libavutil/imgutils.h"
 #include "libavutil/avutil.h"
 #include "libavutil/mathematics.h"
 #include "libavutil/bswap.h"
@@ -1123,6 +1124,73 @@ static int check_image_pointers(uint8_t *data[4], enum AVPixelFormat pix_fmt,
     return 1;
 }
 
+typedef struct SliceArgs {
+    const uint8_t *src[4];
+    int srcStride[4];
+    uint8_t *dst[4];
+    int dstStride[4];
+} SliceArgs;
+
+static int scale_band(SwsContext *c, void *arg, int jobnr, int nb_jobs)
+{
+    const SliceArgs *a = arg;
+    SwsContext *s = c->slice_ctx[jobnr];
+    /* swScale() modifies the pointers and strides it gets */
+    const uint8_t *src[4] = { a->src[0], a->src[1], a->src[2], a->src[3] };
+    uint8_t *dst[4]       = { a->dst[0], a->dst[1], a->dst[2], a->dst[3] };
+    int srcStride[4]      = { a->srcStride[0], a->srcStride[1],
+                              a->srcStride[2], a->srcStride[3] };
+    int dstStride[4]      = { a->dstStride[0], a->dstStride[1],
+                              a->dstStride[2], a->dstStride[3] };
+
+    return s->swScale(s, src, srcStride, 0, c->srcH, dst, dstStride);
+}
+
+/**
+ * Check that the lines of the destination are padded enough that the SIMD
+ * output functions writing past the end of a line do not reach the next one,
+ * which may belong to another band.
+ */
+static int bands_are_independent(SwsContext *c, const int dstStride[4])
+{
+    int linesizes[4], i;
+
+    if (av_image_fill_linesizes(linesizes, c->dstFormat, c->dstW) < 0)
+        return 0;
+    for (i = 0; i < 4; i++)
+        if (linesizes[i] && FFABS(dstStride[i]) < FFALIGN(linesizes[i], 32))
+            return 0;
+
+    return 1;
+}
+
+/**
+ * Scale a whole image with the slice contexts of c, one band per thread.
+ */
+static int scale_threaded(SwsContext *c, const uint8_t *src[4],
+                          int srcStride[4], uint8_t *dst[4], int dstStride[4])
+{
+    SliceArgs args;
+    int rets[MAX_SLICE_THREADS], i, ret = 0;
+
+    for (i = 0; i < 4; i++) {
+        args.src[i]       = src[i];
+        args.srcStride[i] = srcStride[i];
+        args.dst[i]       = dst[i];
+        args.dstStride[i] = dstStride[i];
+    }
+    for (i = 0; i < c->nb_slice_ctx; i++) {
+        memcpy(c->slice_ctx[i]->pal_yuv, c->pal_yuv, sizeof(c->pal_yuv));
+        memcpy(c->slice_ctx[i]->pal_rgb, c->pal_rgb, sizeof(c->pal_rgb));
+    }
+
+    ff_sws_execute(c, scale_band, &args, rets, c->nb_slice_ctx);
+
+    for (i = 0; i < c->nb_slice_ctx; i++)
+        ret += rets[i];
+    return ret;
+}
+
 /**
  * swscale wrapper, so we don't need to export the SwsContext.
  * Assumes planar YUV to be in YUV order instead of YVU.
@@ -1236,6 +1304,10 @@ int attribute_align_arg sws_scale(struct SwsContext *c,
         if (srcSliceY + srcSliceH == c->srcH)
             c->sliceDir = 0;
 
+        if (c->nb_slice_ctx && srcSliceY == 0 && srcSliceH == c->srcH &&
+            bands_are_independent(c, dstStride2))
+            return scale_threaded(c, src2, srcStride2, dst2, dstStride2);
+
         return c->swScale(c, src2, srcStride2, srcSliceY, srcSliceH, dst2,
                           dstStride2);
     } else {
@@ -41,6 +41,7 @@
 #endif
 #endif
 
+#include "libavutil/atomic.h"
 #include "libavutil/attributes.h"
 #include "libavutil/avutil.h"
 #include "libavutil/bswap.h"
@@ -869,6 +870,287 @@ static int init_hscaler_mmxext(int dstW, int xInc, uint8_t *filterCode,
 }
 #endif /* HAVE_MMXEXT_INLINE */
 
+#define USE_MMAP (HAVE_MMAP && HAVE_MPROTECT && defined MAP_ANONYMOUS)
+
+/* number of unused entries kept in the filter cache */
+#define FILTER_CACHE_IDLE_MAX 32
+
+enum SwsFilterType {
+    FILTER_GENERIC,
+    FILTER_MMXEXT,
+};
+
+/**
+ * Everything the filters built by initFilter() or init_hscaler_mmxext()
+ * depend on. Zeroed before being filled so that it can be compared with
+ * memcmp().
+ */
+typedef struct SwsFilterKey {
+    enum SwsFilterType type;
+    int xInc;
+    int srcW;
+    int dstW;
+    int filterAlign;              ///< number of splits for FILTER_MMXEXT
+    int one;
+    int flags;
+    int cpu_flags;
+    int is_horizontal;
+    double param[2];
+} SwsFilterKey;
+
+/**
+ * A set of scaler filters, shared by all the contexts using the same
+ * filters. Entries built from user supplied SwsVectors are not cached and
+ * only have one user.
+ */
+typedef struct SwsFilterEntry {
+    SwsFilterKey key;
+    int16_t *filter;
+    int32_t *filterPos;
+    int filterSize;
+    uint8_t *code;                ///< runtime-generated MMXEXT scaler, if any
+    int codeSize;
+    int refcount;                 ///< protected by filter_cache_lock
+    int cached;                   ///< the entry is in the filter cache list
+    struct SwsFilterEntry *next;
+} SwsFilterEntry;
+
+/* most recently used first, protected by filter_cache_lock */
+static SwsFilterEntry *filter_cache;
+static void *volatile filter_cache_lock;
+
+static void lock_filter_cache(void)
+{
+    while (avpriv_atomic_ptr_cas(&filter_cache_lock, NULL, &filter_cache))
+        ;
+}
+
+static void unlock_filter_cache(void)
+{
+    avpriv_atomic_ptr_cas(&filter_cache_lock, &filter_cache, NULL);
+}
+
+static void free_filter_entry(SwsFilterEntry *e)
+{
+    av_free(e->filter);
+    av_free(e->filterPos);
+    if (e->code) {
+#if USE_MMAP
+        munmap(e->code, e->codeSize);
+#elif HAVE_VIRTUALALLOC
+        VirtualFree(e->code, 0, MEM_RELEASE);
+#else
+        av_free(e->code);
+#endif
+    }
+    av_free(e);
+}
+
+/**
+ * Look up the entry matching key and take a reference to it. Must be called
+ * with filter_cache_lock held.
+ */
+static SwsFilterEntry *lookup_filter_entry(const SwsFilterKey *key)
+{
+    SwsFilterEntry **p, *e;
+
+    for (p = &filter_cache; (e = *p); p = &e->next) {
+        if (!memcmp(&e->key, key, sizeof(*key))) {
+            *p           = e->next;
+            e->next      = filter_cache;
+            filter_cache = e;
+            e->refcount++;
+            break;
+        }
+    }
+    return e;
+}
+
+static SwsFilterEntry *find_filter_entry(const SwsFilterKey *key)
+{
+    SwsFilterEntry *e;
+
+    lock_filter_cache();
+    e = lookup_filter_entry(key);
+    unlock_filter_cache();
+
+    return e;
+}
+
+/**
+ * Add a newly built entry to the cache. If another thread built the same
+ * filters in the meantime, free e and return a reference to its entry.
+ */
+static SwsFilterEntry *add_filter_entry(SwsFilterEntry *e)
+{
+    SwsFilterEntry *old;
+
+    lock_filter_cache();
+    if (!(old = lookup_filter_entry(&e->key))) {
+        e->cached    = 1;
+        e->next      = filter_cache;
+        filter_cache = e;
+    }
+    unlock_filter_cache();
+
+    if (old) {
+        free_filter_entry(e);
+        return old;
+    }
+    return e;
+}
+
+/**
+ * Drop a reference to *pe. Unused cache entries are kept around, up to
+ * FILTER_CACHE_IDLE_MAX of them, so that contexts created one after the
+ * other do not have to rebuild their filters.
+ */
+static void release_filter_entry(SwsFilterEntry **pe)
+{
+    SwsFilterEntry *e = *pe, **p, *stale = NULL;
+    int idle = 0;
+
+    *pe = NULL;
+    if (!e)
+        return;
+
+    if (!e->cached) {
+        free_filter_entry(e);
+        return;
+    }
+
+    lock_filter_cache();
+    e->refcount--;
+    for (p = &filter_cache; (e = *p);) {
+        if (!e->refcount && ++idle > FILTER_CACHE_IDLE_MAX) {
+            *p      = e->next;
+            e->next = stale;
+            stale   = e;
+        } else {
+            p = &e->next;
+        }
+    }
+    unlock_filter_cache();
+
+    while ((e = stale)) {
+        stale = e->next;
+        free_filter_entry(e);
+    }
+}
+
+/**
+ * initFilter() through the filter cache. The filters are owned by *entry
+ * and must be released with release_filter_entry().
+ */
+static int get_filter(SwsFilterEntry **entry, int16_t **outFilter,
+                      int32_t **filterPos, int *outFilterSize, int xInc,
+                      int srcW, int dstW, int filterAlign, int one, int flags,
+                      int cpu_flags, SwsVector *srcFilter,
+                      SwsVector *dstFilter, double param[2],
+                      int is_horizontal)
+{
+    int cacheable = !srcFilter && !dstFilter;
+    SwsFilterEntry *e = NULL;
+    SwsFilterKey key;
+
+    memset(&key, 0, sizeof(key));
+    key.type          = FILTER_GENERIC;
+    key.xInc          = xInc;
+    key.srcW          = srcW;
+    key.dstW          = dstW;
+    key.filterAlign   = filterAlign;
+    key.one           = one;
+    key.flags         = flags;
+    key.cpu_flags     = cpu_flags;
+    key.is_horizontal = is_horizontal;
+    key.param[0]      = param[0];
+    key.param[1]      = param[1];
+
+    if (cacheable)
+        e = find_filter_entry(&key);
+    if (!e) {
+        if (!(e = av_mallocz(sizeof(*e))))
+            return AVERROR(ENOMEM);
+        e->key      = key;
+        e->refcount = 1;
+        if (initFilter(&e->filter, &e->filterPos, &e->filterSize, xInc,
+                       srcW, dstW, filterAlign, one, flags, cpu_flags,
+                       srcFilter, dstFilter, param, is_horizontal) < 0) {
+            free_filter_entry(e);
+            return -1;
+        }
+        if (cacheable)
+            e = add_filter_entry(e);
+    }
+
+    *entry         = e;
+    *outFilter     = e->filter;
+    *filterPos     = e->filterPos;
+    *outFilterSize = e->filterSize;
+    return 0;
+}
+
+#if HAVE_MMXEXT_INLINE
+/**
+ * init_hscaler_mmxext() through the filter cache, allocating executable
+ * memory for the generated code.
+ */
+static int get_mmxext_filter(SwsFilterEntry **entry, uint8_t **code,
+                             int *codeSize, int16_t **filter,
+                             int32_t **filterPos, int dstW, int xInc,
+                             int numSplits)
+{
+    SwsFilterEntry *e;
+    SwsFilterKey key;
+
+    memset(&key, 0, sizeof(key));
+    key.type        = FILTER_MMXEXT;
+    key.xInc        = xInc;
+    key.dstW        = dstW;
+    key.filterAlign = numSplits;
+
+    if (!(e = find_filter_entry(&key))) {
+        if (!(e = av_mallocz(sizeof(*e))))
+            return AVERROR(ENOMEM);
+        e->key      = key;
+        e->refcount = 1;
+        e->codeSize = init_hscaler_mmxext(dstW, xInc, NULL, NULL, NULL,
+                                          numSplits);
+#if USE_MMAP
+        e->code = mmap(NULL, e->codeSize, PROT_READ | PROT_WRITE,
+                       MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+        if (e->code == MAP_FAILED)
+            e->code = NULL;
+#elif HAVE_VIRTUALALLOC
+        e->code = VirtualAlloc(NULL, e->codeSize, MEM_COMMIT,
+                               PAGE_EXECUTE_READWRITE);
+#else
+        e->code = av_malloc(e->codeSize);
+#endif
+        e->filter    = av_mallocz((dstW / numSplits + 8) * sizeof(int16_t));
+        e->filterPos = av_mallocz((dstW / 2 / numSplits + 8) * sizeof(int32_t));
+        if (!e->code || !e->filter || !e->filterPos) {
+            free_filter_entry(e);
+            return AVERROR(ENOMEM);
+        }
+
+        init_hscaler_mmxext(dstW, xInc, e->code, e->filter, e->filterPos,
+                            numSplits);
+#if USE_MMAP
+        mprotect(e->code, e->codeSize, PROT_EXEC | PROT_READ);
+#endif
+        e = add_filter_entry(e);
+    }
+
+    *entry     = e;
+    *code      = e->code;
+    *codeSize  = e->codeSize;
+    *filter    = e->filter;
+    *filterPos = e->filterPos;
+    return 0;
+}
+#endif /* HAVE_MMXEXT_INLINE */
+
 static void getSubSampleFactors(int *h, int *v, enum AVPixelFormat format)
 {
     const AVPixFmtDescriptor *desc = av_pix_fmt_desc_get(format);
@@ -882,6 +1164,12 @@ int sws_setColorspaceDetails(struct SwsContext *c, const int inv_table[4],
 {
     const AVPixFmtDescriptor *desc_dst = av_pix_fmt_desc_get(c->dstFormat);
     const AVPixFmtDescriptor *desc_src = av_pix_fmt_desc_get(c->srcFormat);
+    int i;
+
+    for (i = 0; i < c->nb_slice_ctx; i++)
+        sws_setColorspaceDetails(c->slice_ctx[i], inv_table, srcRange, table,
+                                 dstRange, brightness, contrast, saturation);
+
     memcpy(c->srcColorspaceTable, inv_table, sizeof(int) * 4);
     memcpy(c->dstColorspaceTable, table, sizeof(int) * 4);
 
@@ -957,6 +1245,94 @@ SwsContext *sws_alloc_context(void)
     return c;
 }
 
+#if !HAVE_THREADS
+int ff_sws_thread_init(SwsContext *c, int nb_threads)
+{
+    return AVERROR(ENOSYS);
+}
+
+void ff_sws_thread_free(SwsContext *c)
+{
+}
+
+void ff_sws_execute(SwsContext *c, sws_job_func *func, void *arg,
+                    int *rets, int nb_jobs)
+{
+}
+#endif
+
+/* bands of fewer lines are not worth a thread */
+#define MIN_SLICE_LINES  16
+#define MAX_AUTO_THREADS 16
+
+/**
+ * Create the slice contexts and the threads running them. Every slice
+ * context is set up like c and renders a fixed band of the destination.
+ */
+static av_cold int init_slice_contexts(SwsContext *c, SwsFilter *srcFilter,
+                                       SwsFilter *dstFilter)
+{
+    int align      = 1 << c->chrDstVSubSample;
+    int nb_threads = c->nb_threads;
+    int i, ret;
+
+    if (!HAVE_THREADS)
+        return 0;
+
+    if (!nb_threads)
+        nb_threads = av_clip(av_cpu_count(), 1, MAX_AUTO_THREADS);
+    nb_threads = FFMIN(nb_threads, MAX_SLICE_THREADS);
+    nb_threads = FFMIN(nb_threads, c->dstH / FFMAX(MIN_SLICE_LINES, align));
+    if (nb_threads <= 1)
+        return 0;
+
+    c->slice_ctx = av_mallocz(nb_threads * sizeof(*c->slice_ctx));
+    if (!c->slice_ctx)
+        return AVERROR(ENOMEM);
+
+    for (i = 0; i < nb_threads; i++) {
+        /* start bands on a chroma line so that every band outputs all the
+         * chroma lines of its luma lines */
+        int start = (c->dstH *  i      / nb_threads) & ~(align - 1);
+        int end   = (c->dstH * (i + 1) / nb_threads) & ~(align - 1);
+        SwsContext *s;
+
+        if (i == nb_threads - 1)
+            end = c->dstH;
+
+        if (!(s = sws_alloc_context()))
+            return AVERROR(ENOMEM);
+        c->slice_ctx[c->nb_slice_ctx++] = s;
+
+        s->flags      = c->flags & ~SWS_PRINT_INFO;
+        s->srcW       = c->srcW;
+        s->srcH       = c->srcH;
+        s->dstW       = c->dstW;
+        s->dstH       = c->dstH;
+        s->srcFormat  = c->srcFormat;
+        s->dstFormat  = c->dstFormat;
+        s->param[0]   = c->param[0];
+        s->param[1]   = c->param[1];
+        s->nb_threads = 1;
+        s->dstSliceY  = start;
+        s->dstSliceH  = end - start;
+        sws_setColorspaceDetails(s, c->srcColorspaceTable, c->srcRange,
+                                 c->dstColorspaceTable, c->dstRange,
+                                 c->brightness, c->contrast, c->saturation);
+
+        if ((ret = sws_init_context(s, srcFilter, dstFilter)) < 0)
+            return ret;
+    }
+
+    if ((ret = ff_sws_thread_init(c, nb_threads)) < 0)
+        return ret;
+
+    if (c->flags & SWS_PRINT_INFO)
+        av_log(c, AV_LOG_INFO, "using %d threads\n", nb_threads);
+
+    return 0;
+}
+
 av_cold int sws_init_context(SwsContext *c, SwsFilter *srcFilter,
                              SwsFilter *dstFilter)
 {
@@ -1162,57 +1538,18 @@ av_cold int sws_init_context(SwsContext *c, SwsFilter *srcFilter,
 #endif
     }
 
-#define USE_MMAP (HAVE_MMAP && HAVE_MPROTECT && defined MAP_ANONYMOUS)
-
     /* precalculate horizontal scaler filter coefficients */
     {
 #if HAVE_MMXEXT_INLINE
 // can't downscale !!!
         if (c->canMMXEXTBeUsed && (flags & SWS_FAST_BILINEAR)) {
-            c->lumMmxextFilterCodeSize = init_hscaler_mmxext(dstW, c->lumXInc, NULL,
-                                                             NULL, NULL, 8);
-            c->chrMmxextFilterCodeSize = init_hscaler_mmxext(c->chrDstW, c->chrXInc,
-                                                             NULL, NULL, NULL, 4);
-
-#if USE_MMAP
-            c->lumMmxextFilterCode = mmap(NULL, c->lumMmxextFilterCodeSize,
-                                          PROT_READ | PROT_WRITE,
-                                          MAP_PRIVATE | MAP_ANONYMOUS,
-                                          -1, 0);
-            c->chrMmxextFilterCode = mmap(NULL, c->chrMmxextFilterCodeSize,
-                                          PROT_READ | PROT_WRITE,
-                                          MAP_PRIVATE | MAP_ANONYMOUS,
-                                          -1, 0);
-#elif HAVE_VIRTUALALLOC
-            c->lumMmxextFilterCode = VirtualAlloc(NULL,
-                                                  c->lumMmxextFilterCodeSize,
-                                                  MEM_COMMIT,
-                                                  PAGE_EXECUTE_READWRITE);
-            c->chrMmxextFilterCode = VirtualAlloc(NULL,
-                                                  c->chrMmxextFilterCodeSize,
-                                                  MEM_COMMIT,
-                                                  PAGE_EXECUTE_READWRITE);
-#else
-            c->lumMmxextFilterCode = av_malloc(c->lumMmxextFilterCodeSize);
-            c->chrMmxextFilterCode = av_malloc(c->chrMmxextFilterCodeSize);
-#endif
-
-            if (!c->lumMmxextFilterCode || !c->chrMmxextFilterCode)
-                return AVERROR(ENOMEM);
-            FF_ALLOCZ_OR_GOTO(c, c->hLumFilter,    (dstW           / 8 + 8) * sizeof(int16_t), fail);
-            FF_ALLOCZ_OR_GOTO(c, c->hChrFilter,    (c->chrDstW     / 4 + 8) * sizeof(int16_t), fail);
-            FF_ALLOCZ_OR_GOTO(c, c->hLumFilterPos, (dstW       / 2 / 8 + 8) * sizeof(int32_t), fail);
-            FF_ALLOCZ_OR_GOTO(c, c->hChrFilterPos, (c->chrDstW / 2 / 4 + 8) * sizeof(int32_t), fail);
-
-            init_hscaler_mmxext(dstW, c->lumXInc, c->lumMmxextFilterCode,
-                                c->hLumFilter, c->hLumFilterPos, 8);
-            init_hscaler_mmxext(c->chrDstW, c->chrXInc, c->chrMmxextFilterCode,
-                                c->hChrFilter, c->hChrFilterPos, 4);
-
-#if USE_MMAP
-            mprotect(c->lumMmxextFilterCode, c->lumMmxextFilterCodeSize, PROT_EXEC | PROT_READ);
-            mprotect(c->chrMmxextFilterCode, c->chrMmxextFilterCodeSize, PROT_EXEC | PROT_READ);
-#endif
+            if (get_mmxext_filter(&c->hLumFilterEntry, &c->lumMmxextFilterCode,
+                                  &c->lumMmxextFilterCodeSize, &c->hLumFilter,
+                                  &c->hLumFilterPos, dstW, c->lumXInc, 8) < 0 ||
+                get_mmxext_filter(&c->hChrFilterEntry, &c->chrMmxextFilterCode,
+                                  &c->chrMmxextFilterCodeSize, &c->hChrFilter,
+                                  &c->hChrFilterPos, c->chrDstW, c->chrXInc, 4) < 0)
+                goto fail;
         } else
 #endif /* HAVE_MMXEXT_INLINE */
         {
@@ -1221,15 +1558,15 @@ av_cold int sws_init_context(SwsContext *c, SwsFilter *srcFilter,
                 (HAVE_ALTIVEC && cpu_flags & AV_CPU_FLAG_ALTIVEC) ? 8 :
                 1;
 
-            if (initFilter(&c->hLumFilter, &c->hLumFilterPos,
-                           &c->hLumFilterSize, c->lumXInc,
+            if (get_filter(&c->hLumFilterEntry, &c->hLumFilter,
+                           &c->hLumFilterPos, &c->hLumFilterSize, c->lumXInc,
                            srcW, dstW, filterAlign, 1 << 14,
                            (flags & SWS_BICUBLIN) ? (flags | SWS_BICUBIC) : flags,
                            cpu_flags, srcFilter->lumH, dstFilter->lumH,
                            c->param, 1) < 0)
                 goto fail;
-            if (initFilter(&c->hChrFilter, &c->hChrFilterPos,
-                           &c->hChrFilterSize, c->chrXInc,
+            if (get_filter(&c->hChrFilterEntry, &c->hChrFilter,
+                           &c->hChrFilterPos, &c->hChrFilterSize, c->chrXInc,
                            c->chrSrcW, c->chrDstW, filterAlign, 1 << 14,
                            (flags & SWS_BICUBLIN) ? (flags | SWS_BILINEAR) : flags,
                            cpu_flags, srcFilter->chrH, dstFilter->chrH,
@@ -1245,14 +1582,14 @@ av_cold int sws_init_context(SwsContext *c, SwsFilter *srcFilter,
             (HAVE_ALTIVEC && cpu_flags & AV_CPU_FLAG_ALTIVEC) ? 8 :
             1;
 
-        if (initFilter(&c->vLumFilter, &c->vLumFilterPos, &c->vLumFilterSize,
-                       c->lumYInc, srcH, dstH, filterAlign, (1 << 12),
+        if (get_filter(&c->vLumFilterEntry, &c->vLumFilter, &c->vLumFilterPos,
+                       &c->vLumFilterSize, c->lumYInc, srcH, dstH, filterAlign, (1 << 12),
                        (flags & SWS_BICUBLIN) ? (flags | SWS_BICUBIC) : flags,
                        cpu_flags, srcFilter->lumV, dstFilter->lumV,
                        c->param, 0) < 0)
             goto fail;
-        if (initFilter(&c->vChrFilter, &c->vChrFilterPos, &c->vChrFilterSize,
-                       c->chrYInc, c->chrSrcH, c->chrDstH,
+        if (get_filter(&c->vChrFilterEntry, &c->vChrFilter, &c->vChrFilterPos,
+                       &c->vChrFilterSize, c->chrYInc, c->chrSrcH, c->chrDstH,
                        filterAlign, (1 << 12),
                        (flags & SWS_BICUBLIN) ? (flags | SWS_BILINEAR) : flags,
                        cpu_flags, srcFilter->chrV, dstFilter->chrV,
@@ -1397,6 +1734,13 @@ av_cold int sws_init_context(SwsContext *c, SwsFilter *srcFilter,
     }
 
     c->swScale = ff_getSwsFunc(c);
+
+    if (c->nb_threads != 1) {
+        int ret = init_slice_contexts(c, srcFilter, dstFilter);
+        if (ret < 0)
+            return ret;
+    }
+
     return 0;
 fail: // FIXME replace things by appropriate error codes
     return -1;
@@ -1755,6 +2099,11 @@ void sws_freeContext(SwsContext *c)
     if (!c)
         return;
 
+    ff_sws_thread_free(c);
+    for (i = 0; i < c->nb_slice_ctx; i++)
+        sws_freeContext(c->slice_ctx[i]);
+    av_freep(&c->slice_ctx);
+
     if (c->lumPixBuf) {
         for (i = 0; i < c->vLumBufSize; i++)
             av_freep(&c->lumPixBuf[i]);
@@ -1774,39 +2123,15 @@ void sws_freeContext(SwsContext *c)
         av_freep(&c->alpPixBuf);
     }
 
-    av_freep(&c->vLumFilter);
-    av_freep(&c->vChrFilter);
-    av_freep(&c->hLumFilter);
-    av_freep(&c->hChrFilter);
+    release_filter_entry(&c->vLumFilterEntry);
+    release_filter_entry(&c->vChrFilterEntry);
+    release_filter_entry(&c->hLumFilterEntry);
+    release_filter_entry(&c->hChrFilterEntry);
 #if HAVE_ALTIVEC
     av_freep(&c->vYCoeffsBank);
     av_freep(&c->vCCoeffsBank);
 #endif
 
-    av_freep(&c->vLumFilterPos);
-    av_freep(&c->vChrFilterPos);
-    av_freep(&c->hLumFilterPos);
-    av_freep(&c->hChrFilterPos);
-
-#if HAVE_MMX_INLINE
-#if USE_MMAP
-    if (c->lumMmxextFilterCode)
-        munmap(c->lumMmxextFilterCode, c->lumMmxextFilterCodeSize);
-    if (c->chrMmxextFilterCode)
-        munmap(c->chrMmxextFilterCode, c->chrMmxextFilterCodeSize);
-#elif HAVE_VIRTUALALLOC
-    if (c->lumMmxextFilterCode)
-        VirtualFree(c->lumMmxextFilterCode, 0, MEM_RELEASE);
-    if (c->chrMmxextFilterCode)
-        VirtualFree(c->chrMmxextFilterCode, 0, MEM_RELEASE);
-#else
-    av_free(c->lumMmxextFilterCode);
-    av_free(c->chrMmxextFilterCode);
-#endif
-    c->lumMmxextFilterCode = NULL;
-    c->chrMmxextFilterCode = NULL;
-#endif /* HAVE_MMX_INLINE */
-
     av_freep(&c->yuvTable);
     av_free(c->formatConvBuffer);
 
@@ -21,4 +21,18 @@ $(FATE_LAVFI): $(VREF) libavfilter/filtfmts-test$(EXESUF)
 $(FATE_LAVFI): CMD = lavfitest
 
 FATE_AVCONV += $(FATE_LAVFI)
-fate-lavfi:    $(FATE_LAVFI)
+
+# a split whose outputs all need another format gets a single scaler on its
+# input; above 24 candidate links the per-output placement is kept; no
+# conversion is placed to or from a hwaccel format
+FATE_LAVFI_GRAPH = fate-lavfi-graph-split                               \
+                   fate-lavfi-graph-fallback                            \
+                   fate-lavfi-graph-hwaccel                             \
+
+$(FATE_LAVFI_GRAPH): tools/graph2dot$(EXESUF)
+$(FATE_LAVFI_GRAPH): CMD = run tools/graph2dot -i $(SRC_PATH)/tests/filtergraphs/$(@:fate-lavfi-graph-%=%)
+
+FATE-$(call ALLYES, COLOR_FILTER FORMAT_FILTER NULL_FILTER NULLSINK_FILTER \
+                    SCALE_FILTER SPLIT_FILTER) += $(FATE_LAVFI_GRAPH)
+
+fate-lavfi:    $(FATE_LAVFI) $(FATE_LAVFI_GRAPH)
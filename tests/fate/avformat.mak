@@ -51,3 +51,21 @@ $(FATE_LAVF): CMD = lavftest
 
 FATE_AVCONV += $(FATE_LAVF)
 fate-lavf:     $(FATE_LAVF)
+
+# demux the lavf outputs again with the input memory mapped by the file
+# protocol; the packets must be the same as without mapping
+FATE_LAVF_MMAP-$(call DEMDEC, MOV, MPEG4)              += mov
+FATE_LAVF_MMAP-$(call DEMDEC, MXF, MPEG2VIDEO)         += mxf
+FATE_LAVF_MMAP-$(call DEMDEC, RAWVIDEO, RAWVIDEO)      += rawvideo
+
+FATE_LAVF_MMAP = $(FATE_LAVF_MMAP-yes:%=fate-lavf-mmap-%)
+
+fate-lavf-mmap-mov: fate-lavf-mov
+fate-lavf-mmap-mov: CMD = framecrc -mmap 1 -i $(TARGET_PATH)/tests/data/lavf/lavf.mov -c copy
+fate-lavf-mmap-mxf: fate-lavf-mxf
+fate-lavf-mmap-mxf: CMD = framecrc -mmap 1 -i $(TARGET_PATH)/tests/data/lavf/lavf.mxf -c copy
+fate-lavf-mmap-rawvideo: $(VREF)
+fate-lavf-mmap-rawvideo: CMD = framecrc -mmap 1 -f rawvideo -s 352x288 -pix_fmt yuv420p -i $(TARGET_PATH)/tests/data/vsynth1.yuv -c copy
+
+FATE_AVCONV += $(FATE_LAVF_MMAP)
+fate-lavf-mmap: $(FATE_LAVF_MMAP)
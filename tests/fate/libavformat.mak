@@ -1,3 +1,7 @@
+FATE_LIBAVFORMAT-$(CONFIG_ASYNC_PROTOCOL) += fate-async
+fate-async: libavformat/async-test$(EXESUF)
+fate-async: CMD = run libavformat/async-test
+
 FATE_LIBAVFORMAT += fate-noproxy
 fate-noproxy: libavformat/noproxy-test$(EXESUF)
 fate-noproxy: CMD = run libavformat/noproxy-test
@@ -10,5 +14,7 @@ FATE_LIBAVFORMAT += fate-url
 fate-url: libavformat/url-test$(EXESUF)
 fate-url: CMD = run libavformat/url-test
 
+FATE_LIBAVFORMAT += $(FATE_LIBAVFORMAT-yes)
+
 FATE-$(CONFIG_AVFORMAT) += $(FATE_LIBAVFORMAT)
 fate-libavformat: $(FATE_LIBAVFORMAT)
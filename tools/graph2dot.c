@@ -108,7 +108,7 @@ int main(int argc, char **argv)
     FILE *outfile           = NULL;
     FILE *infile            = NULL;
     char *graph_string      = NULL;
-    AVFilterGraph *graph = av_mallocz(sizeof(AVFilterGraph));
+    AVFilterGraph *graph = avfilter_graph_alloc();
     char c;
 
     av_log_set_level(AV_LOG_DEBUG);